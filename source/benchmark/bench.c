@@ -0,0 +1,234 @@
+/* ---------------------------------------------------------------------------*
+ * bench.c
+ * Runs fmusim on the given FMUs with a range of solvers and output modes,
+ * and reports steps per second, FMI calls per second, output MB per second 
+ * and peak resident memory of each run.
+ * fmusim runs in a separate process with -profile, which counts the FMI calls.
+ * The wall time includes loading the FMU, and the memory is the maximum
+ * resident set size reported by wait4.
+ * Command syntax: bench [-t <tEnd>] [-h <h>] [-dir <dir>] <fmusim> <model.fmu>...
+ * POSIX only.
+ * ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_ARGS 32
+
+// a configuration of fmusim to measure
+typedef struct {
+    const char* name;
+    const char* args[6]; // options passed to fmusim, terminated by NULL
+} Config;
+
+static const Config configs[] = {
+    { "euler",          { "-solver", "euler", NULL } },
+    { "rk4",            { "-solver", "rk4", NULL } },
+    { "dopri5",         { "-solver", "dopri5", NULL } },
+    { "trbdf2",         { "-solver", "trbdf2", NULL } },
+    { "euler binary",   { "-solver", "euler", "-binary", NULL } },
+    { "euler async",    { "-solver", "euler", "-async", "4096", NULL } },
+    { "euler interval", { "-solver", "euler", "-interval", "0.1", NULL } },
+};
+#define N_CONFIGS (int)(sizeof(configs) / sizeof(Config))
+
+// measurements of one run
+typedef struct {
+    int steps;
+    unsigned long long calls;
+    double outputBytes;
+    double wallTime;
+    long maxRss; // kB
+} Result;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+// Returns everything read from fd, terminated by '\0', or NULL
+// if memory allocation fails
+static char* readAll(int fd) {
+    size_t size = 4096, n = 0;
+    char* text = (char*)malloc(size);
+    ssize_t k;
+    if (!text) return NULL;
+    while ((k = read(fd, text + n, size - n - 1)) > 0) {
+        n += k;
+        if (n + 1 == size) {
+            char* more = (char*)realloc(text, 2 * size);
+            if (!more) {
+                free(text);
+                return NULL;
+            }
+            text = more;
+            size *= 2;
+        }
+    }
+    text[n] = '\0';
+    return text;
+}
+
+// Parse the output of fmusim into result. Returns 0 to indicate failure.
+static int parseOutput(const char* text, const char* dir, Result* result) {
+    const char* p;
+    char name[PATH_MAX];
+    char path[PATH_MAX];
+    struct stat st;
+    if (!strstr(text, "terminated successful")) return 0;
+    p = strstr(text, "  steps ............ ");
+    if (!p || sscanf(p, "  steps ............ %d", &result->steps) != 1) return 0;
+
+    // sum the calls of all FMI functions in the profile
+    result->calls = 0;
+    p = strstr(text, "FMI function calls\n");
+    if (!p) return 0;
+    p = strchr(p, '\n') + 1; // header of the table
+    p = strchr(p, '\n');
+    while (p && !strncmp(p, "\n  fmi", 6)) {
+        unsigned long long calls;
+        if (sscanf(p + 1, "%*s %llu", &calls) == 1) result->calls += calls;
+        p = strchr(p + 1, '\n');
+    }
+
+    // size of the result file
+    result->outputBytes = 0;
+    p = strstr(text, " file '");
+    if (p && sscanf(p, " file '%[^']' written.", name) == 1) {
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (!stat(path, &st)) result->outputBytes = (double)st.st_size;
+    }
+    return 1;
+}
+
+// Run fmusim with the given arguments in dir and measure it.
+// Returns 0 to indicate failure.
+static int run(char* const* args, const char* dir, Result* result) {
+    int fd[2], status, ok;
+    struct rusage usage;
+    char* text;
+    double start;
+    pid_t pid;
+    if (pipe(fd)) {
+        printf("error: Could not create pipe\n");
+        return 0;
+    }
+    start = now();
+    pid = fork();
+    if (pid < 0) {
+        printf("error: Could not start %s\n", args[0]);
+        close(fd[0]);
+        close(fd[1]);
+        return 0;
+    }
+    if (pid == 0) {
+        close(fd[0]);
+        dup2(fd[1], STDOUT_FILENO);
+        close(fd[1]);
+        if (chdir(dir)) _exit(127);
+        execv(args[0], args);
+        _exit(127);
+    }
+    close(fd[1]);
+    text = readAll(fd[0]);
+    close(fd[0]);
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        free(text);
+        return 0;
+    }
+    result->wallTime = now() - start;
+    result->maxRss = usage.ru_maxrss;
+    ok = text && WIFEXITED(status) && WEXITSTATUS(status) == 0 
+            && parseOutput(text, dir, result);
+    free(text);
+    return ok;
+}
+
+static void printUsage(void) {
+    printf("usage: bench [-t <tEnd>] [-h <h>] [-dir <dir>] <fmusim> <model.fmu>...\n");
+    printf("   -t <tEnd> ...... end time of each simulation, default 10\n");
+    printf("   -h <h> ......... step size, default 0.001\n");
+    printf("   -dir <dir> ..... directory for the result files, default bench_run\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* tEnd = "10";
+    const char* h = "0.001";
+    const char* dir = "bench_run";
+    char fmusim[PATH_MAX];
+    char fmuPath[PATH_MAX];
+    char* args[MAX_ARGS];
+    int arg = 1, m, c, failures = 0;
+
+    while (arg < argc && argv[arg][0] == '-') {
+        if (!strcmp(argv[arg], "-t") && arg+1<argc) tEnd = argv[++arg];
+        else if (!strcmp(argv[arg], "-h") && arg+1<argc) h = argv[++arg];
+        else if (!strcmp(argv[arg], "-dir") && arg+1<argc) dir = argv[++arg];
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+        arg++;
+    }
+    if (argc - arg < 2) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    if (!realpath(argv[arg], fmusim)) {
+        printf("error: Could not find %s\n", argv[arg]);
+        return EXIT_FAILURE;
+    }
+    mkdir(dir, 0777);
+
+    printf("tEnd %s, h %s\n", tEnd, h);
+    printf("%-20s %-16s %8s %10s %12s %10s %8s %10s\n", "model", "run", "steps", 
+            "steps/s", "FMI calls/s", "MB/s", "RSS [MB]", "time [s]");
+    for (m=arg+1; m<argc; m++) {
+        const char* base = strrchr(argv[m], '/') ? strrchr(argv[m], '/') + 1 : argv[m];
+        char model[PATH_MAX];
+        char* suffix;
+        snprintf(model, sizeof(model), "%s", base);
+        suffix = strstr(model, ".fmu");
+        if (suffix) *suffix = '\0';
+        if (!realpath(argv[m], fmuPath)) {
+            printf("error: Could not find %s\n", argv[m]);
+            failures++;
+            continue;
+        }
+        for (c=0; c<N_CONFIGS; c++) {
+            const Config* config = &configs[c];
+            Result result;
+            int n = 0, i;
+            args[n++] = fmusim;
+            args[n++] = "-profile";
+            for (i=0; config->args[i]; i++) args[n++] = (char*)config->args[i];
+            args[n++] = fmuPath;
+            args[n++] = (char*)tEnd;
+            args[n++] = (char*)h;
+            args[n++] = "0"; // loggingOn
+            args[n++] = ";"; // csv separator
+            args[n] = NULL;
+            if (!run(args, dir, &result)) {
+                printf("%-20s %-16s failed\n", model, config->name);
+                failures++;
+                continue;
+            }
+            printf("%-20s %-16s %8d %10.0f %12.0f %10.2f %8.1f %10.3f\n", model, config->name, 
+                    result.steps, result.steps / result.wallTime, result.calls / result.wallTime, 
+                    result.outputBytes / 1e6 / result.wallTime, result.maxRss / 1024.0, 
+                    result.wallTime);
+            fflush(stdout);
+        }
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/* ---------------------------------------------------------------------------*
+ * Benchmark FMU - a stiff chain of N masses connected by springs and 
+ * dampers, the first one to a wall, the last one free.
+ * The size N is set by generated.h, written by genmodel.
+ * Equations, for k = 1..N:
+ *  der(x[k]) = v[k];
+ *  der(v[k]) = c * (x[k-1] - 2 * x[k] + x[k+1]) 
+ *            + d * (v[k-1] - 2 * v[k] + v[k+1]);
+ *  where
+ *    x[k]   displacement of mass k [m], used as state, start = 1 for k = N
+ *    v[k]   velocity of mass k [m/s], used as state
+ *    x[0], v[0]      are 0, the wall
+ *    x[N+1], v[N+1]  are x[N] and v[N], the free end
+ *    c      stiffness of the springs [N/m], a parameter, start = 1e4
+ *    d      damping of the dampers [Ns/m], a parameter, start = 100
+ *  All masses are 1 kg. The fastest modes decay with rate up to 4 * d, 
+ *  the slowest ones oscillate with a frequency that falls with N, 
+ *  which makes the model stiff.
+ * ---------------------------------------------------------------------------*/
+
+// define class name and unique id
+#define MODEL_IDENTIFIER chain
+#include "generated.h"
+
+// define model size
+#define NUMBER_OF_REALS (4 * N + 2)
+#define NUMBER_OF_INTEGERS 0
+#define NUMBER_OF_BOOLEANS 0
+#define NUMBER_OF_STRINGS 0
+#define NUMBER_OF_STATES (2 * N)
+#define NUMBER_OF_EVENT_INDICATORS 0
+
+// include fmu header files, typedefs and macros
+#include "fmuTemplate.h"
+
+// define all model variables and their value references
+// conventions used here:
+// - if x is a variable, then macro x_ is its variable reference
+// - the vr of a variable is its index in array  r, i, b or s
+// - if k is the vr of a real state, then k+1 is the vr of its derivative
+// - the states of mass k = 0..N-1 start at vr 4*k
+#define x_(k)     (4 * (k))
+#define v_(k)     (4 * (k) + 2)
+#define c_        (4 * N)
+#define d_        (4 * N + 1)
+
+// displacement and velocity of mass k, with the wall left of the chain
+// and the free end right of it
+#define x(k) ((k) < 0 ? 0 : r(x_((k) < N ? (k) : N - 1)))
+#define v(k) ((k) < 0 ? 0 : r(v_((k) < N ? (k) : N - 1)))
+
+// called by fmiInstantiateModel
+// Set values for all variables that define a start value
+// Settings used unless changed by fmiSetX before fmiInitialize
+void setStartValues(ModelInstance *comp) {
+    int k;
+    for (k=0; k<N; k++) {
+        r(x_(k)) = k == N - 1 ? 1 : 0;
+        r(v_(k)) = 0;
+    }
+    r(c_) = 1e4;
+    r(d_) = 100;
+}
+
+// called by fmiGetReal, fmiGetContinuousStates and fmiGetDerivatives
+fmiReal getReal(ModelInstance* comp, fmiValueReference vr){
+    int k = vr / 4;
+    if (vr >= c_) return r(vr);
+    switch (vr % 4) {
+        case 0 : return r(x_(k));
+        case 1 : return r(v_(k));
+        case 2 : return r(v_(k));
+        default: return r(c_) * (x(k-1) - 2 * x(k) + x(k+1)) 
+                      + r(d_) * (v(k-1) - 2 * v(k) + v(k+1));
+    }
+}
+
+// called by fmiInitialize() after setting eventInfo to defaults
+// Used to set the first time event, if any.
+void initialize(ModelInstance* comp, fmiEventInfo* eventInfo) {
+}
+
+// called by fmiEventUpdate() after setting eventInfo to defaults
+void eventUpdate(ModelInstance* comp, fmiEventInfo* eventInfo) {
+} 
+
+// include code that implements the FMI based on the above definitions
+#include "fmuTemplate.c"
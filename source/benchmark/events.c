@@ -0,0 +1,81 @@
+/* ---------------------------------------------------------------------------*
+ * Benchmark FMU - N sawtooth signals, each with its own state event.
+ * The size N is set by generated.h, written by genmodel.
+ * Equations, for k = 1..N:
+ *  der(phi[k]) = 1 + (k-1)/N;
+ *  when phi[k] > 1 then phi[k] := phi[k] - 1;
+ *  where
+ *    phi[k] phase of signal k, used as state, start = (k-1)/N
+ * The phases start and rise differently, so that the events rarely coincide.
+ * ---------------------------------------------------------------------------*/
+
+// define class name and unique id
+#define MODEL_IDENTIFIER events
+#include "generated.h"
+
+// define model size
+#define NUMBER_OF_REALS (2 * N)
+#define NUMBER_OF_INTEGERS 0
+#define NUMBER_OF_BOOLEANS 0
+#define NUMBER_OF_STRINGS 0
+#define NUMBER_OF_STATES N
+#define NUMBER_OF_EVENT_INDICATORS N
+
+// include fmu header files, typedefs and macros
+#include "fmuTemplate.h"
+
+// define all model variables and their value references
+// conventions used here:
+// - if x is a variable, then macro x_ is its variable reference
+// - the vr of a variable is its index in array  r, i, b or s
+// - if k is the vr of a real state, then k+1 is the vr of its derivative
+#define phi_(k)     (2 * (k))
+#define der_phi_(k) (2 * (k) + 1)
+
+// called by fmiInstantiateModel
+// Set values for all variables that define a start value
+// Settings used unless changed by fmiSetX before fmiInitialize
+void setStartValues(ModelInstance *comp) {
+    int k;
+    for (k=0; k<N; k++) {
+        r(phi_(k)) = (double)k / N;
+        r(der_phi_(k)) = 1 + (double)k / N;
+        pos(k) = r(phi_(k)) < 1;
+    }
+}
+
+// called by fmiGetReal, fmiGetContinuousStates and fmiGetDerivatives
+fmiReal getReal(ModelInstance* comp, fmiValueReference vr){
+    return r(vr);
+}
+
+// called by fmiInitialize() after setting eventInfo to defaults
+// Used to set the first time event, if any.
+void initialize(ModelInstance* comp, fmiEventInfo* eventInfo) {
+}
+
+// offset for event indicator, adds hysteresis and prevents z=0 at restart 
+#define EPS_INDICATORS 1e-14
+
+fmiReal getEventIndicator(ModelInstance* comp, int z) {
+    return 1 - r(phi_(z)) + (pos(z) ? EPS_INDICATORS : -EPS_INDICATORS);
+}
+
+// Used to set the next time event, if any.
+void eventUpdate(ModelInstance* comp, fmiEventInfo* eventInfo) {
+    int k;
+    for (k=0; k<N; k++) {
+        if (pos(k) && r(phi_(k)) >= 1) {
+            r(phi_(k)) -= 1;
+        }
+        pos(k) = r(phi_(k)) < 1;
+    }
+    eventInfo->iterationConverged  = fmiTrue;
+    eventInfo->stateValueReferencesChanged = fmiFalse;
+    eventInfo->stateValuesChanged  = fmiTrue;
+    eventInfo->terminateSimulation = fmiFalse;
+    eventInfo->upcomingTimeEvent   = fmiFalse;
+} 
+
+// include code that implements the FMI based on the above definitions
+#include "fmuTemplate.c"
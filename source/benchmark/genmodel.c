@@ -0,0 +1,209 @@
+/* ---------------------------------------------------------------------------*
+ * genmodel.c
+ * Writes modelDescription.xml and generated.h of a benchmark model of size n
+ * to the given directory. generated.h defines N, MODEL_GUID and STATES for
+ * the model source, which includes it before fmuTemplate.h.
+ * Command syntax: genmodel <model> <n> <dir>
+ * ---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFSIZE 4096
+
+// write the start of the model description
+static void header(FILE* f, const char* model, const char* guid, int nx, int nz) {
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n");
+    fprintf(f, "<fmiModelDescription\n");
+    fprintf(f, "  fmiVersion=\"1.0\"\n");
+    fprintf(f, "  modelName=\"%s\"\n", model);
+    fprintf(f, "  modelIdentifier=\"%s\"\n", model);
+    fprintf(f, "  guid=\"%s\"\n", guid);
+    fprintf(f, "  numberOfContinuousStates=\"%d\"\n", nx);
+    fprintf(f, "  numberOfEventIndicators=\"%d\">\n", nz);
+    fprintf(f, "<ModelVariables>\n");
+}
+
+static void footer(FILE* f) {
+    fprintf(f, "</ModelVariables>\n");
+    fprintf(f, "</fmiModelDescription>\n");
+}
+
+// write a variable of the given type, with attributes of the type element
+// and of the variable, e.g. causality, which may be empty
+static void variable(FILE* f, const char* name, int vr, const char* description, 
+        const char* type, const char* typeAttributes, const char* attributes) {
+    fprintf(f, "  <ScalarVariable name=\"%s\" valueReference=\"%d\" description=\"%s\"%s>\n",
+            name, vr, description, attributes);
+    fprintf(f, "     <%s%s/>\n", type, typeAttributes);
+    fprintf(f, "  </ScalarVariable>\n");
+}
+
+// write the derivative of state, which depends on the nDeps given states
+static void derivative(FILE* f, const char* state, int vr, const char* description, 
+        const char** deps, int nDeps) {
+    int i;
+    fprintf(f, "  <ScalarVariable name=\"der(%s)\" valueReference=\"%d\" description=\"%s\">\n",
+            state, vr, description);
+    fprintf(f, "     <Real/>\n");
+    fprintf(f, "     <DirectDependency>\n");
+    for (i=0; i<nDeps; i++) fprintf(f, "       <Name>%s</Name>\n", deps[i]);
+    fprintf(f, "     </DirectDependency>\n");
+    fprintf(f, "  </ScalarVariable>\n");
+}
+
+// Returns the name of element k of the array, for k = 0..n-1, 
+// or NULL if k is out of range. The name is kept in the given slot
+// until the slot is used again.
+#define SLOTS 8
+#define STATE (SLOTS - 1) // slot used for the name of the state
+static char names[SLOTS][32];
+static const char* name(int slot, const char* array, int k, int n) {
+    if (k < 0 || k >= n) return NULL;
+    sprintf(names[slot], "%s[%d]", array, k + 1);
+    return names[slot];
+}
+
+// add the non-NULL name to deps
+static void add(const char** deps, int* nDeps, const char* name) {
+    if (name) deps[(*nDeps)++] = name;
+}
+
+// N oscillators in a row, each coupled to its neighbours by springs
+static void oscillators(FILE* f, const char* guid, int n) {
+    int k;
+    header(f, "oscillators", guid, 2 * n, 0);
+    for (k=0; k<n; k++) {
+        const char* deps[3];
+        int nDeps = 0;
+        variable(f, name(STATE, "p", k, n), 4*k, "position", "Real", 
+                k == 0 ? " start=\"1\" fixed=\"true\"" : " start=\"0\" fixed=\"true\"", "");
+        add(deps, &nDeps, name(1, "v", k, n));
+        derivative(f, name(STATE, "p", k, n), 4*k + 1, "velocity", deps, nDeps);
+        variable(f, name(STATE, "v", k, n), 4*k + 2, "velocity", "Real", 
+                " start=\"0\" fixed=\"true\"", "");
+        nDeps = 0;
+        add(deps, &nDeps, name(1, "p", k - 1, n));
+        add(deps, &nDeps, name(2, "p", k, n));
+        add(deps, &nDeps, name(3, "p", k + 1, n));
+        derivative(f, name(STATE, "v", k, n), 4*k + 3, "acceleration", deps, nDeps);
+    }
+    variable(f, "c0", 4*n, "stiffness of each oscillator", "Real", 
+            " start=\"1\" fixed=\"true\"", " variability=\"parameter\"");
+    variable(f, "c", 4*n + 1, "stiffness of the coupling", "Real", 
+            " start=\"0.5\" fixed=\"true\"", " variability=\"parameter\"");
+    footer(f);
+}
+
+// N masses in a chain of springs and dampers fixed to a wall
+static void chain(FILE* f, const char* guid, int n) {
+    int k;
+    header(f, "chain", guid, 2 * n, 0);
+    for (k=0; k<n; k++) {
+        const char* deps[6];
+        int nDeps = 0;
+        variable(f, name(STATE, "x", k, n), 4*k, "displacement", "Real", 
+                k == n - 1 ? " start=\"1\" fixed=\"true\"" : " start=\"0\" fixed=\"true\"", "");
+        add(deps, &nDeps, name(1, "v", k, n));
+        derivative(f, name(STATE, "x", k, n), 4*k + 1, "velocity", deps, nDeps);
+        variable(f, name(STATE, "v", k, n), 4*k + 2, "velocity", "Real", 
+                " start=\"0\" fixed=\"true\"", "");
+        nDeps = 0;
+        add(deps, &nDeps, name(0, "x", k - 1, n));
+        add(deps, &nDeps, name(2, "x", k, n));
+        add(deps, &nDeps, name(3, "x", k + 1, n));
+        add(deps, &nDeps, name(1, "v", k - 1, n));
+        add(deps, &nDeps, name(4, "v", k, n));
+        add(deps, &nDeps, name(5, "v", k + 1, n));
+        derivative(f, name(STATE, "v", k, n), 4*k + 3, "acceleration", deps, nDeps);
+    }
+    variable(f, "c", 4*n, "stiffness of the springs", "Real", 
+            " start=\"10000\" fixed=\"true\"", " variability=\"parameter\"");
+    variable(f, "d", 4*n + 1, "damping of the dampers", "Real", 
+            " start=\"100\" fixed=\"true\"", " variability=\"parameter\"");
+    footer(f);
+}
+
+// N phases that rise with different rates and wrap around at 1
+static void events(FILE* f, const char* guid, int n) {
+    int k;
+    header(f, "events", guid, n, n);
+    for (k=0; k<n; k++) {
+        char start[64];
+        sprintf(start, " start=\"%.17g\" fixed=\"true\"", (double)k / n);
+        variable(f, name(STATE, "phi", k, n), 2*k, "phase", "Real", start, "");
+        derivative(f, name(STATE, "phi", k, n), 2*k + 1, "rate", NULL, 0);
+    }
+    footer(f);
+}
+
+// N Integer and N String outputs that change at each sample time
+static void outputs(FILE* f, const char* guid, int n) {
+    int k;
+    header(f, "outputs", guid, 1, 0);
+    variable(f, "t", 0, "time since start", "Real", " start=\"0\" fixed=\"true\"", "");
+    fprintf(f, "  <ScalarVariable name=\"der(t)\" valueReference=\"1\" description=\"rate of t\">\n");
+    fprintf(f, "     <Real/>\n");
+    fprintf(f, "  </ScalarVariable>\n");
+    variable(f, "period", 2, "sample period", "Real", " start=\"0.01\" fixed=\"true\"", 
+            " variability=\"parameter\"");
+    for (k=0; k<n; k++) {
+        variable(f, name(STATE, "i", k, n), k, "counter", "Integer", "", 
+                " variability=\"discrete\" causality=\"output\"");
+    }
+    for (k=0; k<n; k++) {
+        variable(f, name(STATE, "s", k, n), k, "name of the month", "String", "", 
+                " variability=\"discrete\" causality=\"output\"");
+    }
+    footer(f);
+}
+
+int main(int argc, char* argv[]) {
+    char path[BUFSIZE];
+    char guid[BUFSIZE];
+    const char* model;
+    int k, n, nx;
+    FILE* f;
+    if (argc != 4 || sscanf(argv[2], "%d", &n) != 1 || n < 1) {
+        printf("usage: genmodel <model> <n> <dir>\n");
+        return EXIT_FAILURE;
+    }
+    model = argv[1];
+    if (!strcmp(model, "oscillators") || !strcmp(model, "chain")) nx = 2 * n;
+    else if (!strcmp(model, "events")) nx = n;
+    else if (!strcmp(model, "outputs")) nx = 1;
+    else {
+        printf("error: Unknown model %s, expected oscillators, chain, events or outputs\n", model);
+        return EXIT_FAILURE;
+    }
+    sprintf(guid, "{fmusim-benchmark-%s-%d}", model, n);
+
+    sprintf(path, "%s/modelDescription.xml", argv[3]);
+    f = fopen(path, "w");
+    if (!f) {
+        printf("error: Could not open '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+    if (!strcmp(model, "oscillators")) oscillators(f, guid, n);
+    else if (!strcmp(model, "chain")) chain(f, guid, n);
+    else if (!strcmp(model, "events")) events(f, guid, n);
+    else outputs(f, guid, n);
+    fclose(f);
+
+    // states have even value references, followed by their derivatives
+    sprintf(path, "%s/generated.h", argv[3]);
+    f = fopen(path, "w");
+    if (!f) {
+        printf("error: Could not open '%s'\n", path);
+        return EXIT_FAILURE;
+    }
+    fprintf(f, "// generated by genmodel %s %d\n", model, n);
+    fprintf(f, "#define N %d\n", n);
+    fprintf(f, "#define MODEL_GUID \"%s\"\n", guid);
+    fprintf(f, "#define STATES {");
+    for (k=0; k<nx; k++) fprintf(f, "%s%s%d", k > 0 ? "," : " ", k % 16 == 15 ? "\\\n    " : "", 2*k);
+    fprintf(f, " }\n");
+    fclose(f);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+/* ---------------------------------------------------------------------------*
+ * Benchmark FMU - N harmonic oscillators coupled to their neighbours.
+ * The size N is set by generated.h, written by genmodel.
+ * Equations, for k = 1..N:
+ *  der(p[k]) = v[k];
+ *  der(v[k]) = -c0 * p[k] + c * (p[k-1] - 2 * p[k] + p[k+1]);
+ *  where
+ *    p[k]   position of oscillator k, used as state, start = 1 for k = 1
+ *    v[k]   velocity of oscillator k, used as state
+ *    p[0], p[N+1]  are 0
+ *    c0     stiffness of each oscillator, a parameter, start = 1
+ *    c      stiffness of the coupling, a parameter, start = 0.5
+ * ---------------------------------------------------------------------------*/
+
+// define class name and unique id
+#define MODEL_IDENTIFIER oscillators
+#include "generated.h"
+
+// define model size
+#define NUMBER_OF_REALS (4 * N + 2)
+#define NUMBER_OF_INTEGERS 0
+#define NUMBER_OF_BOOLEANS 0
+#define NUMBER_OF_STRINGS 0
+#define NUMBER_OF_STATES (2 * N)
+#define NUMBER_OF_EVENT_INDICATORS 0
+
+// include fmu header files, typedefs and macros
+#include "fmuTemplate.h"
+
+// define all model variables and their value references
+// conventions used here:
+// - if x is a variable, then macro x_ is its variable reference
+// - the vr of a variable is its index in array  r, i, b or s
+// - if k is the vr of a real state, then k+1 is the vr of its derivative
+// - the states of oscillator k = 0..N-1 start at vr 4*k
+#define p_(k)     (4 * (k))
+#define v_(k)     (4 * (k) + 2)
+#define c0_       (4 * N)
+#define c_        (4 * N + 1)
+
+// position of oscillator k, 0 outside of the row
+#define p(k) ((k) < 0 || (k) >= N ? 0 : r(p_(k)))
+
+// called by fmiInstantiateModel
+// Set values for all variables that define a start value
+// Settings used unless changed by fmiSetX before fmiInitialize
+void setStartValues(ModelInstance *comp) {
+    int k;
+    for (k=0; k<N; k++) {
+        r(p_(k)) = k == 0 ? 1 : 0;
+        r(v_(k)) = 0;
+    }
+    r(c0_) = 1;
+    r(c_)  = 0.5;
+}
+
+// called by fmiGetReal, fmiGetContinuousStates and fmiGetDerivatives
+fmiReal getReal(ModelInstance* comp, fmiValueReference vr){
+    int k = vr / 4;
+    if (vr >= c0_) return r(vr);
+    switch (vr % 4) {
+        case 0 : return r(p_(k));
+        case 1 : return r(v_(k));
+        case 2 : return r(v_(k));
+        default: return - r(c0_) * p(k) + r(c_) * (p(k-1) - 2 * p(k) + p(k+1));
+    }
+}
+
+// called by fmiInitialize() after setting eventInfo to defaults
+// Used to set the first time event, if any.
+void initialize(ModelInstance* comp, fmiEventInfo* eventInfo) {
+}
+
+// called by fmiEventUpdate() after setting eventInfo to defaults
+void eventUpdate(ModelInstance* comp, fmiEventInfo* eventInfo) {
+} 
+
+// include code that implements the FMI based on the above definitions
+#include "fmuTemplate.c"
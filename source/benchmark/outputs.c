@@ -0,0 +1,89 @@
+/* ---------------------------------------------------------------------------*
+ * Benchmark FMU - N Integer and N String outputs that change at each 
+ * sample time. This loads the output of fmusim rather than the solver.
+ * The size N is set by generated.h, written by genmodel.
+ * Equations, for k = 1..N:
+ *  der(t) = 1;
+ *  when sample(0, period) then
+ *    i[k] := pre(i[k]) + k;
+ *    s[k] := month[mod(i[k], 12)];
+ *  end when;
+ *  where
+ *    t      time since start [s], used as state
+ *    period sample period [s], a parameter, start = 0.01
+ * ---------------------------------------------------------------------------*/
+
+// define class name and unique id
+#define MODEL_IDENTIFIER outputs
+#include "generated.h"
+
+// define model size
+#define NUMBER_OF_REALS 3
+#define NUMBER_OF_INTEGERS N
+#define NUMBER_OF_BOOLEANS 0
+#define NUMBER_OF_STRINGS N
+#define NUMBER_OF_STATES 1
+#define NUMBER_OF_EVENT_INDICATORS 0
+
+// include fmu header files, typedefs and macros
+#include "fmuTemplate.h"
+
+// define all model variables and their value references
+// conventions used here:
+// - if x is a variable, then macro x_ is its variable reference
+// - the vr of a variable is its index in array  r, i, b or s
+// - if k is the vr of a real state, then k+1 is the vr of its derivative
+#define t_        0
+#define der_t_    1
+#define period_   2
+#define i_(k)     (k)
+#define s_(k)     (k)
+
+const char* month[] = {
+    "jan","feb","march","april","may","june","july",
+    "august","sept","october","november","december"
+};
+
+// called by fmiInstantiateModel
+// Set values for all variables that define a start value
+// Settings used unless changed by fmiSetX before fmiInitialize
+void setStartValues(ModelInstance *comp) {
+    int k;
+    r(t_) = 0;
+    r(period_) = 0.01;
+    for (k=0; k<N; k++) {
+        i(i_(k)) = 0;
+        s(s_(k)) = month[0];
+    }
+}
+
+// called by fmiGetReal, fmiGetContinuousStates and fmiGetDerivatives
+fmiReal getReal(ModelInstance* comp, fmiValueReference vr){
+    switch (vr) {
+        case t_      : return r(t_);
+        case der_t_  : return 1;
+        case period_ : return r(period_);
+        default: return 0;
+    }
+}
+
+// called by fmiInitialize() after setting eventInfo to defaults
+// Used to set the first time event, if any.
+void initialize(ModelInstance* comp, fmiEventInfo* eventInfo) {
+    eventInfo->upcomingTimeEvent   = fmiTrue;
+    eventInfo->nextEventTime       = r(period_) + comp->time;
+}
+
+// called by fmiEventUpdate() after setting eventInfo to defaults
+void eventUpdate(ModelInstance* comp, fmiEventInfo* eventInfo) {
+    int k;
+    eventInfo->upcomingTimeEvent   = fmiTrue;
+    eventInfo->nextEventTime       = r(period_) + comp->time;
+    for (k=0; k<N; k++) {
+        i(i_(k)) += k + 1;
+        s(s_(k)) = month[i(i_(k)) % 12];
+    }
+} 
+
+// include code that implements the FMI based on the above definitions
+#include "fmuTemplate.c"
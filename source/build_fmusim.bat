@@ -11,7 +11,7 @@ if defined VS90COMNTOOLS (call "%VS90COMNTOOLS%\vsvars32.bat") else ^
 if defined VS80COMNTOOLS (call "%VS80COMNTOOLS%\vsvars32.bat") else ^
 goto noCompiler
 
-set SRC=main.c xml_parser.c stack.c fmuinit.c fmusim.c fmuio.c fmuzip.c
+set SRC=main.c xml_parser.c stack.c fmuinit.c fmusim.c fmuio.c fmuzip.c inflate.c arena.c mdcache.c numfmt.c fmuthread.c solver.c sparsity.c params.c ensemble.c scheduler.c workspace.c logger.c profile.c
 
 rem create fmusim.exe in the fmusim dir
 pushd fmusim
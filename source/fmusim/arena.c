@@ -0,0 +1,88 @@
+/* -------------------------------------------------------------------------
+ * arena.c
+ * A growable arena of zero-initialized memory that is released as a whole.
+ * Memory is handed out from large blocks by bumping a pointer.
+ * When a block is full, a new block of twice the size is allocated,
+ * so that the number of blocks grows with the logarithm of the total size.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 8 // alignment of arenaAlloc, enough for double and pointers
+
+// offset of the first usable byte of a block
+#define BLOCK_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+// Returns NULL if memory allocation fails
+Arena* arenaNew(size_t initialSize) {
+    Arena* a = (Arena*)calloc(1, sizeof(Arena));
+    if (!a) return NULL;
+    a->blockSize = initialSize > 0 ? initialSize : 4096;
+    return a;
+}
+
+// add a new current block with at least n free bytes
+// returns 0 to indicate error
+static int addBlock(Arena* a, size_t n) {
+    ArenaBlock* b;
+    size_t size = a->blockSize;
+    while (size < n) size *= 2;
+    b = (ArenaBlock*)calloc(1, BLOCK_HEADER + size);
+    if (!b) return 0; // error
+    b->size = size;
+    b->used = 0;
+    b->next = a->blocks;
+    a->blocks = b;
+    a->blockSize = 2 * size;
+    return 1; // success
+}
+
+// hand out n bytes from the current block, starting at the given alignment
+static void* take(Arena* a, size_t n, size_t align) {
+    ArenaBlock* b = a->blocks;
+    size_t start = 0;
+    if (b) start = (b->used + align - 1) & ~(align - 1);
+    if (!b || start + n > b->size) {
+        if (!addBlock(a, n)) return NULL;
+        b = a->blocks;
+        start = 0;
+    }
+    b->used = start + n;
+    a->total += n;
+    return (char*)b + BLOCK_HEADER + start;
+}
+
+// Returns n bytes of zero-initialized, aligned memory,
+// or NULL if memory allocation fails
+void* arenaAlloc(Arena* a, size_t n) {
+    return take(a, n, ARENA_ALIGN);
+}
+
+// Returns a copy of the first n chars of s, terminated by '\0',
+// or NULL if memory allocation fails
+char* arenaStrndup(Arena* a, const char* s, size_t n) {
+    char* copy = (char*)take(a, n + 1, 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, n);
+    copy[n] = '\0';
+    return copy;
+}
+
+char* arenaStrdup(Arena* a, const char* s) {
+    return arenaStrndup(a, s, strlen(s));
+}
+
+// release the arena and all memory handed out by it
+void arenaFree(Arena* a) {
+    ArenaBlock* b;
+    if (!a) return;
+    b = a->blocks;
+    while (b) {
+        ArenaBlock* next = b->next;
+        free(b);
+        b = next;
+    }
+    free(a);
+}
@@ -0,0 +1,29 @@
+/* -------------------------------------------------------------------------
+ * arena.h
+ * A growable arena of zero-initialized memory that is released as a whole.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next; // previously filled block, or NULL
+    size_t size;             // usable bytes in this block
+    size_t used;             // bytes handed out from this block
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* blocks;      // current block, followed by the filled ones
+    size_t blockSize;        // size of the next block, doubled for each block
+    size_t total;            // bytes handed out from all blocks
+} Arena;
+
+Arena* arenaNew(size_t initialSize);
+void* arenaAlloc(Arena* a, size_t n);
+char* arenaStrndup(Arena* a, const char* s, size_t n);
+char* arenaStrdup(Arena* a, const char* s);
+void arenaFree(Arena* a);
+
+#endif // ARENA_H
@@ -0,0 +1,130 @@
+/* -------------------------------------------------------------------------
+ * ensemble.c
+ * Simulation of one FMU for many parameter sets in parallel. The FMU is
+ * loaded once, each set gets its own model instance and result file.
+ * The simulations are run by a work-stealing scheduler, optionally in slices
+ * of simulated time, so that a slice of a long run on a busy worker does
+ * not keep the sets queued behind it from being taken by idle workers.
+ * Each worker reuses the work arrays of its finished simulations.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ensemble.h"
+#include "scheduler.h"
+#include "profile.h"
+
+// state shared by the workers of an ensemble
+typedef struct {
+    FMU* fmu;
+    SimulationOptions* options;
+    ParameterTable* table;
+    double slice;               // simulated time per task, 0 for whole runs
+    char** instanceNames;       // instance name of each set
+    char** resultFiles;         // result file of each set
+    Workspace* workspaces;      // one per worker
+} Ensemble;
+
+// the simulation of one set
+typedef struct {
+    int row;
+    Simulation* sim;            // NULL before the first and after the last slice
+    int failed;                 // 1 if the simulation failed
+} Job;
+
+// Returns a copy of name with "_<n>" inserted before the extension,
+// or NULL if out of memory
+static char* numberedName(const char* name, int n) {
+    const char* dot = strrchr(name, '.');
+    size_t len = dot ? (size_t)(dot - name) : strlen(name);
+    char* copy = (char*)malloc(strlen(name) + 12);
+    if (!copy) return NULL;
+    sprintf(copy, "%.*s_%d%s", (int)len, name, n, dot ? dot : "");
+    return copy;
+}
+
+// task function: simulate the next slice of the job
+static int simulateSlice(void* task, int worker, void* context) {
+    Job* job = (Job*)task;
+    Ensemble* e = (Ensemble*)context;
+    Workspace* w = &e->workspaces[worker];
+    Simulation* sim = job->sim;
+    int ok;
+    if (!sim) {
+        sim = newSimulation(e->fmu, e->options, e->instanceNames[job->row], 
+                e->resultFiles[job->row], e->table, job->row, w);
+        job->sim = sim;
+    }
+    ok = sim && simulateUntil(sim, e->slice > 0 ? sim->time + e->slice : e->options->tEnd);
+    if (ok && !simulationFinished(sim)) return TASK_AGAIN;
+    if (ok) printf("Set %d simulated to t=%g in %d steps with %d events, '%s' written.\n",
+            job->row + 1, sim->time, sim->nSteps, 
+            sim->nTimeEvents + sim->nStateEvents + sim->nStepEvents, e->resultFiles[job->row]);
+    else printf("error: Simulation of set %d failed\n", job->row + 1);
+    freeSimulation(sim, w);
+    job->sim = NULL;
+    job->failed = !ok;
+    return TASK_DONE;
+}
+
+// Simulate fmu for each row of table, using nThreads worker threads.
+// If slice > 0, the workers take turns in steps of slice simulated time.
+// Set n is written to the default result file with "_n" appended to its name.
+// Returns 0 if a simulation failed.
+int runEnsemble(FMU* fmu, SimulationOptions* options, ParameterTable* table, 
+        int nThreads, double slice) {
+    Ensemble e;
+    Job* jobs;
+    void** tasks;
+    const char* modelIdentifier = getModelIdentifier(fmu->modelDescription);
+    int i, n = table->nRows, nUsed, nFailed = 0, ok = 1;
+
+    memset(&e, 0, sizeof(Ensemble));
+    e.fmu = fmu;
+    e.options = options;
+    e.table = table;
+    e.slice = slice;
+    e.instanceNames = (char**)calloc(n, sizeof(char*));
+    e.resultFiles = (char**)calloc(n, sizeof(char*));
+    e.workspaces = (Workspace*)calloc(nThreads, sizeof(Workspace));
+    jobs = (Job*)calloc(n, sizeof(Job));
+    tasks = (void**)calloc(n, sizeof(void*));
+    if (!e.instanceNames || !e.resultFiles || !e.workspaces || !jobs || !tasks) {
+        ok = fmuError("out of memory");
+    }
+    for (i=0; ok && i<n; i++) {
+        e.instanceNames[i] = numberedName(modelIdentifier, i + 1);
+        e.resultFiles[i] = numberedName(defaultResultFile(options->output), i + 1);
+        if (!e.instanceNames[i] || !e.resultFiles[i]) ok = fmuError("out of memory");
+        else if (!registerLoggerInstance(e.instanceNames[i], fmu)) ok = 0;
+        jobs[i].row = i;
+        tasks[i] = &jobs[i];
+    }
+
+    if (ok) {
+        nUsed = runTasks(tasks, n, nThreads, simulateSlice, &e);
+        for (i=0; i<n; i++) nFailed += jobs[i].failed;
+        if (nUsed > 0) {
+            printf("Ensemble of %d sets simulated by %d threads, %d failed\n", 
+                    n, nUsed, nFailed);
+            printProfile();
+        }
+        ok = nUsed > 0 && nFailed == 0;
+    }
+
+    for (i=0; i<n; i++) {
+        if (e.instanceNames && e.instanceNames[i]) {
+            unregisterLoggerInstance(e.instanceNames[i]);
+            free(e.instanceNames[i]);
+        }
+        if (e.resultFiles && e.resultFiles[i]) free(e.resultFiles[i]);
+    }
+    for (i=0; e.workspaces && i<nThreads; i++) workspaceClear(&e.workspaces[i]);
+    free(e.instanceNames);
+    free(e.resultFiles);
+    free(e.workspaces);
+    free(jobs);
+    free(tasks);
+    return ok;
+}
@@ -0,0 +1,14 @@
+/* -------------------------------------------------------------------------
+ * ensemble.h
+ * Simulation of one FMU for many parameter sets in parallel.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ensemble_h
+#define ensemble_h
+
+#include "fmusim.h"
+
+int runEnsemble(FMU* fmu, SimulationOptions* options, ParameterTable* table, 
+        int nThreads, double slice);
+
+#endif // ensemble_h
@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _GNU_SOURCE // for memfd_create
+#endif
 #include "fmuinit.h"
 
 #include "xml_parser.h"
@@ -7,6 +10,10 @@
 #include <windows.h>
 #else
 #include <dlfcn.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/mman.h>
 #endif
 
 #define BUFSIZE 4096
@@ -26,18 +33,8 @@ static void* getAdr(FMU *fmu, const char* functionName){
     return fp;
 }
 
-// Load the given dll and set function pointers in fmu
-int fmuLoadDll(const char* dllPath, FMU *fmu) {
-#ifdef _MSC_VER
-    HANDLE h = LoadLibrary(dllPath);
-#else
-    printf("dllPath = %s\n", dllPath);
-    HANDLE h = dlopen(dllPath, RTLD_LAZY);
-#endif
-    if (!h) {
-        printf("error: Could not load %s\n", dllPath);
-        return 0; // failure
-    }
+// Set function pointers in fmu to the functions of the loaded dll h
+static int bindFunctions(HANDLE h, FMU *fmu) {
     fmu->dllHandle = h;
     fmu->getModelTypesPlatform   = (fGetModelTypesPlatform) getAdr(fmu, "fmiGetModelTypesPlatform");
     fmu->getVersion              = (fGetVersion)         getAdr(fmu, "fmiGetVersion");
@@ -66,6 +63,59 @@ int fmuLoadDll(const char* dllPath, FMU *fmu) {
     return 1; // success  
 }
 
+// Load the given dll and set function pointers in fmu
+int fmuLoadDll(const char* dllPath, FMU *fmu) {
+#ifdef _MSC_VER
+    HANDLE h = LoadLibrary(dllPath);
+#else
+    printf("dllPath = %s\n", dllPath);
+    HANDLE h = dlopen(dllPath, RTLD_LAZY);
+#endif
+    if (!h) {
+        printf("error: Could not load %s\n", dllPath);
+        return 0; // failure
+    }
+    return bindFunctions(h, fmu);
+}
+
+// Load a dll given as image of n bytes in memory, e.g. read directly from
+// the FMU archive, and set function pointers in fmu. name is used in
+// messages only. The image is copied to an anonymous memory file that
+// is loaded through /proc/self/fd, so that nothing is written to disk.
+// Supported on Linux only.
+int fmuLoadDllFromMemory(const unsigned char* image, size_t n, const char* name, FMU *fmu) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    char path[BUFSIZE];
+    HANDLE h;
+    size_t written = 0;
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd == -1) {
+        printf("error: Could not create memory file for %s\n", name);
+        return 0; // failure
+    }
+    while (written < n) {
+        ssize_t k = write(fd, image + written, n - written);
+        if (k <= 0) {
+            printf("error: Could not write memory file for %s\n", name);
+            close(fd);
+            return 0; // failure
+        }
+        written += k;
+    }
+    sprintf(path, "/proc/self/fd/%d", fd);
+    h = dlopen(path, RTLD_LAZY);
+    close(fd); // the mapping of the loaded library remains valid
+    if (!h) {
+        printf("error: Could not load %s from memory: %s\n", name, dlerror());
+        return 0; // failure
+    }
+    return bindFunctions(h, fmu);
+#else
+    printf("error: Loading %s from memory is not supported on this platform\n", name);
+    return 0; // failure
+#endif
+}
+
 void fmuFree(FMU *fmu) {
 #ifdef _MSC_VER
   FreeLibrary(fmu->dllHandle);
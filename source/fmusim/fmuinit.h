@@ -11,6 +11,7 @@
 #include "main.h"
 
 extern int fmuLoadDll(const char* dllPath, FMU *fmu);
+extern int fmuLoadDllFromMemory(const unsigned char* image, size_t n, const char* name, FMU *fmu);
 extern void fmuFree(FMU *fmu);
 
 #endif // fmuinit_h
@@ -1,195 +1,571 @@
 #include "fmuio.h"
+#include "numfmt.h"
+#include "logger.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <stdarg.h>
+#if !WINDOWS
+#include <regex.h>
+#endif
 
-extern FMU fmu;
+// space for one numeric column of a row, including the separator
+#define COLUMN_SIZE (NUMFMT_DOUBLE_SIZE + 1)
 
-static void doubleToCommaString(char* buffer, double r){
-    char* comma;
-    sprintf(buffer, "%.16g", r);
-    comma = strchr(buffer, '.');
-    if (comma) *comma = ',';
+static void finishBinaryFile(Output* out);
+
+// index of the value arrays of Output for the base type of a variable
+static int typeIndex(Elm baseType) {
+    switch (baseType) {
+        case elm_Real:    return 0;
+        case elm_Integer: return 1;
+        case elm_Boolean: return 2;
+        case elm_String:  return 3;
+        default:          return -1;
+    }
 }
 
-// output time and all non-alias variables in CSV format
-// if separator is ',', columns are separated by ',' and '.' is used for floating-point numbers.
-// otherwise, the given separator (e.g. ';' or '\t') is to separate columns, and ',' is used for 
-// floating-point numbers.
-void outputRow(FMU *fmu, fmiComponent c, double time, FILE* file, char separator, int header) {
-    int k;
-    fmiReal r;
-    fmiInteger i;
-    fmiBoolean b;
-    fmiString s;
-    fmiValueReference vr;
-    ScalarVariable** vars = fmu->modelDescription->modelVariables;
-    char buffer[32];
-    
-    // print first column
-    if (header) 
-        fprintf(file, "time"); 
-    else {
-        if (separator==',') 
-            fprintf(file, "%.16g", time);
+// Returns 0 to indicate failure (out of memory)
+static int initSample(OutputSample* sample, int n) {
+    sample->r = (fmiReal*)calloc(n + 1, sizeof(fmiReal));
+    sample->i = (fmiInteger*)calloc(n + 1, sizeof(fmiInteger));
+    sample->b = (fmiBoolean*)calloc(n + 1, sizeof(fmiBoolean));
+    sample->s = (fmiString*)calloc(n + 1, sizeof(fmiString));
+    return sample->r && sample->i && sample->b && sample->s;
+}
+
+static void freeSample(OutputSample* sample) {
+    free(sample->r);
+    free(sample->i);
+    free(sample->b);
+    free((void*)sample->s);
+    free(sample->strings);
+}
+
+static void writerThread(void* output);
+
+// Returns 1 if name matches the glob pattern, where
+// '*' matches any sequence of chars and '?' any single char.
+// Other chars, including '[' and ']' of array elements, match themselves.
+static int matchGlob(const char* pattern, const char* name) {
+    const char* star = NULL; // position of the last '*' in pattern
+    const char* next = NULL; // where to continue in name after backtracking
+    while (*name) {
+        if (*pattern=='*') {
+            star = pattern++;
+            next = name;
+        }
+        else if (*pattern=='?' || *pattern==*name) {
+            pattern++;
+            name++;
+        }
+        else if (star) {
+            pattern = star + 1; // let '*' match one more char
+            name = ++next;
+        }
+        else return 0;
+    }
+    while (*pattern=='*') pattern++;
+    return !*pattern;
+}
+
+// Returns 0 to indicate failure
+// Set selected[k] to 1 for each variable k matching a filter of options,
+// that is a variable name, a glob pattern with '*' or '?', or a POSIX
+// extended regular expression enclosed in '/'. Warns about filters that
+// match no variable.
+static int selectVariables(ModelDescription* md, OutputOptions* options, char* selected) {
+    ScalarVariable** vars = md->modelVariables;
+    int f, k, n;
+    for (f=0; f<options->nFilters; f++) {
+        const char* filter = options->filters[f];
+        size_t len = strlen(filter);
+        n = 0;
+        if (len>=2 && filter[0]=='/' && filter[len-1]=='/') {
+#if WINDOWS
+            printf("error: Regular expressions are not supported on this platform: %s\n", filter);
+            return 0;
+#else
+            regex_t re;
+            char* expr = (char*)calloc(len - 1, sizeof(char));
+            if (!expr) return fmuError("out of memory");
+            strncpy(expr, filter + 1, len - 2);
+            if (regcomp(&re, expr, REG_EXTENDED | REG_NOSUB)) {
+                printf("error: Illegal regular expression %s\n", filter);
+                free(expr);
+                return 0;
+            }
+            free(expr);
+            for (k=0; vars && vars[k]; k++) 
+                if (!regexec(&re, getName(vars[k]), 0, NULL, 0)) n += selected[k] = 1;
+            regfree(&re);
+#endif
+        }
+        else if (strpbrk(filter, "*?")) {
+            for (k=0; vars && vars[k]; k++) 
+                if (matchGlob(filter, getName(vars[k]))) n += selected[k] = 1;
+        }
         else {
-            // separator is e.g. ';' or '\t'
-            doubleToCommaString(buffer, time);
-            fprintf(file, "%s", buffer);       
+            ScalarVariable* sv = getVariableByName(md, filter);
+            for (k=0; sv && vars[k]; k++) 
+                if (vars[k]==sv) n += selected[k] = 1;
         }
+        if (!n) printf("warning: No variable matches %s\n", filter);
     }
-    
-    // print all other columns
-    for (k=0; vars[k]; k++) {
+    return 1; // success
+}
+
+// Returns NULL to indicate failure
+// Opens the result file and selects all non-alias variables as columns,
+// or the variables matching the filters of options, see selectVariables.
+// The value references of the columns are grouped by base type once here,
+// so that outputRow fetches all values of a row with one call per type.
+// All buffers are allocated here and reused for all rows.
+Output* newOutput(FMU* fmu, const char* path, OutputOptions* options) {
+    ScalarVariable** vars = fmu->modelDescription->modelVariables;
+    char* selected = NULL; // the variables matching a filter, if any
+    Output* out;
+    int k, t, n = 0;
+    out = (Output*)calloc(1, sizeof(Output));
+    if (!out) {
+        fmuError("out of memory");
+        return NULL;
+    }
+    out->options = *options;
+    if (vars) while (vars[n]) n++;
+    out->columns = (ScalarVariable**)calloc(n + 1, sizeof(ScalarVariable*));
+    out->index = (int*)calloc(n + 1, sizeof(int));
+    for (t=0; t<4; t++) 
+        out->vr[t] = (fmiValueReference*)calloc(n + 1, sizeof(fmiValueReference));
+    out->nSamples = options->bufferRows > 0 ? options->bufferRows : 1;
+    out->samples = (OutputSample*)calloc(out->nSamples, sizeof(OutputSample));
+    out->rowSize = (n + 2) * COLUMN_SIZE; // enough for numbers only
+    out->row = (char*)malloc(out->rowSize);
+    if (!out->row || !out->columns || !out->index || !out->vr[0] || !out->vr[1] 
+            || !out->vr[2] || !out->vr[3] || !out->samples) {
+        freeOutput(out);
+        fmuError("out of memory");
+        return NULL;
+    }
+    for (k=0; k<out->nSamples; k++) {
+        if (!initSample(&out->samples[k], n)) {
+            freeOutput(out);
+            fmuError("out of memory");
+            return NULL;
+        }
+    }
+    if (options->nFilters > 0) {
+        selected = (char*)calloc(n + 1, sizeof(char));
+        if (!selected) {
+            freeOutput(out);
+            fmuError("out of memory");
+            return NULL;
+        }
+        if (!selectVariables(fmu->modelDescription, options, selected)) {
+            free(selected);
+            freeOutput(out);
+            return NULL;
+        }
+    }
+    for (k=0; k<n; k++) {
         ScalarVariable* sv = vars[k];
-        if (getAlias(sv)!=enu_noAlias) continue;
-        if (header) {
-            // output names only
-            fprintf(file, "%c%s", separator, getName(sv));
+        if (selected ? !selected[k] : getAlias(sv)!=enu_noAlias) continue;
+        if (!sv->typeSpec) continue;
+        t = typeIndex(sv->baseType);
+        if (t<0) continue;
+        out->columns[out->n] = sv;
+        out->index[out->n] = out->nvr[t];
+        out->vr[t][out->nvr[t]++] = getValueReference(sv);
+        out->n++;
+    }
+    free(selected);
+    if (options->format==binaryFormat) {
+        // layout of a row, see ResultHeader
+        out->offset[0] = sizeof(fmiReal); // after time
+        out->offset[1] = out->offset[0] + out->nvr[0] * sizeof(fmiReal);
+        out->offset[3] = out->offset[1] + out->nvr[1] * sizeof(fmiInteger);
+        out->offset[2] = out->offset[3] + out->nvr[3] * sizeof(unsigned int);
+        out->binaryRowSize = (out->offset[2] + out->nvr[2] * sizeof(fmiBoolean) + 7) & ~7u;
+        if (out->binaryRowSize > out->rowSize) {
+            free(out->row);
+            out->rowSize = out->binaryRowSize;
+            out->row = (char*)malloc(out->rowSize);
         }
-        else {
-            // output values
-            vr = getValueReference(sv);
-            switch (sv->typeSpec->type){
-                case elm_Real:
-                    fmu->getReal(c, &vr, 1, &r);
-                    if (separator==',') 
-                        fprintf(file, ",%.16g", r);
-                    else {
-                        // separator is e.g. ';' or '\t'
-                        doubleToCommaString(buffer, r);
-                        fprintf(file, "%c%s", separator, buffer);       
-                    }
-                    break;
-                case elm_Integer:
-                    fmu->getInteger(c, &vr, 1, &i);
-                    fprintf(file, "%c%d", separator, i);
-                    break;
-                case elm_Boolean:
-                    fmu->getBoolean(c, &vr, 1, &b);
-                    fprintf(file, "%c%d", separator, b);
-                    break;
-                case elm_String:
-                    fmu->getString(c, &vr, 1, &s);
-                    fprintf(file, "%c%s", separator, s);
-                    break;
-            }
+        out->strings = arenaNew(4096);
+        if (!out->row || !out->strings) {
+            freeOutput(out);
+            fmuError("out of memory");
+            return NULL;
         }
-    } // for
-    
-    // terminate this row
-    fprintf(file, "\n"); 
+    }
+    if (!(out->file=fopen(path, options->format==binaryFormat ? "w+b" : "w"))) {
+        printf("could not write %s\n", path);
+        freeOutput(out);
+        return NULL;
+    }
+    if (options->bufferRows > 0) {
+        mutexInit(&out->mutex);
+        condInit(&out->filled);
+        condInit(&out->written);
+        if (!threadCreate(&out->thread, writerThread, out)) {
+            condDestroy(&out->filled);
+            condDestroy(&out->written);
+            mutexDestroy(&out->mutex);
+            freeOutput(out);
+            fmuError("could not start the writer thread");
+            return NULL;
+        }
+        out->threadRunning = 1;
+    }
+    return out;
 }
 
-static const char* fmiStatusToString(fmiStatus status){
-    switch (status){
-        case fmiOK:      return "ok";
-        case fmiWarning: return "warning";
-        case fmiDiscard: return "discard";
-        case fmiError:   return "error";
-        case fmiFatal:   return "fatal";
-        default:         return "?";
+// Waits until all rows are written, closes the result file and releases out
+void freeOutput(Output* out) {
+    int t;
+    if (!out) return;
+    if (out->threadRunning) {
+        mutexLock(&out->mutex);
+        out->closing = 1;
+        condSignal(&out->filled);
+        mutexUnlock(&out->mutex);
+        threadJoin(out->thread);
+        condDestroy(&out->filled);
+        condDestroy(&out->written);
+        mutexDestroy(&out->mutex);
     }
+    if (out->file && out->options.format==binaryFormat) finishBinaryFile(out);
+    if (out->file) fclose(out->file);
+    free(out->columns);
+    free(out->index);
+    for (t=0; t<4; t++) free(out->vr[t]);
+    if (out->samples) for (t=0; t<out->nSamples; t++) freeSample(&out->samples[t]);
+    free(out->samples);
+    free(out->row);
+    arenaFree(out->strings);
+    free((void*)out->stringTable);
+    free(out->stringIds);
+    free(out);
 }
 
-// search a fmu for the given variable
-// return NULL if not found or vr = fmiUndefinedValueReference
-static ScalarVariable* getSV(FMU* fmu, char type, fmiValueReference vr) {
-    int i;
-    Elm tp;
-    ScalarVariable** vars = fmu->modelDescription->modelVariables;
-    if (vr==fmiUndefinedValueReference) return NULL;
-    switch (type) {
-        case 'r': tp = elm_Real;    break;
-        case 'i': tp = elm_Integer; break;
-        case 'b': tp = elm_Boolean; break;
-        case 's': tp = elm_String;  break;                
-    }
-    for (i=0; vars[i]; i++) {
-        ScalarVariable* sv = vars[i];
-        if (vr==getValueReference(sv) && tp==sv->typeSpec->type) 
-            return sv;
-    }
-    return NULL;
-}
-
-// replace e.g. #r1365# by variable name and ## by # in message
-// copies the result to buffer
-static void replaceRefsInMessage(const char* msg, char* buffer, int nBuffer, FMU* fmu){
-    int i=0; // position in msg
-    int k=0; // position in buffer
-    int n;
-    char c = msg[i];
-    while (c!='\0' && k < nBuffer) {
-        if (c!='#') {
-            buffer[k++]=c;
-            i++;
-            c = msg[i];
+// Copy the String values of sample into its own buffer, because the 
+// FMU may change or release them before the writer thread writes them.
+static void copyStrings(Output* out, OutputSample* sample) {
+    size_t n = 0;
+    int k;
+    char* p;
+    for (k=0; k<out->nvr[3]; k++) 
+        if (sample->s[k]) n += strlen(sample->s[k]) + 1;
+    if (n > sample->stringsSize) {
+        p = (char*)realloc(sample->strings, 2 * n);
+        if (!p) {
+            fmuError("out of memory");
+            for (k=0; k<out->nvr[3]; k++) sample->s[k] = NULL;
+            return;
         }
-        else {
-            char* end = strchr(msg+i+1, '#');
-            if (!end) {
-                printf("unmatched '#' in '%s'\n", msg);
-                buffer[k++]='#';
-                break;
-            }
-            n = end - (msg+i);
-            if (n==1) {
-                // ## detected, output #
-                buffer[k++]='#';
-                i += 2;
-                c = msg[i];
-            }
-            else {
-                char type = msg[i+1]; // one of ribs
-                fmiValueReference vr;
-                int nvr = sscanf(msg+i+2, "%u", &vr);
-                if (nvr==1) {
-                    // vr of type detected, e.g. #r12#
-                    ScalarVariable* sv = getSV(fmu, type, vr);
-                    const char* name = sv ? getName(sv) : "?";
-                    sprintf(buffer+k, "%s", name);
-                    k += strlen(name);
-                    i += (n+1);
-                    c = msg[i]; 
-                }
-                else {
-                    // could not parse the number
-                    printf("illegal value reference at position %d in '%s'\n", i+2, msg);
-                    buffer[k++]='#';
-                    break;
-                }
+        sample->strings = p;
+        sample->stringsSize = 2 * n;
+    }
+    p = sample->strings;
+    for (k=0; k<out->nvr[3]; k++) {
+        if (!sample->s[k]) continue;
+        n = strlen(sample->s[k]) + 1;
+        memcpy(p, sample->s[k], n);
+        sample->s[k] = p;
+        p += n;
+    }
+}
+
+static void writeSample(Output* out, OutputSample* sample);
+
+// Output time and the values of all columns, or the column names if header
+// is 1. The values are fetched from the FMU with one call per base type.
+// With a writer thread, they are only put into the ring buffer. If it is 
+// full, this waits for the writer thread or drops the row, see OutputOptions.
+void outputRow(FMU *fmu, fmiComponent c, Output* out, double time, int header) {
+    OutputSample* sample;
+    if (out->threadRunning) {
+        mutexLock(&out->mutex);
+        while (out->count==out->nSamples && (header || !out->options.dropRows))
+            condWait(&out->written, &out->mutex);
+        if (out->count==out->nSamples) {
+            out->nDropped++;
+            mutexUnlock(&out->mutex);
+            return;
+        }
+        sample = &out->samples[(out->first + out->count) % out->nSamples];
+        mutexUnlock(&out->mutex);
+    }
+    else sample = &out->samples[0];
+
+    // fill the sample, the writer thread does not access it before count is incremented
+    sample->time = time;
+    sample->header = header;
+    if (!header) {
+        if (out->nvr[0]) fmu->getReal   (c, out->vr[0], out->nvr[0], sample->r);
+        if (out->nvr[1]) fmu->getInteger(c, out->vr[1], out->nvr[1], sample->i);
+        if (out->nvr[2]) fmu->getBoolean(c, out->vr[2], out->nvr[2], sample->b);
+        if (out->nvr[3]) {
+            fmu->getString(c, out->vr[3], out->nvr[3], sample->s);
+            if (out->threadRunning) copyStrings(out, sample);
+        }
+    }
+
+    if (out->threadRunning) {
+        mutexLock(&out->mutex);
+        out->count++;
+        condSignal(&out->filled);
+        mutexUnlock(&out->mutex);
+    }
+    else writeSample(out, sample);
+}
+
+// Writes the filled samples in the order they were filled,
+// until freeOutput sets closing
+static void writerThread(void* output) {
+    Output* out = (Output*)output;
+    mutexLock(&out->mutex);
+    for (;;) {
+        OutputSample* sample;
+        while (!out->count && !out->closing) condWait(&out->filled, &out->mutex);
+        if (!out->count) break; // closing and all samples written
+        sample = &out->samples[out->first];
+        mutexUnlock(&out->mutex);
+        writeSample(out, sample);
+        mutexLock(&out->mutex);
+        out->first = (out->first + 1) % out->nSamples;
+        out->count--;
+        condSignal(&out->written);
+    }
+    mutexUnlock(&out->mutex);
+}
+
+// ------------------------------------------------------------------------- 
+// Binary result file, see ResultHeader
+
+// Returns the id of String value s, 0 for NULL. 
+// The ids of the distinct values are 1, 2, ...
+static unsigned int stringId(Output* out, const char* s) {
+    unsigned int h = 2166136261u; // FNV-1a
+    unsigned int i, mask;
+    const char* p;
+    if (!s) return 0;
+    for (p=s; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 16777619u;
+    }
+    if (2 * (out->nStrings + 1) > out->stringTableSize) {
+        // grow and rehash the table of distinct values
+        unsigned int size = out->stringTableSize ? 2 * out->stringTableSize : 64;
+        const char** table = (const char**)calloc(size, sizeof(char*));
+        unsigned int* ids = (unsigned int*)calloc(size, sizeof(unsigned int));
+        if (!table || !ids) {
+            free((void*)table);
+            free(ids);
+            fmuError("out of memory");
+            return 0;
+        }
+        for (i=0; i<out->stringTableSize; i++) {
+            unsigned int k = 2166136261u;
+            if (!out->stringTable[i]) continue;
+            for (p=out->stringTable[i]; *p; p++) {
+                k ^= (unsigned char)*p;
+                k *= 16777619u;
             }
+            for (k &= size - 1; table[k]; k = (k+1) & (size - 1));
+            table[k] = out->stringTable[i];
+            ids[k] = out->stringIds[i];
+        }
+        free((void*)out->stringTable);
+        free(out->stringIds);
+        out->stringTable = table;
+        out->stringIds = ids;
+        out->stringTableSize = size;
+    }
+    mask = out->stringTableSize - 1;
+    for (h &= mask; out->stringTable[h]; h = (h+1) & mask)
+        if (!strcmp(out->stringTable[h], s)) return out->stringIds[h];
+    p = arenaStrdup(out->strings, s);
+    if (!p) {
+        fmuError("out of memory");
+        return 0;
+    }
+    out->stringTable[h] = p;
+    out->stringIds[h] = ++out->nStrings;
+    out->stringsSize += strlen(s) + 1;
+    return out->stringIds[h];
+}
+
+// Write header, columns and names of a binary result file
+static void outputBinaryHeader(Output* out) {
+    static const unsigned int sizes[4] = 
+        { sizeof(fmiReal), sizeof(fmiInteger), sizeof(fmiBoolean), sizeof(unsigned int) };
+    ResultHeader header;
+    ResultColumn column;
+    unsigned int name = 5; // after "time"
+    size_t n = 5;
+    int k;
+    for (k=0; k<out->n; k++) n += strlen(getName(out->columns[k])) + 1;
+    memset(&header, 0, sizeof(ResultHeader));
+    header.magic = RESULT_MAGIC;
+    header.version = RESULT_VERSION;
+    header.nColumns = out->n + 1;
+    header.headerSize = (unsigned int)((sizeof(ResultHeader) 
+            + header.nColumns * sizeof(ResultColumn) + n + 7) & ~(size_t)7);
+    header.rowSize = out->binaryRowSize;
+    fwrite(&header, sizeof(ResultHeader), 1, out->file);
+    column.type = 0;
+    column.vr = fmiUndefinedValueReference;
+    column.offset = 0;
+    column.name = 0;
+    fwrite(&column, sizeof(ResultColumn), 1, out->file);
+    for (k=0; k<out->n; k++) {
+        ScalarVariable* sv = out->columns[k];
+        column.type = typeIndex(sv->baseType);
+        column.vr = getValueReference(sv);
+        column.offset = out->offset[column.type] + out->index[k] * sizes[column.type];
+        column.name = name;
+        name += strlen(getName(sv)) + 1;
+        fwrite(&column, sizeof(ResultColumn), 1, out->file);
+    }
+    fwrite("time", 1, 5, out->file);
+    for (k=0; k<out->n; k++) {
+        const char* s = getName(out->columns[k]);
+        fwrite(s, 1, strlen(s) + 1, out->file);
+    }
+    n = header.headerSize - sizeof(ResultHeader) - header.nColumns * sizeof(ResultColumn) - n;
+    fwrite("\0\0\0\0\0\0\0", 1, n, out->file); // padding
+}
+
+// Write one row of a binary result file. The values are copied
+// as fetched, only String values are replaced by their ids.
+static void outputBinaryRow(Output* out, OutputSample* sample) {
+    char* row = out->row;
+    unsigned int* ids = (unsigned int*)(row + out->offset[3]);
+    int k;
+    memset(row, 0, out->binaryRowSize);
+    memcpy(row, &sample->time, sizeof(fmiReal));
+    memcpy(row + out->offset[0], sample->r, out->nvr[0] * sizeof(fmiReal));
+    memcpy(row + out->offset[1], sample->i, out->nvr[1] * sizeof(fmiInteger));
+    memcpy(row + out->offset[2], sample->b, out->nvr[2] * sizeof(fmiBoolean));
+    for (k=0; k<out->nvr[3]; k++) ids[k] = stringId(out, sample->s[k]);
+    fwrite(row, 1, out->binaryRowSize, out->file);
+    out->nRows++;
+}
+
+// Append the distinct String values and complete the header
+static void finishBinaryFile(Output* out) {
+    ResultHeader header;
+    const char** values;
+    unsigned int i;
+    if (out->nStrings) {
+        values = (const char**)calloc(out->nStrings, sizeof(char*));
+        if (!values) {
+            fmuError("out of memory");
+            return;
         }
-    } // while
-    buffer[k] = '\0';
+        for (i=0; i<out->stringTableSize; i++)
+            if (out->stringTable[i]) values[out->stringIds[i] - 1] = out->stringTable[i];
+        for (i=0; i<out->nStrings; i++) 
+            fwrite(values[i], 1, strlen(values[i]) + 1, out->file);
+        free((void*)values);
+    }
+    if (fseek(out->file, 0, SEEK_SET) 
+            || fread(&header, sizeof(ResultHeader), 1, out->file) != 1) {
+        fmuError("could not complete the result file");
+        return;
+    }
+    header.nRows = out->nRows;
+    header.nStrings = out->nStrings;
+    header.stringsSize = out->stringsSize;
+    fseek(out->file, 0, SEEK_SET);
+    fwrite(&header, sizeof(ResultHeader), 1, out->file);
 }
 
-#define MAX_MSG_SIZE 1000
-void fmuLogger(fmiComponent c, fmiString instanceName,
-	       fmiStatus status, fmiString category,
-	       fmiString message, ...) {
-    char msg[MAX_MSG_SIZE];
-    char* copy;
-    va_list argp;
+// ------------------------------------------------------------------------- 
+// CSV result file
 
-    // replace C format strings
-	va_start(argp, message);
-    vsprintf(msg, message, argp);
+// Make room for n more chars and the final '\n' after the first len 
+// chars of the row buffer. Returns 0 to indicate failure (out of memory)
+static int reserve(Output* out, size_t len, size_t n) {
+    char* row;
+    size_t size;
+    if (len + n + 1 <= out->rowSize) return 1;
+    size = 2 * (len + n + 1);
+    row = (char*)realloc(out->row, size);
+    if (!row) return fmuError("out of memory");
+    out->row = row;
+    out->rowSize = size;
+    return 1;
+}
 
-    // replace e.g. ## and #r12#  
-    copy = strdup(msg);
-    replaceRefsInMessage(copy, msg, MAX_MSG_SIZE, &fmu);
-    free(copy);
+// Write time and all columns of sample in CSV format, or the column names.
+// if separator is ',', columns are separated by ',' and '.' is used for floating-point numbers.
+// otherwise, the given separator (e.g. ';' or '\t') is to separate columns, and ',' is used for 
+// floating-point numbers.
+// The row is composed in the row buffer of out and written with a single fwrite.
+static void outputCsvRow(Output* out, OutputSample* sample) {
+    int k;
+    char separator = out->options.separator;
+    char decimalPoint = separator==',' ? '.' : ',';
+    char* row = out->row;
+    size_t len;
+    
+    // print first column
+    if (sample->header) {
+        memcpy(row, "time", 4);
+        len = 4;
+    }
+    else len = formatDouble(row, sample->time, decimalPoint);
     
-    // print the final message
-    if (!instanceName) instanceName = "?";
-    if (!category) category = "?";
-    printf("%s %s (%s): %s\n", fmiStatusToString(status), instanceName, category, msg);
+    // print all other columns
+    for (k=0; k<out->n; k++) {
+        ScalarVariable* sv = out->columns[k];
+        int j = out->index[k];
+        if (sample->header || sv->baseType==elm_String) {
+            // output names, or values of type String
+            const char* s = sample->header ? getName(sv) : sample->s[j];
+            size_t n = s ? strlen(s) : 0;
+            if (!reserve(out, len, n + 1)) break;
+            row = out->row;
+            row[len++] = separator;
+            memcpy(row + len, s, n);
+            len += n;
+            continue;
+        }
+        // output numeric values
+        if (!reserve(out, len, COLUMN_SIZE)) break;
+        row = out->row;
+        row[len++] = separator;
+        switch (sv->baseType){
+            case elm_Real:
+                len += formatDouble(row + len, sample->r[j], decimalPoint);
+                break;
+            case elm_Integer:
+                len += formatInt(row + len, sample->i[j]);
+                break;
+            case elm_Boolean:
+                len += formatInt(row + len, sample->b[j]);
+                break;
+            default: break;
+        }
+    } // for
+    
+    // terminate this row
+    row[len++] = '\n';
+    fwrite(row, 1, len, out->file);
+}
+
+// Write the sample in the format given by the options of out
+static void writeSample(Output* out, OutputSample* sample) {
+    if (out->options.format==csvFormat) outputCsvRow(out, sample);
+    else if (sample->header) outputBinaryHeader(out);
+    else outputBinaryRow(out, sample);
 }
 
+// print message, after the pending messages of the logger
 int fmuError(const char* message){
+    flushLogger();
     printf("%s\n", message);
     return 0;
 }
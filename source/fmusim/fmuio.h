@@ -9,14 +9,121 @@
 #define fmuio_h
 
 #include "main.h"
+#include "fmuthread.h"
 #include <stdio.h>
 
-extern void fmuLogger(fmiComponent c, fmiString instanceName,
-	       fmiStatus status, fmiString category,
-	       fmiString message, ...);
+// Formats of the result file
+typedef enum {
+    csvFormat,                   // text, see outputRow
+    binaryFormat                 // binary, see ResultHeader
+} OutputFormat;
 
-extern void outputRow(FMU *fmu, fmiComponent c, double time, FILE* file,
-	       char separator, int header);
+// A binary result file starts with a ResultHeader, followed by nColumns
+// ResultColumns and the '\0'-terminated column names. Then follows one
+// row of rowSize bytes per output step: time and the Real values as
+// doubles, the Integer values as 32-bit ints, String values as 32-bit ids
+// (0 for NULL, 1 for the first distinct value and so on),
+// Boolean values as bytes, padded to a multiple of 8. All numbers are
+// stored in the byte order of the simulator, values are aligned to their
+// size. Rows are appended during simulation, so that a file can be read
+// while it grows. When the file is complete, the distinct String values
+// follow the last row, as '\0'-terminated strings in the order of their
+// ids, and nRows, nStrings and stringsSize are set in the header.
+#define RESULT_MAGIC   0x53524d46 // "FMRS", also detects a different byte order
+#define RESULT_VERSION 1
+typedef struct {
+    unsigned int magic;          // RESULT_MAGIC
+    unsigned int version;        // RESULT_VERSION
+    unsigned int nColumns;       // number of columns, including time
+    unsigned int headerSize;     // offset of the first row, a multiple of 8
+    unsigned int rowSize;        // size of a row, a multiple of 8
+    unsigned int nRows;          // number of rows, 0 until complete
+    unsigned int nStrings;       // number of distinct String values
+    unsigned int stringsSize;    // size of the String values after the last row
+} ResultHeader;
+
+// A column of a binary result file
+typedef struct {
+    unsigned int type;           // 0 Real, 1 Integer (also Enumeration), 2 Boolean, 3 String
+    unsigned int vr;             // value reference, fmiUndefinedValueReference for time
+    unsigned int offset;         // offset of the value in a row
+    unsigned int name;           // offset of the name after the columns
+} ResultColumn;
+
+// Options for writing the result file
+typedef struct {
+    OutputFormat format;
+    char separator;              // column separator of the CSV format, see outputRow
+    int bufferRows;              // 0 to write rows in the simulation thread, otherwise
+                                 // the number of rows buffered for a writer thread
+    int dropRows;                // 1 to drop rows when the buffer is full, 0 to wait
+    double interval;             // 0 to output every step, otherwise the distance
+                                 // of the output times, independent of the step size
+    int eventRows;               // 1 to output a row before and after each event
+    const char** filters;        // names, globs and /regex/ of the variables to output
+    int nFilters;                // 0 to output all non-alias variables
+} OutputOptions;
+
+// The values of one row, fetched with one call per base type
+// into r, i, b and s, in the order given by the vr arrays of Output
+typedef struct {
+    double time;
+    int header;                  // 1 for the row of column names
+    fmiReal* r;
+    fmiInteger* i;
+    fmiBoolean* b;
+    fmiString* s;
+    char* strings;               // copies of the String values for a writer thread
+    size_t stringsSize;          // allocated size of strings
+} OutputSample;
+
+// The result file and its columns. Columns are the non-alias variables,
+// or the variables selected by the filters of the options.
+// Arrays of size 4 are indexed by base type:
+// 0 Real, 1 Integer (also Enumeration), 2 Boolean, 3 String.
+// With a writer thread, the simulation thread fills the samples, which
+// form a ring buffer, and the writer thread formats and writes them.
+// Otherwise, the single sample is written directly by outputRow.
+typedef struct {
+    FILE* file;                  // the result file
+    OutputOptions options;
+    int n;                       // number of columns, without time
+    ScalarVariable** columns;    // the variable of each column
+    int* index;                  // position of the value of each column in r, i, b or s
+    int nvr[4];                  // number of columns per base type
+    fmiValueReference* vr[4];    // value references of the columns per base type
+    OutputSample* samples;
+    int nSamples;                // options.bufferRows, or 1 without writer thread
+    // writer thread only
+    int threadRunning;           // 1 if thread has been started
+    Thread thread;
+    Mutex mutex;                 // protects first, count and closing
+    Cond filled;                 // signalled when a sample has been filled
+    Cond written;                // signalled when a sample has been written
+    int first;                   // index of the oldest filled sample
+    int count;                   // number of filled samples
+    int closing;                 // 1 to terminate the thread when all samples are written
+    unsigned int nDropped;       // number of rows dropped, see options.dropRows
+    // used for writing only, by the writer thread if any
+    char* row;                   // buffer for composing a row
+    size_t rowSize;              // allocated size of row, grows for long strings
+    // binary format only
+    unsigned int offset[4];      // offset of the values per base type in a row
+    unsigned int binaryRowSize;  // see ResultHeader
+    unsigned int nRows;          // number of rows written
+    Arena* strings;              // copies of the distinct String values
+    const char** stringTable;    // hash set of the distinct String values
+    unsigned int* stringIds;     // ids of the values in stringTable
+    unsigned int stringTableSize;// number of slots in stringTable, a power of 2
+    unsigned int nStrings;       // number of distinct String values
+    unsigned int stringsSize;    // size of the String values, with terminating '\0'
+} Output;
+
+extern Output* newOutput(FMU* fmu, const char* path, OutputOptions* options);
+
+extern void outputRow(FMU *fmu, fmiComponent c, Output* out, double time, int header);
+
+extern void freeOutput(Output* out);
 		   
 extern int fmuError(const char *msg);
 
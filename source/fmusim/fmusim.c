@@ -1,5 +1,7 @@
 #include "fmusim.h"
 #include "fmuio.h"
+#include "solver.h"
+#include "profile.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,170 +13,298 @@
 #endif
 
 #define RESULT_FILE "result.csv"
+#define RESULT_BIN_FILE "result.bin"
 
-// simulate the given FMU using the forward euler method.
-// time events are processed by reducing step size to exactly hit tNext.
-// state events are checked and fired only at the end of an Euler step. 
-// the simulator may therefore miss state events and fires state events typically too late.
-int fmuSimulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn, char separator) {
-    int i, n;
-    double dt, tPre;
-    fmiBoolean timeEvent, stateEvent, stepEvent;
-    double time;  
-    int nx;                          // number of state variables
-    int nz;                          // number of state event indicators
-    double *x;                       // continuous states
-    double *xdot;                    // the crresponding derivatives in same order
-    double *z = NULL;                // state event indicators
-    double *prez = NULL;             // previous values of state event indicators
-    fmiEventInfo eventInfo;          // updated by calls to initialize and eventUpdate
-    ModelDescription* md;            // handle to the parsed XML file        
+// the result file used if none is given
+const char* defaultResultFile(OutputOptions* output) {
+    return output->format==binaryFormat ? RESULT_BIN_FILE : RESULT_FILE;
+}
+
+// Instantiate and initialize the given FMU for simulation from t=0 to 
+// options->tEnd, and write the start values to resultFile. If parameters
+// is not NULL, the values of the given row are set before initialization.
+// instanceName must be registered with registerLoggerInstance.
+// Work arrays are taken from w, the workspace of the calling thread, or 
+// allocated if w is NULL. Returns NULL to indicate failure.
+Simulation* newSimulation(FMU* fmu, SimulationOptions* options, const char* instanceName,
+        const char* resultFile, ParameterTable* parameters, int row, Workspace* w) {
+    ModelDescription* md = fmu->modelDescription;
     const char* guid;                // global unique id of the fmu
     fmiCallbackFunctions callbacks;  // called by the model during simulation
-    fmiComponent c;                  // instance of the fmu 
     fmiStatus fmiFlag;               // return code of the fmu functions
-    fmiReal t0 = 0;                  // start time
-    fmiBoolean toleranceControlled = fmiFalse;
-    int nSteps = 0;
-    int nTimeEvents = 0;
-    int nStepEvents = 0;
-    int nStateEvents = 0;
-    FILE* file;
+    fmiBoolean toleranceControlled = isAdaptive(options->solver->method);
+    Simulation* sim = (Simulation*)calloc(1, sizeof(Simulation));
+    if (!sim) {
+        fmuError("out of memory");
+        return NULL;
+    }
+    sim->fmu = fmu;
+    sim->options = options;
+    sim->resultFile = resultFile;
+    sim->tEnd = options->tEnd;
+    sim->nOut = 1;
 
     // instantiate the fmu
-    md = fmu->modelDescription;
     guid = getString(md, att_guid);
     callbacks.logger = fmuLogger;
     callbacks.allocateMemory = calloc;
     callbacks.freeMemory = free;
-    c = fmu->instantiateModel(getModelIdentifier(md), guid, callbacks, loggingOn);
-    if (!c) return fmuError("could not instantiate model");
+    sim->instanceName = instanceName;
+    sim->c = fmu->instantiateModel(instanceName, guid, callbacks, options->loggingOn);
+    if (!sim->c) {
+        fmuError("could not instantiate model");
+        goto fail;
+    }
+    if (parameters && !setParameters(fmu, sim->c, parameters, row)) goto fail;
     
     // allocate memory 
-    nx = getNumberOfStates(md);
-    nz = getNumberOfEventIndicators(md);
-    x    = (double *) calloc(nx, sizeof(double));
-    xdot = (double *) calloc(nx, sizeof(double));
-    if (nz>0) {
-        z    =  (double *) calloc(nz, sizeof(double));
-        prez =  (double *) calloc(nz, sizeof(double));
+    sim->nx = getNumberOfStates(md);
+    sim->nz = getNumberOfEventIndicators(md);
+    if (sim->nz>0) {
+        sim->z    =  (double *) workspaceAlloc(w, sim->nz * sizeof(double));
+        sim->prez =  (double *) workspaceAlloc(w, sim->nz * sizeof(double));
+        if (!sim->z || !sim->prez) {
+            fmuError("out of memory");
+            goto fail;
+        }
     }
-    if (!x || !xdot || nz>0 && (!z || !prez)) return fmuError("out of memory");
+    sim->s = newSolver(fmu, sim->c, sim->nx, sim->nz, options->solver, w);
+    if (!sim->s) goto fail;
 
     // open result file
-    if (!(file=fopen(RESULT_FILE, "w"))) {
-        printf("could not write %s\n", RESULT_FILE);
-        return 0; // failure
-    }
+    sim->out = newOutput(fmu, resultFile, options->output);
+    if (!sim->out) goto fail;
         
     // set the start time and initialize
-    time = t0;
-    fmiFlag =  fmu->setTime(c, t0);
-    if (fmiFlag > fmiWarning) return fmuError("could not set time");
-    fmiFlag =  fmu->initialize(c, toleranceControlled, t0, &eventInfo);
-    if (fmiFlag > fmiWarning)  fmuError("could not initialize model");
-    if (eventInfo.terminateSimulation) {
+    sim->time = sim->t0;
+    fmiFlag =  fmu->setTime(sim->c, sim->t0);
+    if (fmiFlag > fmiWarning) {
+        fmuError("could not set time");
+        goto fail;
+    }
+    fmiFlag =  fmu->initialize(sim->c, toleranceControlled, options->solver->relTol, &sim->eventInfo);
+    if (fmiFlag > fmiWarning) {
+        fmuError("could not initialize model");
+        goto fail;
+    }
+    sim->initialized = 1;
+    if (sim->eventInfo.terminateSimulation) {
         printf("model requested termination at init");
-        tEnd = time;
+        sim->tEnd = sim->time;
+    }
+  
+    fmiFlag = fmu->getEventIndicators(sim->c, sim->z, sim->nz);
+    if (fmiFlag > fmiWarning) {
+        fmuError("could not retrieve event indicators");
+        goto fail;
     }
   
     // output solution for time t0
-    outputRow(fmu, c, t0, file, separator, TRUE);  // output column names
-    outputRow(fmu, c, t0, file, separator, FALSE); // output values
+    outputRow(fmu, sim->c, sim->out, sim->t0, TRUE);  // output column names
+    outputRow(fmu, sim->c, sim->out, sim->t0, FALSE); // output values
+    sim->tOut = options->output->interval > 0 ? sim->t0 + options->output->interval : sim->tEnd;
+    return sim;
+
+fail:
+    freeSimulation(sim, w);
+    return NULL;
+}
+
+// Returns 1 if the simulation reached its end time or was terminated by the model
+int simulationFinished(Simulation* sim) {
+    return sim->terminated || sim->time >= sim->tEnd;
+}
 
-    // enter the simulation loop
-    while (time < tEnd) {
-     // get current state and derivatives
-     fmiFlag = fmu->getContinuousStates(c, x, nx);
-     if (fmiFlag > fmiWarning) return fmuError("could not retrieve states");
-     fmiFlag = fmu->getDerivatives(c, xdot, nx);
-     if (fmiFlag > fmiWarning) return fmuError("could not retrieve derivatives");
+// Continue the simulation until time tStop is reached or passed, or 
+// the simulation is finished. Steps are not shortened to hit tStop, so
+// the result does not depend on how a simulation is split into parts.
+// Uses the method given by options->solver. fixed-step
+// methods take steps of size h, adaptive methods steps of at most size h.
+// time events are processed by reducing step size to exactly hit tNext.
+// output times on the grid given by output->interval are hit the same way.
+// state events are detected by a sign change of an event indicator at the end 
+// of a step, and then located in the step, which is cut short at the event.
+// the simulator may still miss state events if an indicator changes its sign
+// twice within one step.
+// Returns 0 to indicate failure.
+int simulateUntil(Simulation* sim, double tStop) {
+    int i;
+    double tPre, tNext;
+    fmiBoolean timeEvent, stateEvent, stepEvent;
+    fmiBoolean outputTime;           // output this step
+    fmiStatus fmiFlag;               // return code of the fmu functions
+    FMU* fmu = sim->fmu;
+    fmiComponent c = sim->c;
+    double h = sim->options->h;
+    fmiBoolean loggingOn = sim->options->loggingOn;
+    OutputOptions* output = sim->options->output;
+    double *z = sim->z, *prez = sim->prez;
+    int nz = sim->nz;
 
+    while (sim->time < sim->tEnd && sim->time < tStop && !sim->terminated) {
      // advance time
-     tPre = time;
-     time = min(time+h, tEnd);
-     timeEvent = eventInfo.upcomingTimeEvent && eventInfo.nextEventTime < time;     
-     if (timeEvent) time = eventInfo.nextEventTime;
-     dt = time - tPre; 
-     fmiFlag = fmu->setTime(c, time);
-     if (fmiFlag > fmiWarning) fmuError("could not set time");
-
-     // perform one step
-     for (i=0; i<nx; i++) x[i] += dt*xdot[i]; // forward Euler method
-     fmiFlag = fmu->setContinuousStates(c, x, nx);
-     if (fmiFlag > fmiWarning) return fmuError("could not set states");
-     if (loggingOn) printf("Step %d to t=%.16g\n", nSteps, time);
-    
-     // Check for step event, e.g. dynamic state selection
-     fmiFlag = fmu->completedIntegratorStep(c, &stepEvent);
-     if (fmiFlag > fmiWarning) return fmuError("could not complete intgrator step");
+     tPre = sim->time;
+     tNext = min(tPre+h, sim->tEnd);
+     if (output->interval > 0 && sim->tOut <= tNext + 1e-9*h) {
+         // end the step at the next output time, which is also taken if 
+         // it is slightly beyond the step to avoid a tiny next step
+         tNext = min(sim->tOut, sim->tEnd);
+     }
+     // end the step at the next time event, which is also taken if it is
+     // slightly beyond the step, as the sum of steps misses it by rounding,
+     // but never beyond tEnd
+     timeEvent = sim->eventInfo.upcomingTimeEvent
+             && sim->eventInfo.nextEventTime <= tNext + 1e-9*h;
+     if (timeEvent) tNext = min(sim->eventInfo.nextEventTime, sim->tEnd);
 
-     // Check for state event
+     // perform one step, adaptive solvers may end it before tNext
+     sim->time = tNext;
+     if (!solverStep(sim->s, tPre, &sim->time)) return 0; // failure
+
+     // Check for state event, and end the step at the first one
      for (i=0; i<nz; i++) prez[i] = z[i]; 
      fmiFlag = fmu->getEventIndicators(c, z, nz);
      if (fmiFlag > fmiWarning) return fmuError("could not retrieve event indicators");
      stateEvent = FALSE;
      for (i=0; i<nz; i++) 
          stateEvent = stateEvent || (prez[i] * z[i] < 0);  
+     if (stateEvent && !solverLocateEvent(sim->s, prez, z, &sim->time)) return 0; // failure
+     if (loggingOn) printf("Step %d to t=%.16g\n", sim->nSteps, sim->time);
+
+     timeEvent = timeEvent && sim->time >= tNext;
+     outputTime = output->interval <= 0 || sim->time >= sim->tOut || sim->time >= sim->tEnd;
+     if (output->interval > 0 && sim->time >= sim->tOut) 
+         sim->tOut = sim->t0 + (++sim->nOut) * output->interval;
+    
+     // Check for step event, e.g. dynamic state selection
+     fmiFlag = fmu->completedIntegratorStep(c, &stepEvent);
+     if (fmiFlag > fmiWarning) return fmuError("could not complete intgrator step");
      
      // handle events
      if (timeEvent || stateEvent || stepEvent) {
         
         if (timeEvent) {
-            nTimeEvents++;
-            if (loggingOn) printf("time event at t=%.16g\n", time);
+            sim->nTimeEvents++;
+            if (loggingOn) printf("time event at t=%.16g\n", sim->time);
         }
         if (stateEvent) {
-            nStateEvents++;
+            sim->nStateEvents++;
             if (loggingOn) for (i=0; i<nz; i++)
                 printf("state event %s z[%d] at t=%.16g\n", 
-                        (prez[i]>0 && z[i]<0) ? "-\\-" : "-/-", i, time);
+                        (prez[i]>0 && z[i]<0) ? "-\\-" : "-/-", i, sim->time);
         }
         if (stepEvent) {
-            nStepEvents++;
-            if (loggingOn) printf("step event at t=%.16g\n", time);
+            sim->nStepEvents++;
+            if (loggingOn) printf("step event at t=%.16g\n", sim->time);
         }
 
+        // output values before the event
+        if (output->eventRows) outputRow(fmu, c, sim->out, sim->time, FALSE);
+
         // event iteration in one step, ignoring intermediate results
-        fmiFlag = fmu->eventUpdate(c, fmiFalse, &eventInfo);
+        fmiFlag = fmu->eventUpdate(c, fmiFalse, &sim->eventInfo);
         if (fmiFlag > fmiWarning) return fmuError("could not perform event update");
         
         // terminate simulation, if requested by the model
-        if (eventInfo.terminateSimulation) {
-            printf("model requested termination at t=%.16g\n", time);
+        if (sim->eventInfo.terminateSimulation) {
+            printf("model requested termination at t=%.16g\n", sim->time);
+            sim->terminated = 1;
             break; // success
         }
 
         // check for change of value of states
-        if (eventInfo.stateValuesChanged && loggingOn) {
-            printf("state values changed at t=%.16g\n", time);
+        if (sim->eventInfo.stateValuesChanged && loggingOn) {
+            printf("state values changed at t=%.16g\n", sim->time);
         }
         
         // check for selection of new state variables
-        if (eventInfo.stateValueReferencesChanged && loggingOn) {
-            printf("new state variables selected at t=%.16g\n", time);
+        if (sim->eventInfo.stateValueReferencesChanged && loggingOn) {
+            printf("new state variables selected at t=%.16g\n", sim->time);
         }
+
+        // output values after the event, even if this is no output time
+        if (output->eventRows) outputTime = TRUE;
+
+        // states, derivatives and event indicators may have changed
+        solverReset(sim->s);
+        fmiFlag = fmu->getEventIndicators(c, z, nz);
+        if (fmiFlag > fmiWarning) return fmuError("could not retrieve event indicators");
        
      } // if event
-     outputRow(fmu, c, time, file, separator, FALSE); // output values for this step
-     nSteps++;
+     if (outputTime) outputRow(fmu, c, sim->out, sim->time, FALSE); // output values for this step
+     sim->nSteps++;
   } // while  
+  return 1; // success
+}
 
-  // cleanup
-  fclose(file);
-  if (x!=NULL) free(x);
-  if (xdot!= NULL) free(xdot);
-  if (z!= NULL) free(z);
-  if (prez!= NULL) free(prez);
-
-  // print simulation summary 
-  printf("Simulation from %g to %g terminated successful\n", t0, tEnd);
-  printf("  steps ............ %d\n", nSteps);
-  printf("  fixed step size .. %g\n", h);
-  printf("  time events ...... %d\n", nTimeEvents);
-  printf("  state events ..... %d\n", nStateEvents);
-  printf("  step events ...... %d\n", nStepEvents);
-  printf("CSV file '%s' written.\n", RESULT_FILE);
+// print simulation summary 
+void printSummary(Simulation* sim) {
+  SimulationOptions* options = sim->options;
+  SolverOptions* solver = options->solver;
+  OutputOptions* output = options->output;
+  Solver* s = sim->s;
+  printf("Simulation from %g to %g terminated successful\n", sim->t0, sim->tEnd);
+  printf("  steps ............ %d\n", sim->nSteps);
+  printf("  solver ........... %s\n", solverMethodName(solver->method));
+  if (isAdaptive(solver->method)) {
+      printf("  max step size .... %g\n", options->h);
+      printf("  tolerances ....... rel %g, abs %g\n", solver->relTol, solver->absTol);
+      printf("  rejected steps ... %d\n", s->nRejected);
+  }
+  else printf("  fixed step size .. %g\n", options->h);
+  printf("  derivative calls . %d\n", s->nDerivatives);
+  if (isImplicit(solver->method)) {
+      printf("  Jacobians ........ %d, %d evaluations each\n", s->nJacobians, 
+              s->pattern ? s->pattern->nColors : sim->nx);
+      printf("  LU factorizations  %d\n", s->nFactorizations);
+  }
+  if (output->interval > 0) printf("  output interval .. %g\n", output->interval);
+  printf("  time events ...... %d\n", sim->nTimeEvents);
+  printf("  state events ..... %d\n", sim->nStateEvents);
+  if (sim->nStateEvents > 0) printf("  event iterations . %d\n", s->nEventIterations);
+  printf("  step events ...... %d\n", sim->nStepEvents);
+  if (output->dropRows) printf("  dropped rows ..... %u\n", sim->out->nDropped);
+}
 
-  return 1; // success
+// Close the result file, and release the model instance and all memory.
+// Work arrays go to w, the workspace of the calling thread, if not NULL.
+void freeSimulation(Simulation* sim, Workspace* w) {
+  FMU* fmu;
+  if (!sim) return;
+  fmu = sim->fmu;
+  if (sim->out) freeOutput(sim->out);
+  freeSolver(sim->s, w);
+  workspaceFree(w, sim->z, sim->nz * sizeof(double));
+  workspaceFree(w, sim->prez, sim->nz * sizeof(double));
+  if (sim->c) {
+      if (sim->initialized) fmu->terminate(sim->c);
+      fmu->freeModelInstance(sim->c);
+  }
+  free(sim);
+}
+
+// simulate the given FMU from t=0 to tEnd, see simulateUntil
+int fmuSimulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn,
+        SolverOptions* solver, OutputOptions* output) {
+    SimulationOptions options;
+    Simulation* sim;
+    const char* resultFile = defaultResultFile(output);
+    const char* instanceName = getModelIdentifier(fmu->modelDescription);
+    int ok;
+    options.tEnd = tEnd;
+    options.h = h;
+    options.loggingOn = loggingOn;
+    options.solver = solver;
+    options.output = output;
+    if (!registerLoggerInstance(instanceName, fmu)) return 0; // failure
+    sim = newSimulation(fmu, &options, instanceName, resultFile, NULL, 0, NULL);
+    ok = sim && simulateUntil(sim, tEnd);
+    if (ok) {
+        printSummary(sim);
+        printProfile();
+    }
+    freeSimulation(sim, NULL);
+    unregisterLoggerInstance(instanceName);
+    if (ok) printf("%s file '%s' written.\n", output->format==binaryFormat ? "Binary" : "CSV", resultFile);
+    return ok;
 }
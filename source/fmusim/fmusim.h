@@ -9,8 +9,55 @@
 #define fmusim_h
 
 #include "main.h"
+#include "fmuio.h"
+#include "logger.h"
+#include "solver.h"
+#include "params.h"
+#include "workspace.h"
 
-int fmuSimulate(FMU* fmu, double tEnd, double h,
-		fmiBoolean loggingOn, char separator);
+typedef struct {
+    double tEnd;                // end time of simulation
+    double h;                   // step size, the maximal one for adaptive solvers
+    fmiBoolean loggingOn;
+    SolverOptions* solver;
+    OutputOptions* output;
+} SimulationOptions;
+
+// state of a simulation that can be continued in parts
+typedef struct {
+    FMU* fmu;
+    SimulationOptions* options;
+    const char* instanceName;
+    const char* resultFile;
+    fmiComponent c;                  // instance of the fmu 
+    int initialized;                 // 1 after fmiInitialize succeeded
+    Solver* s;                       // integrates the continuous states
+    Output* out;                     // the result file
+    int nx;                          // number of state variables
+    int nz;                          // number of state event indicators
+    double *z;                       // state event indicators
+    double *prez;                    // previous values of state event indicators
+    fmiEventInfo eventInfo;          // updated by calls to initialize and eventUpdate
+    double t0;                       // start time
+    double time;                     // current time
+    double tEnd;                     // end time, earlier if terminated at init
+    double tOut;                     // next output time on the grid
+    int nOut;                        // number of output times on the grid passed so far
+    int terminated;                  // 1 if the model requested termination
+    int nSteps;
+    int nTimeEvents;
+    int nStepEvents;
+    int nStateEvents;
+} Simulation;
+
+const char* defaultResultFile(OutputOptions* output);
+Simulation* newSimulation(FMU* fmu, SimulationOptions* options, const char* instanceName,
+        const char* resultFile, ParameterTable* parameters, int row, Workspace* w);
+int simulateUntil(Simulation* sim, double tStop);
+int simulationFinished(Simulation* sim);
+void printSummary(Simulation* sim);
+void freeSimulation(Simulation* sim, Workspace* w);
+int fmuSimulate(FMU* fmu, double tEnd, double h, fmiBoolean loggingOn,
+		SolverOptions* solver, OutputOptions* output);
 
 #endif // fmusim_h
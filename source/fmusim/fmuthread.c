@@ -0,0 +1,141 @@
+/* -------------------------------------------------------------------------
+ * fmuthread.c
+ * Threads, mutexes, condition variables and atomic operations
+ * for Windows and POSIX.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include "fmuthread.h"
+
+#ifdef _MSC_VER
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+// function and argument of a new thread
+typedef struct {
+    ThreadFunction f;
+    void* arg;
+} ThreadStart;
+
+#ifdef _MSC_VER
+static unsigned __stdcall run(void* start) {
+#else
+static void* run(void* start) {
+#endif
+    ThreadStart s = *(ThreadStart*)start;
+    free(start);
+    s.f(s.arg);
+    return 0;
+}
+
+// Start a thread that calls f(arg). Returns 0 to indicate failure.
+int threadCreate(Thread* thread, ThreadFunction f, void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start) return 0;
+    start->f = f;
+    start->arg = arg;
+#ifdef _MSC_VER
+    *thread = (HANDLE)_beginthreadex(NULL, 0, run, start, 0, NULL);
+    if (*thread) return 1;
+#else
+    if (!pthread_create(thread, NULL, run, start)) return 1;
+#endif
+    free(start);
+    return 0;
+}
+
+// Wait for the thread to terminate
+void threadJoin(Thread thread) {
+#ifdef _MSC_VER
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+// Returns the number of processors available, at least 1
+int processorCount(void) {
+#ifdef _MSC_VER
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+#ifdef _MSC_VER
+void mutexInit(Mutex* m)          { InitializeCriticalSection(m); }
+void mutexLock(Mutex* m)          { EnterCriticalSection(m); }
+void mutexUnlock(Mutex* m)        { LeaveCriticalSection(m); }
+void mutexDestroy(Mutex* m)       { DeleteCriticalSection(m); }
+void condInit(Cond* c)            { InitializeConditionVariable(c); }
+void condWait(Cond* c, Mutex* m)  { SleepConditionVariableCS(c, m, INFINITE); }
+void condSignal(Cond* c)          { WakeConditionVariable(c); }
+void condBroadcast(Cond* c)       { WakeAllConditionVariable(c); }
+void condDestroy(Cond* c)         { } // nothing to release
+#else
+void mutexInit(Mutex* m)          { pthread_mutex_init(m, NULL); }
+void mutexLock(Mutex* m)          { pthread_mutex_lock(m); }
+void mutexUnlock(Mutex* m)        { pthread_mutex_unlock(m); }
+void mutexDestroy(Mutex* m)       { pthread_mutex_destroy(m); }
+void condInit(Cond* c)            { pthread_cond_init(c, NULL); }
+void condWait(Cond* c, Mutex* m)  { pthread_cond_wait(c, m); }
+void condSignal(Cond* c)          { pthread_cond_signal(c); }
+void condBroadcast(Cond* c)       { pthread_cond_broadcast(c); }
+void condDestroy(Cond* c)         { pthread_cond_destroy(c); }
+#endif
+
+// Let other threads run
+void threadYield(void) {
+#ifdef _MSC_VER
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+// Suspend the calling thread for ms milliseconds
+void threadSleep(int ms) {
+#ifdef _MSC_VER
+    Sleep(ms);
+#else
+    struct timespec t;
+    t.tv_sec = ms / 1000;
+    t.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&t, NULL);
+#endif
+}
+
+// Atomic operations. A load acquires and a store releases, so that a thread
+// that loads a value also sees all writes done before it was stored.
+#ifdef _MSC_VER
+long atomicLoad(volatile long* p) { 
+    return InterlockedCompareExchange(p, 0, 0); 
+}
+void atomicStore(volatile long* p, long value) { 
+    InterlockedExchange(p, value); 
+}
+// Returns 1 if *p was expected and has been replaced by desired
+int atomicCompareExchange(volatile long* p, long expected, long desired) {
+    return InterlockedCompareExchange(p, desired, expected) == expected;
+}
+#else
+long atomicLoad(volatile long* p) { 
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE); 
+}
+void atomicStore(volatile long* p, long value) { 
+    __atomic_store_n(p, value, __ATOMIC_RELEASE); 
+}
+// Returns 1 if *p was expected and has been replaced by desired
+int atomicCompareExchange(volatile long* p, long expected, long desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, 
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
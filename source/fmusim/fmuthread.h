@@ -0,0 +1,42 @@
+/* -------------------------------------------------------------------------
+ * fmuthread.h
+ * Threads, mutexes, condition variables and atomic operations
+ * for Windows and POSIX.
+ * -------------------------------------------------------------------------*/
+
+#ifndef fmuthread_h
+#define fmuthread_h
+
+#ifdef _MSC_VER
+#include <windows.h>
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Cond;
+#else
+#include <pthread.h>
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+#endif
+
+typedef void (*ThreadFunction)(void* arg);
+
+int threadCreate(Thread* thread, ThreadFunction f, void* arg);
+void threadJoin(Thread thread);
+int processorCount(void);
+void mutexInit(Mutex* m);
+void mutexLock(Mutex* m);
+void mutexUnlock(Mutex* m);
+void mutexDestroy(Mutex* m);
+void condInit(Cond* c);
+void condWait(Cond* c, Mutex* m);
+void condSignal(Cond* c);
+void condBroadcast(Cond* c);
+void condDestroy(Cond* c);
+void threadYield(void);
+void threadSleep(int ms);
+long atomicLoad(volatile long* p);
+void atomicStore(volatile long* p, long value);
+int atomicCompareExchange(volatile long* p, long expected, long desired);
+
+#endif // fmuthread_h
@@ -1,143 +1,491 @@
 #include "fmuzip.h"
+#include "inflate.h"
+#include "main.h"
 
 #include <string.h>
 #include <stdlib.h>
-#include <malloc.h>
 
+#include <sys/stat.h>
+#include <sys/types.h>
 #ifdef _MSC_VER
 #include <windows.h>
+#include <direct.h>
+#include <io.h>
+#define mkdir(path, mode) _mkdir(path)
+#define PATH_SEP "\\"
 #else
+#include <dirent.h>
 #include <unistd.h>
+#define PATH_SEP "/"
 #endif
 
-#define UNZIP_CMD "7z x -aoa -o"
-#define BUFSIZE 4096
+// signatures and sizes of the zip records used here, see the
+// .ZIP File Format Specification by PKWARE (APPNOTE.TXT)
+#define ZIP_LOCAL_SIG     0x04034b50
+#define ZIP_CENTRAL_SIG   0x02014b50
+#define ZIP_END_SIG       0x06054b50
+#define ZIP_LOCAL_SIZE    30
+#define ZIP_CENTRAL_SIZE  46
+#define ZIP_END_SIZE      22
+#define ZIP_MAX_COMMENT   0xffff
 
-// return codes of the 7z command line tool
-#define SEVEN_ZIP_NO_ERROR 0 // success
-#define SEVEN_ZIP_WARNING 1  // e.g., one or more files were locked during zip
-#define SEVEN_ZIP_ERROR 2
-#define SEVEN_ZIP_COMMAND_LINE_ERROR 7
-#define SEVEN_ZIP_OUT_OF_MEMORY 8
-#define SEVEN_ZIP_STOPPED_BY_USER 255
+#define ZIP_STORED        0
+#define ZIP_DEFLATED      8
+#define ZIP_ENCRYPTED     0x0001 // general purpose flag bit 0
 
-#ifdef _MSC_VER
-int fmuUnzip(const char *zipPath, const char *outPath) {
-    int code;
-    char cwd[BUFSIZE];
-    char binPath[BUFSIZE];
-    int n = strlen(UNZIP_CMD) + strlen(outPath) + 1 +  strlen(zipPath) + 9;
-    char* cmd = (char*)calloc(sizeof(char), n);
-
-    // remember current directory
-    if (!GetCurrentDirectory(BUFSIZE, cwd)) {
-        printf ("error: Could not get current directory: %s\n", strerror(GetLastError()));
-        return 0; // error
-    }
-        
-    // change to %FMUSDK_HOME%\bin to find 7z.dll and 7z.exe
-    if (!GetEnvironmentVariable("FMUSDK_HOME", binPath, BUFSIZE)) {
-        if (GetLastError() == ERROR_ENVVAR_NOT_FOUND) {
-            printf ("error: Environment variable FMUSDK_HOME not defined.\n");
+static unsigned int readU16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int readU32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// CRC-32 as used by zip, polynomial 0xedb88320
+unsigned int zipCrc32(const unsigned char* data, size_t n) {
+    static unsigned int table[256];
+    static int tableReady = 0;
+    unsigned int crc = 0xffffffff;
+    size_t i;
+    if (!tableReady) {
+        unsigned int c;
+        int k;
+        for (i=0; i<256; i++) {
+            c = (unsigned int)i;
+            for (k=0; k<8; k++)
+                c = (c >> 1) ^ (0xedb88320 & (0 - (c & 1)));
+            table[i] = c;
+        }
+        tableReady = 1;
+    }
+    for (i=0; i<n; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// read n bytes at the given offset, returns 0 to indicate error
+static int readAt(FILE* file, long offset, unsigned char* buffer, size_t n) {
+    if (fseek(file, offset, SEEK_SET)) return 0;
+    return fread(buffer, 1, n, file) == n;
+}
+
+// Open the zip archive and read its central directory.
+// Returns NULL to indicate failure.
+ZipArchive* zipOpen(const char* zipPath) {
+    ZipArchive* zip;
+    unsigned char* tail;
+    unsigned char* cd;
+    unsigned char* p;
+    long size, tailSize, pos;
+    unsigned int i, n, cdSize, cdOffset;
+    FILE* file = fopen(zipPath, "rb");
+    if (!file) {
+        printf("error: Could not open FMU '%s'\n", zipPath);
+        return NULL;
+    }
+
+    // locate the end of central directory record, followed by a comment
+    if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < ZIP_END_SIZE) {
+        printf("error: '%s' is not a zip file\n", zipPath);
+        fclose(file);
+        return NULL;
+    }
+    tailSize = size < ZIP_END_SIZE + ZIP_MAX_COMMENT ? size : ZIP_END_SIZE + ZIP_MAX_COMMENT;
+    tail = (unsigned char*)malloc(tailSize);
+    if (!tail || !readAt(file, size - tailSize, tail, tailSize)) {
+        printf("error: Could not read '%s'\n", zipPath);
+        free(tail);
+        fclose(file);
+        return NULL;
+    }
+    for (pos = tailSize - ZIP_END_SIZE; pos >= 0; pos--)
+        if (readU32(tail + pos) == ZIP_END_SIG) break;
+    if (pos < 0) {
+        printf("error: '%s' is not a zip file\n", zipPath);
+        free(tail);
+        fclose(file);
+        return NULL;
+    }
+    n        = readU16(tail + pos + 10);
+    cdSize   = readU32(tail + pos + 12);
+    cdOffset = readU32(tail + pos + 16);
+    free(tail);
+    if (cdOffset == 0xffffffff || (long)cdOffset + (long)cdSize > size) {
+        printf("error: Unsupported or corrupt zip file '%s'\n", zipPath);
+        fclose(file);
+        return NULL;
+    }
+
+    // read the central directory
+    zip = (ZipArchive*)calloc(1, sizeof(ZipArchive));
+    cd = (unsigned char*)malloc(cdSize ? cdSize : 1);
+    if (zip) zip->entries = (ZipEntry*)calloc(n ? n : 1, sizeof(ZipEntry));
+    if (!zip || !cd || !zip->entries) {
+        printf("error: Out of memory\n");
+        free(cd);
+        if (zip) free(zip->entries);
+        free(zip);
+        fclose(file);
+        return NULL;
+    }
+    zip->file = file;
+    zip->size = size;
+    if (!readAt(file, cdOffset, cd, cdSize)) {
+        printf("error: Could not read central directory of '%s'\n", zipPath);
+        free(cd);
+        zipClose(zip);
+        return NULL;
+    }
+    // the central directory holds name, size and CRC of all entries
+    // and is therefore a cheap fingerprint of the archive content
+    zip->cdCrc = zipCrc32(cd, cdSize);
+    p = cd;
+    for (i=0; i<n; i++) {
+        ZipEntry* e = &zip->entries[i];
+        unsigned int nameLen;
+        if (p + ZIP_CENTRAL_SIZE > cd + cdSize || readU32(p) != ZIP_CENTRAL_SIG) {
+            printf("error: Corrupt central directory in '%s'\n", zipPath);
+            free(cd);
+            zipClose(zip);
+            return NULL;
+        }
+        nameLen           = readU16(p + 28);
+        e->flags          = readU16(p + 8);
+        e->method         = readU16(p + 10);
+        e->crc            = readU32(p + 16);
+        e->compressedSize = readU32(p + 20);
+        e->size           = readU32(p + 24);
+        e->offset         = readU32(p + 42);
+        if (p + ZIP_CENTRAL_SIZE + nameLen > cd + cdSize) {
+            printf("error: Corrupt central directory in '%s'\n", zipPath);
+            free(cd);
+            zipClose(zip);
+            return NULL;
         }
-        else {
-            printf ("error: Could not get value of FMUSDK_HOME: %s\n",strerror(GetLastError()));
+        e->name = (char*)malloc(nameLen + 1);
+        if (!e->name) {
+            printf("error: Out of memory\n");
+            free(cd);
+            zipClose(zip);
+            return NULL;
         }
-        return 0; // error       
+        memcpy(e->name, p + ZIP_CENTRAL_SIZE, nameLen);
+        e->name[nameLen] = '\0';
+        zip->n++;
+        p += ZIP_CENTRAL_SIZE + nameLen + readU16(p + 30) + readU16(p + 32);
     }
-#if WINDOWS
-    strcat(binPath, "\\bin");
-#else
-    strcat(binPath, "/bin");
-#endif
-    if (!SetCurrentDirectory(binPath)) {
-        printf ("error: could not change to directory '%s': %s\n", binPath, strerror(GetLastError())); 
-        return 0; // error        
-    }
-   
-    // run the unzip command
-    // remove "> NUL" to see the unzip protocol
-    sprintf(cmd, "%s%s \"%s\" > NUL", UNZIP_CMD, outPath, zipPath); 
-    // printf("cmd='%s'\n", cmd);
-    code = system(cmd);
-    free(cmd);
-    if (code!=SEVEN_ZIP_NO_ERROR) {
-        switch (code) {
-            printf("7z: ");
-            case SEVEN_ZIP_WARNING:            printf("warning\n"); break;
-            case SEVEN_ZIP_ERROR:              printf("error\n"); break;
-            case SEVEN_ZIP_COMMAND_LINE_ERROR: printf("command line error\n"); break;
-            case SEVEN_ZIP_OUT_OF_MEMORY:      printf("out of memory\n"); break;
-            case SEVEN_ZIP_STOPPED_BY_USER:    printf("stopped by user\n"); break;
-            default: printf("unknown problem\n");
+    free(cd);
+    return zip;
+}
+
+// returns NULL if the archive has no entry with the given name
+ZipEntry* zipFind(ZipArchive* zip, const char* name) {
+    int i;
+    for (i=0; i<zip->n; i++)
+        if (!strcmp(zip->entries[i].name, name)) return &zip->entries[i];
+    return NULL;
+}
+
+// Returns the uncompressed content of the entry, followed by a terminating
+// '\0', or NULL to indicate failure. The caller must free the result.
+unsigned char* zipRead(ZipArchive* zip, ZipEntry* entry) {
+    unsigned char header[ZIP_LOCAL_SIZE];
+    unsigned char* compressed;
+    unsigned char* data;
+    size_t compressedBytes, bytes;
+    long offset;
+    int err = 0;
+    if (entry->flags & ZIP_ENCRYPTED) {
+        printf("error: Entry '%s' is encrypted\n", entry->name);
+        return NULL;
+    }
+    if (entry->method != ZIP_STORED && entry->method != ZIP_DEFLATED) {
+        printf("error: Entry '%s' uses unsupported compression method %d\n",
+                entry->name, entry->method);
+        return NULL;
+    }
+    if (!readAt(zip->file, entry->offset, header, ZIP_LOCAL_SIZE)
+            || readU32(header) != ZIP_LOCAL_SIG) {
+        printf("error: Corrupt local header of entry '%s'\n", entry->name);
+        return NULL;
+    }
+    offset = entry->offset + ZIP_LOCAL_SIZE + readU16(header + 26) + readU16(header + 28);
+
+    // the sizes come from the archive and may be corrupt: the compressed data
+    // must lie within the archive, deflate expands it at most 1032 times,
+    // and adding the terminating '\0' must not wrap around
+    compressedBytes = (size_t)entry->compressedSize + 1;
+    bytes = (size_t)entry->size + 1;
+    if (entry->compressedSize > zip->size || offset < 0
+            || (unsigned long)offset > zip->size - entry->compressedSize
+            || (double)entry->size > 1032.0 * entry->compressedSize
+            || compressedBytes == 0 || bytes == 0) {
+        printf("error: Corrupt size of entry '%s'\n", entry->name);
+        return NULL;
+    }
+    compressed = (unsigned char*)malloc(compressedBytes);
+    data = (unsigned char*)malloc(bytes);
+    if (!compressed || !data) {
+        printf("error: Out of memory reading entry '%s'\n", entry->name);
+        free(compressed);
+        free(data);
+        return NULL;
+    }
+    if (!readAt(zip->file, offset, compressed, entry->compressedSize)) {
+        printf("error: Could not read entry '%s'\n", entry->name);
+        free(compressed);
+        free(data);
+        return NULL;
+    }
+    if (entry->method == ZIP_STORED) {
+        if (entry->compressedSize != entry->size) err = 1;
+        else memcpy(data, compressed, entry->size);
+    }
+    else {
+        err = inflateRaw(compressed, entry->compressedSize, data, entry->size);
+    }
+    free(compressed);
+    if (err) {
+        printf("error: Could not decompress entry '%s' (%d)\n", entry->name, err);
+        free(data);
+        return NULL;
+    }
+    if (zipCrc32(data, entry->size) != entry->crc) {
+        printf("error: CRC mismatch in entry '%s'\n", entry->name);
+        free(data);
+        return NULL;
+    }
+    data[entry->size] = '\0';
+    return data;
+}
+
+// create all directories of the given file path
+static void makeDirs(char* path) {
+    char* p;
+    for (p=path+1; *p; p++) {
+        if (*p == '/' || *p == '\\') {
+            char c = *p;
+            *p = '\0';
+            mkdir(path, 0755); // fails harmlessly if the directory exists
+            *p = c;
         }
     }
-    
-    // restore current directory
-    SetCurrentDirectory(cwd);
-    
-    return (code==SEVEN_ZIP_NO_ERROR || code==SEVEN_ZIP_WARNING) ? 1 : 0;  
 }
-#else
+
+// reject absolute paths and paths that leave the output directory
+static int isSafePath(const char* name) {
+    const char* p;
+    if (name[0] == '/' || name[0] == '\\' || strchr(name, ':')) return 0;
+    for (p=name; *p; p++) {
+        if ((p==name || p[-1]=='/' || p[-1]=='\\') && p[0]=='.' && p[1]=='.'
+            && (p[2]=='\0' || p[2]=='/' || p[2]=='\\')) return 0;
+    }
+    return 1;
+}
+
+// Write the given entry to outPath, which ends with a path separator.
+// Missing directories are created. Returns 0 to indicate failure.
+int zipExtract(ZipArchive* zip, ZipEntry* entry, const char* outPath) {
+    unsigned char* data;
+    char* path;
+    FILE* file;
+    int ok;
+    if (!isSafePath(entry->name)) {
+        printf("error: Illegal path of entry '%s'\n", entry->name);
+        return 0;
+    }
+    data = zipRead(zip, entry);
+    if (!data) return 0;
+    path = (char*)calloc(sizeof(char), strlen(outPath) + strlen(entry->name) + 1);
+    if (!path) {
+        printf("error: Out of memory extracting entry '%s'\n", entry->name);
+        free(data);
+        return 0;
+    }
+    sprintf(path, "%s%s", outPath, entry->name);
+    makeDirs(path);
+    file = fopen(path, "wb");
+    if (!file) {
+        printf("error: Could not create '%s' for entry '%s'\n", path, entry->name);
+        free(path);
+        free(data);
+        return 0;
+    }
+    ok = fwrite(data, 1, entry->size, file) == entry->size;
+    ok = !fclose(file) && ok;
+    if (!ok) printf("error: Could not write '%s' for entry '%s'\n", path, entry->name);
+    free(path);
+    free(data);
+    return ok;
+}
+
+void zipClose(ZipArchive* zip) {
+    int i;
+    if (!zip) return;
+    for (i=0; i<zip->n; i++) free(zip->entries[i].name);
+    free(zip->entries);
+    fclose(zip->file);
+    free(zip);
+}
+
+// Extract modelDescription.xml and the binaries of this platform
+// to outPath, which ends with a path separator.
+// Other entries, e.g. sources and documentation, are not needed to
+// simulate the FMU and are skipped. Returns 0 to indicate failure.
+static int extractFmu(ZipArchive* zip, const char *zipPath, const char *outPath) {
+    int i;
+    int ok = 1;
+    int dirLen = strlen(ZIP_DLL_DIR);
+    if (!zipFind(zip, XML_FILE)) {
+        printf("error: No %s in '%s'\n", XML_FILE, zipPath);
+        ok = 0;
+    }
+    for (i=0; i<zip->n; i++) {
+        ZipEntry* e = &zip->entries[i];
+        int isDir = e->name[0] && e->name[strlen(e->name) - 1] == '/';
+        if (isDir) continue;
+        if (!strcmp(e->name, XML_FILE) || !strncmp(e->name, ZIP_DLL_DIR, dirLen)) {
+            if (!zipExtract(zip, e, outPath)) ok = 0;
+        }
+    }
+    return ok;
+}
+
+// Extract the FMU at zipPath to outPath, see extractFmu.
+// Returns 0 to indicate failure.
 int fmuUnzip(const char *zipPath, const char *outPath) {
-    int code;
-    char cwd[BUFSIZE];
-    char binPath[BUFSIZE];
-    int n;
-    char* cmd;
-
-    // remember current directory
-    if (!getcwd(cwd, BUFSIZE)) {
-      printf ("error: Could not get current directory\n");
-      return 0; // error
-    }
-        
-    const char *FMUSDK_HOME = getenv("FMUSDK_HOME");
-    // change to %FMUSDK_HOME%\bin to find 7z.dll and 7z.exe
-    if (FMUSDK_HOME==NULL) {
-      printf ("warning: Could not get value of FMUSDK_HOME, assuming 7zip is in your path.\n");
-      FMUSDK_HOME = strdup("");
-    } else {
-#if WINDOWS
-        strcat(binPath, "\\bin");
-#else
-        strcat(binPath, "/bin");
-#endif
-	if (!chdir(binPath)) {
-	    printf ("error: could not change to directory '%s'\n", binPath);
-	    return 0; // error        
-	}
-    }
-   
-    // run the unzip command
-#if WINDOWS
-    n = strlen(UNZIP_CMD) + strlen(outPath) + 1 +  strlen(zipPath) + 9;
-    cmd = (char*)calloc(sizeof(char), n);
-    // remove "> NUL" to see the unzip protocol
-    sprintf(cmd, "%s%s \"%s\" > NUL", UNZIP_CMD, outPath, zipPath); 
+    int ok;
+    ZipArchive* zip = zipOpen(zipPath);
+    if (!zip) return 0; // error
+    ok = extractFmu(zip, zipPath, outPath);
+    zipClose(zip);
+    return ok;
+}
+
+static int isDirectory(const char* path) {
+    struct stat st;
+    return !stat(path, &st) && (st.st_mode & S_IFMT) == S_IFDIR;
+}
+
+// Create a new, uniquely named directory from template path,
+// which ends with XXXXXX. Returns 0 to indicate failure.
+static int makeTmpDir(char* path) {
+#ifdef _MSC_VER
+    return _mktemp(path) && !_mkdir(path);
 #else
-    n = strlen(UNZIP_CMD) + strlen(outPath) + 1 +  strlen(zipPath) + 16;
-    cmd = (char*)calloc(sizeof(char), n);
-    sprintf(cmd, "%s%s \"%s\" > /dev/null", UNZIP_CMD, outPath, zipPath); 
+    return mkdtemp(path) != NULL;
 #endif
-    printf("cmd='%s'\n", cmd);
-    code = system(cmd);
-    free(cmd);
-    if (code!=SEVEN_ZIP_NO_ERROR) {
-        switch (code) {
-            printf("7z: ");
-            case SEVEN_ZIP_WARNING:            printf("warning\n"); break;
-            case SEVEN_ZIP_ERROR:              printf("error\n"); break;
-            case SEVEN_ZIP_COMMAND_LINE_ERROR: printf("command line error\n"); break;
-            case SEVEN_ZIP_OUT_OF_MEMORY:      printf("out of memory\n"); break;
-            case SEVEN_ZIP_STOPPED_BY_USER:    printf("stopped by user\n"); break;
-            default: printf("unknown problem\n");
+}
+
+// Extract the FMU at zipPath to a subdirectory of cacheDir that is named
+// after the content of the archive, unless this was done before.
+// The FMU is extracted to a private directory first, which is then renamed.
+// Renaming is atomic, so concurrent runs either see a complete directory 
+// or none. If another run wins the race, its copy is used. 
+// Returns the directory, ending with a path separator, or NULL to indicate
+// failure. The caller must free the result but not remove the directory.
+char* fmuUnzipCached(const char *zipPath, const char *cacheDir) {
+    ZipArchive* zip;
+    char key[20];
+    char* outPath;
+    char* tmpPath;
+    int n;
+    zip = zipOpen(zipPath);
+    if (!zip) return NULL;
+    sprintf(key, "%08x%08x", zip->cdCrc, zip->size);
+    // outPath holds "<dir>/<key>/", tmpPath "<dir>/<key>.XXXXXX/"
+    n = strlen(cacheDir) + strlen(PATH_SEP) + strlen(key);
+    outPath = (char*)calloc(sizeof(char), n + strlen(PATH_SEP) + 1);
+    tmpPath = (char*)calloc(sizeof(char), n + strlen(".XXXXXX") + strlen(PATH_SEP) + 1);
+    if (!outPath || !tmpPath) {
+        printf("error: Out of memory\n");
+        free(outPath);
+        free(tmpPath);
+        zipClose(zip);
+        return NULL;
+    }
+    sprintf(outPath, "%s%s%s", cacheDir, PATH_SEP, key);
+    if (isDirectory(outPath)) {
+        // cache hit
+        zipClose(zip);
+        free(tmpPath);
+        return strcat(outPath, PATH_SEP);
+    }
+    sprintf(tmpPath, "%s%s", cacheDir, PATH_SEP);
+    makeDirs(tmpPath);
+    sprintf(tmpPath, "%s%s%s.XXXXXX", cacheDir, PATH_SEP, key);
+    if (!makeTmpDir(tmpPath)) {
+        printf("error: Could not create directory in cache '%s'\n", cacheDir);
+        free(outPath);
+        free(tmpPath);
+        zipClose(zip);
+        return NULL;
+    }
+    strcat(tmpPath, PATH_SEP);
+    if (!extractFmu(zip, zipPath, tmpPath)) {
+        fmuRemoveDir(tmpPath);
+        free(outPath);
+        free(tmpPath);
+        zipClose(zip);
+        return NULL;
+    }
+    zipClose(zip);
+    tmpPath[strlen(tmpPath) - 1] = '\0';
+    if (rename(tmpPath, outPath)) {
+        // fails if a concurrent run has renamed its copy first
+        fmuRemoveDir(tmpPath);
+        if (!isDirectory(outPath)) {
+            printf("error: Could not rename '%s' to '%s'\n", tmpPath, outPath);
+            free(outPath);
+            free(tmpPath);
+            return NULL;
         }
     }
-    
-    // restore current directory
-    chdir(cwd);
-    
-    return (code==SEVEN_ZIP_NO_ERROR || code==SEVEN_ZIP_WARNING) ? 1 : 0;  
+    free(tmpPath);
+    return strcat(outPath, PATH_SEP);
 }
+
+// Remove the given directory with all its content.
+// Returns 0 to indicate failure.
+int fmuRemoveDir(const char *path) {
+    char* child;
+    int ok = 1;
+#ifdef _MSC_VER
+    WIN32_FIND_DATA data;
+    HANDLE h;
+    child = (char*)calloc(sizeof(char), strlen(path) + MAX_PATH + 3);
+    if (!child) return 0;
+    sprintf(child, "%s\\*", path);
+    h = FindFirstFile(child, &data);
+    if (h != INVALID_HANDLE_VALUE) {
+        do {
+            if (!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) continue;
+            sprintf(child, "%s\\%s", path, data.cFileName);
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ok = fmuRemoveDir(child) && ok;
+            else ok = DeleteFile(child) && ok;
+        } while (FindNextFile(h, &data));
+        FindClose(h);
+    }
+    free(child);
+    return RemoveDirectory(path) && ok;
+#else
+    struct dirent* e;
+    struct stat st;
+    DIR* dir = opendir(path);
+    if (!dir) return 0;
+    while ((e = readdir(dir))) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        child = (char*)calloc(sizeof(char), strlen(path) + strlen(e->d_name) + 2);
+        if (!child) {
+            ok = 0;
+            break;
+        }
+        sprintf(child, "%s/%s", path, e->d_name);
+        if (!lstat(child, &st) && S_ISDIR(st.st_mode)) ok = fmuRemoveDir(child) && ok;
+        else ok = !unlink(child) && ok;
+        free(child);
+    }
+    closedir(dir);
+    return !rmdir(path) && ok;
 #endif
+}
@@ -1,13 +1,44 @@
-/* ------------------------------------------------------------------------- 
+/* -------------------------------------------------------------------------
  * ziphandler.h
  * Code for handling zip files.
- * Copyright 2010 QTronic GmbH. All rights reserved. 
+ * Copyright 2010 QTronic GmbH. All rights reserved.
  * -------------------------------------------------------------------------
  */
 
 #ifndef zip_h
 #define zip_h
 
+#include <stdio.h>
+
+// An entry of the central directory of a zip archive
+typedef struct {
+    char* name;                  // path of the entry, '/' separated
+    unsigned short method;       // compression method, 0=stored, 8=deflated
+    unsigned short flags;        // general purpose bit flags
+    unsigned int crc;            // CRC-32 of the uncompressed data
+    unsigned int compressedSize;
+    unsigned int size;           // uncompressed size
+    unsigned int offset;         // offset of the local header in the archive
+} ZipEntry;
+
+// An open zip archive with its central directory
+typedef struct {
+    FILE* file;
+    ZipEntry* entries;
+    int n;                       // number of entries
+    unsigned int size;           // size of the archive file
+    unsigned int cdCrc;          // CRC-32 of the central directory
+} ZipArchive;
+
+ZipArchive* zipOpen(const char* zipPath);
+ZipEntry* zipFind(ZipArchive* zip, const char* name);
+unsigned char* zipRead(ZipArchive* zip, ZipEntry* entry);
+int zipExtract(ZipArchive* zip, ZipEntry* entry, const char* outPath);
+void zipClose(ZipArchive* zip);
+unsigned int zipCrc32(const unsigned char* data, size_t n);
+
 int fmuUnzip(const char *zipPath, const char *outPath);
+char* fmuUnzipCached(const char *zipPath, const char *cacheDir);
+int fmuRemoveDir(const char *path);
 
 #endif // zip_h
@@ -0,0 +1,274 @@
+/* -------------------------------------------------------------------------
+ * inflate.c
+ * Decoder for raw deflate streams (RFC 1951) as stored in zip archives.
+ * The whole compressed stream and the whole output buffer are in memory,
+ * which keeps the decoder small: no sliding window, no streaming state.
+ * Huffman codes are decoded canonically, bit by bit, as described in
+ * section 3.2.2 of RFC 1951.
+ * -------------------------------------------------------------------------
+ */
+
+#include "inflate.h"
+
+#define MAXBITS 15      // maximum bits in a code
+#define MAXLCODES 286   // maximum number of literal/length codes
+#define MAXDCODES 30    // maximum number of distance codes
+#define MAXCODES (MAXLCODES+MAXDCODES)
+#define FIXLCODES 288   // number of fixed literal/length codes
+
+// error codes returned by inflateRaw
+#define INFLATE_INPUT_END    -1 // compressed data ended prematurely
+#define INFLATE_OUTPUT_FULL  -2 // uncompressed data exceeds dstLen
+#define INFLATE_BAD_BLOCK    -3 // invalid block type
+#define INFLATE_BAD_STORED   -4 // stored block length does not match its complement
+#define INFLATE_BAD_CODES    -5 // invalid code lengths in dynamic block
+#define INFLATE_BAD_SYMBOL   -6 // invalid literal/length or distance symbol
+#define INFLATE_BAD_DISTANCE -7 // distance refers to data before start of output
+#define INFLATE_SIZE         -8 // uncompressed data is shorter than dstLen
+
+typedef struct {
+    const unsigned char* in;  // compressed input
+    size_t inLen;
+    size_t inPos;
+    unsigned char* out;       // uncompressed output
+    size_t outLen;
+    size_t outPos;
+    unsigned int bitBuf;      // bits not yet consumed, lsb first
+    int bitCnt;               // number of valid bits in bitBuf
+    int inputEnd;             // 1 if a read beyond the input was attempted
+} InflateState;
+
+// canonical Huffman code: number of codes of each length and the
+// symbols ordered by code
+typedef struct {
+    short* count;
+    short* symbol;
+} Huffman;
+
+// return need bits from the input stream, lsb first
+static int bits(InflateState* s, int need) {
+    unsigned long val = s->bitBuf;
+    while (s->bitCnt < need) {
+        if (s->inPos == s->inLen) {
+            s->inputEnd = 1;
+            return 0;
+        }
+        val |= (unsigned long)s->in[s->inPos++] << s->bitCnt;
+        s->bitCnt += 8;
+    }
+    s->bitBuf = (unsigned int)(val >> need);
+    s->bitCnt -= need;
+    return (int)(val & ((1UL << need) - 1));
+}
+
+// copy a stored (uncompressed) block to the output
+static int stored(InflateState* s) {
+    unsigned int len;
+    // discard remaining bits of the current byte
+    s->bitBuf = 0;
+    s->bitCnt = 0;
+    if (s->inPos + 4 > s->inLen) return INFLATE_INPUT_END;
+    len  = s->in[s->inPos++];
+    len |= s->in[s->inPos++] << 8;
+    if (s->in[s->inPos++] != (~len & 0xff) ||
+        s->in[s->inPos++] != ((~len >> 8) & 0xff))
+        return INFLATE_BAD_STORED;
+    if (s->inPos + len > s->inLen) return INFLATE_INPUT_END;
+    if (s->outPos + len > s->outLen) return INFLATE_OUTPUT_FULL;
+    while (len--) s->out[s->outPos++] = s->in[s->inPos++];
+    return 0;
+}
+
+// decode one symbol using the given code, returns a negative value on error
+static int decode(InflateState* s, const Huffman* h) {
+    int len;
+    int code = 0;   // len bits being decoded
+    int first = 0;  // first code of length len
+    int index = 0;  // index of first code of length len in symbol table
+    for (len=1; len<=MAXBITS; len++) {
+        int count;
+        code |= bits(s, 1);
+        if (s->inputEnd) return INFLATE_INPUT_END;
+        count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return INFLATE_BAD_SYMBOL;
+}
+
+// build a canonical Huffman code from the given code lengths.
+// Returns 0 for a complete code, a positive value for an incomplete
+// code and a negative value for an over-subscribed code.
+static int construct(Huffman* h, const short* length, int n) {
+    int symbol, len, left;
+    short offs[MAXBITS+1];
+    for (len=0; len<=MAXBITS; len++) h->count[len] = 0;
+    for (symbol=0; symbol<n; symbol++) h->count[length[symbol]]++;
+    if (h->count[0] == n) return 0; // no codes, complete but decoding will fail
+    left = 1;
+    for (len=1; len<=MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return left;
+    }
+    offs[1] = 0;
+    for (len=1; len<MAXBITS; len++) offs[len+1] = offs[len] + h->count[len];
+    for (symbol=0; symbol<n; symbol++)
+        if (length[symbol] != 0) h->symbol[offs[length[symbol]]++] = symbol;
+    return left;
+}
+
+// decode literal/length and distance codes until end of block
+static int codes(InflateState* s, const Huffman* lencode, const Huffman* distcode) {
+    static const short lbase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const short lext[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const short dbase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577};
+    static const short dext[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    int symbol;
+    size_t len, dist;
+    do {
+        symbol = decode(s, lencode);
+        if (symbol < 0) return symbol;
+        if (symbol < 256) {
+            // literal
+            if (s->outPos == s->outLen) return INFLATE_OUTPUT_FULL;
+            s->out[s->outPos++] = (unsigned char)symbol;
+        }
+        else if (symbol > 256) {
+            // length and distance of a match
+            symbol -= 257;
+            if (symbol >= 29) return INFLATE_BAD_SYMBOL;
+            len = lbase[symbol] + bits(s, lext[symbol]);
+            symbol = decode(s, distcode);
+            if (symbol < 0) return symbol;
+            if (symbol >= 30) return INFLATE_BAD_SYMBOL;
+            dist = dbase[symbol] + bits(s, dext[symbol]);
+            if (s->inputEnd) return INFLATE_INPUT_END;
+            if (dist > s->outPos) return INFLATE_BAD_DISTANCE;
+            if (s->outPos + len > s->outLen) return INFLATE_OUTPUT_FULL;
+            while (len--) {
+                s->out[s->outPos] = s->out[s->outPos - dist];
+                s->outPos++;
+            }
+        }
+    } while (symbol != 256); // end of block
+    return 0;
+}
+
+// decode a block that uses the fixed Huffman codes of RFC 1951
+// The tables are cheap to build and are rebuilt per block,
+// which keeps inflateRaw free of static state.
+static int fixed(InflateState* s) {
+    int symbol;
+    short lengths[FIXLCODES];
+    short lencnt[MAXBITS+1], lensym[FIXLCODES];
+    short distcnt[MAXBITS+1], distsym[MAXDCODES];
+    Huffman lencode = {lencnt, lensym};
+    Huffman distcode = {distcnt, distsym};
+    for (symbol=0; symbol<144; symbol++) lengths[symbol] = 8;
+    for (; symbol<256; symbol++) lengths[symbol] = 9;
+    for (; symbol<280; symbol++) lengths[symbol] = 7;
+    for (; symbol<FIXLCODES; symbol++) lengths[symbol] = 8;
+    construct(&lencode, lengths, FIXLCODES);
+    for (symbol=0; symbol<MAXDCODES; symbol++) lengths[symbol] = 5;
+    construct(&distcode, lengths, MAXDCODES);
+    return codes(s, &lencode, &distcode);
+}
+
+// decode a block that uses dynamic Huffman codes given in the block header
+static int dynamic(InflateState* s) {
+    static const short order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    int nlen, ndist, ncode, index, err;
+    short lengths[MAXCODES];
+    short lencnt[MAXBITS+1], lensym[MAXLCODES];
+    short distcnt[MAXBITS+1], distsym[MAXDCODES];
+    Huffman lencode = {lencnt, lensym};
+    Huffman distcode = {distcnt, distsym};
+
+    nlen = bits(s, 5) + 257;
+    ndist = bits(s, 5) + 1;
+    ncode = bits(s, 4) + 4;
+    if (s->inputEnd) return INFLATE_INPUT_END;
+    if (nlen > MAXLCODES || ndist > MAXDCODES) return INFLATE_BAD_CODES;
+
+    // code lengths of the code length code
+    for (index=0; index<ncode; index++) lengths[order[index]] = bits(s, 3);
+    for (; index<19; index++) lengths[order[index]] = 0;
+    if (s->inputEnd) return INFLATE_INPUT_END;
+    if (construct(&lencode, lengths, 19) != 0) return INFLATE_BAD_CODES;
+
+    // literal/length and distance code lengths
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol, len;
+        symbol = decode(s, &lencode);
+        if (symbol < 0) return symbol;
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+        len = 0;
+        if (symbol == 16) {
+            // repeat last length 3..6 times
+            if (index == 0) return INFLATE_BAD_CODES;
+            len = lengths[index - 1];
+            symbol = 3 + bits(s, 2);
+        }
+        else if (symbol == 17) symbol = 3 + bits(s, 3);  // repeat zero 3..10 times
+        else symbol = 11 + bits(s, 7);                   // repeat zero 11..138 times
+        if (s->inputEnd) return INFLATE_INPUT_END;
+        if (index + symbol > nlen + ndist) return INFLATE_BAD_CODES;
+        while (symbol--) lengths[index++] = len;
+    }
+    if (lengths[256] == 0) return INFLATE_BAD_CODES; // no end-of-block code
+
+    // incomplete codes are only allowed for a single length 1 code
+    err = construct(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1))
+        return INFLATE_BAD_CODES;
+    err = construct(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1))
+        return INFLATE_BAD_CODES;
+
+    return codes(s, &lencode, &distcode);
+}
+
+int inflateRaw(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen) {
+    InflateState s;
+    int last, type, err;
+    s.in = src;
+    s.inLen = srcLen;
+    s.inPos = 0;
+    s.out = dst;
+    s.outLen = dstLen;
+    s.outPos = 0;
+    s.bitBuf = 0;
+    s.bitCnt = 0;
+    s.inputEnd = 0;
+    do {
+        last = bits(&s, 1);
+        type = bits(&s, 2);
+        if (s.inputEnd) return INFLATE_INPUT_END;
+        switch (type) {
+            case 0:  err = stored(&s); break;
+            case 1:  err = fixed(&s); break;
+            case 2:  err = dynamic(&s); break;
+            default: err = INFLATE_BAD_BLOCK;
+        }
+        if (err) return err;
+    } while (!last);
+    return s.outPos == s.outLen ? 0 : INFLATE_SIZE;
+}
@@ -0,0 +1,18 @@
+/* -------------------------------------------------------------------------
+ * inflate.h
+ * Decoder for raw deflate streams (RFC 1951) as stored in zip archives.
+ * -------------------------------------------------------------------------
+ */
+
+#ifndef inflate_h
+#define inflate_h
+
+#include <stddef.h>
+
+// Decompress srcLen bytes of raw deflate data from src into dst.
+// dstLen is the exact size of the uncompressed data, e.g. as
+// recorded in the central directory of a zip archive.
+// Returns 0 on success, a negative error code otherwise.
+int inflateRaw(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen);
+
+#endif // inflate_h
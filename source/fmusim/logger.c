@@ -0,0 +1,578 @@
+/* -------------------------------------------------------------------------
+ * logger.c
+ * The logger called by FMUs. Messages are filtered by status and category
+ * before any formatting. Then references to variables such as #r12# are 
+ * replaced by variable names, and the message is printed. 
+ * With a buffer, fmuLogger only copies the format and the arguments of a 
+ * message into a lock-free ring buffer. A separate thread formats and 
+ * prints the messages, or the caller of flushLogger does. 
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "logger.h"
+#include "fmuthread.h"
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#define vsnprintf _vsnprintf
+#endif
+#ifndef va_copy
+#define va_copy(dst, src) ((dst) = (src))
+#endif
+
+#define MAX_MSG_SIZE 1000   // maximal length of a formatted message
+#define RECORD_SIZE 496     // space for the strings and arguments of a message
+#define MAX_SPEC_SIZE 32    // maximal length of a conversion specification
+#define CACHE_LINE 64       // size of a cache line in bytes
+
+// the arguments of a printf conversion as they are passed in the va_list
+typedef enum {
+    argNone, argInt, argLong, argLongLong, argSize, argDouble, argLongDouble,
+    argString, argPointer, argInvalid
+} ArgType;
+
+// a message in the buffer
+typedef struct {
+    int status;
+    int formatted;              // 1 if data holds the formatted message instead
+                                // of format and arguments
+    char data[RECORD_SIZE];     // instance name, category and format as strings,
+                                // then the arguments, each one unaligned
+} LogRecord;
+
+// a slot of the ring buffer, see http://www.1024cores.net/home/
+// lock-free-algorithms/queues/bounded-mpmc-queue. A slot at position pos
+// is free for writing if sequence == pos, and filled if sequence == pos + 1
+typedef struct {
+    volatile long sequence;
+    LogRecord record;
+} LogSlot;
+
+// a position in the ring buffer, on a cache line of its own, because 
+// tail is written by the logging threads and head by the printing thread
+typedef struct {
+    char before[CACHE_LINE];
+    volatile long value;
+    char after[CACHE_LINE];
+} Position;
+
+// Model instances known to fmuLogger, to look up the variables referenced
+// in their messages. The FMI 1.0 logger gets only the instance name.
+typedef struct {
+    const char* instanceName;
+    FMU* fmu;
+} LoggerInstance;
+
+static LoggerOptions options;               // fmiOK, all categories, no buffer
+static LoggerInstance* loggerInstances = NULL;
+static int nLoggerInstances = 0;
+
+// the buffer
+static LogSlot* slots = NULL;               // NULL if messages are printed directly
+static long capacity;                       // number of slots, a power of 2
+static Position tail;                       // position of the next message to write
+static Position head;                       // position of the next message to print
+static int initialized;                     // 1 if mutex has been initialized
+static Mutex mutex;                         // serializes printing from the buffer, 
+                                            // changes of the registered instances
+                                            // and closing
+static int closing;                         // 1 to terminate the thread
+static Thread thread;
+
+static const char* fmiStatusToString(fmiStatus status){
+    switch (status){
+        case fmiOK:      return "ok";
+        case fmiWarning: return "warning";
+        case fmiDiscard: return "discard";
+        case fmiError:   return "error";
+        case fmiFatal:   return "fatal";
+        default:         return "?";
+    }
+}
+
+// Returns 0 to indicate that name is not one of ok, warning, discard, error, fatal
+int parseStatus(const char* name, fmiStatus* status) {
+    fmiStatus s;
+    for (s=fmiOK; s<=fmiFatal; s++) {
+        if (!strcmp(name, fmiStatusToString(s))) {
+            *status = s;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Make fmuLogger resolve references in messages of the named instance of fmu.
+// Once initLogger has been called, this is safe while other instances log.
+// Returns 0 to indicate failure.
+int registerLoggerInstance(const char* instanceName, FMU* fmu) {
+    LoggerInstance* instances;
+    int ok = 1;
+    if (initialized) mutexLock(&mutex);
+    instances = (LoggerInstance*)realloc(loggerInstances, 
+            (nLoggerInstances + 1) * sizeof(LoggerInstance));
+    if (instances) {
+        loggerInstances = instances;
+        loggerInstances[nLoggerInstances].instanceName = instanceName;
+        loggerInstances[nLoggerInstances].fmu = fmu;
+        nLoggerInstances++;
+    }
+    else ok = 0;
+    if (initialized) mutexUnlock(&mutex);
+    if (!ok) printf("out of memory\n");
+    return ok;
+}
+
+// Forget the named instance after printing its buffered messages. 
+// The instance must no longer log.
+void unregisterLoggerInstance(const char* instanceName) {
+    int i;
+    flushLogger();
+    if (initialized) mutexLock(&mutex);
+    for (i=nLoggerInstances-1; i>=0; i--) {
+        if (!strcmp(loggerInstances[i].instanceName, instanceName)) {
+            loggerInstances[i] = loggerInstances[--nLoggerInstances];
+            break;
+        }
+    }
+    if (nLoggerInstances == 0) {
+        free(loggerInstances);
+        loggerInstances = NULL;
+    }
+    if (initialized) mutexUnlock(&mutex);
+}
+
+// Returns the FMU of the named instance, or NULL if unknown
+static FMU* getLoggerFmu(const char* instanceName) {
+    int i;
+    for (i=0; i<nLoggerInstances; i++) {
+        if (!strcmp(loggerInstances[i].instanceName, instanceName)) return loggerInstances[i].fmu;
+    }
+    return NULL;
+}
+
+// search a fmu for the given variable
+// return NULL if not found or vr = fmiUndefinedValueReference
+static ScalarVariable* getSV(FMU* fmu, char type, fmiValueReference vr) {
+    Elm tp;
+    switch (type) {
+        case 'r': tp = elm_Real;    break;
+        case 'i': tp = elm_Integer; break;
+        case 'b': tp = elm_Boolean; break;
+        case 's': tp = elm_String;  break;                
+        default: return NULL;
+    }
+    if (!fmu) return NULL;
+    return getVariable(fmu->modelDescription, vr, tp);
+}
+
+// replace e.g. #r1365# by variable name and ## by # in message
+// copies the result to buffer, truncated to nBuffer-1 chars
+static void replaceRefsInMessage(const char* msg, char* buffer, int nBuffer, FMU* fmu){
+    int i=0; // position in msg
+    int k=0; // position in buffer
+    int n;
+    char c = msg[i];
+    while (c!='\0' && k < nBuffer - 1) {
+        if (c!='#') {
+            // copy up to the next '#'
+            const char* hash = strchr(msg+i, '#');
+            int len = hash ? hash - (msg+i) : (int)strlen(msg+i);
+            if (len > nBuffer - 1 - k) len = nBuffer - 1 - k;
+            memcpy(buffer+k, msg+i, len);
+            k += len;
+            i += len;
+            c = msg[i];
+        }
+        else {
+            const char* end = strchr(msg+i+1, '#');
+            if (!end) {
+                printf("unmatched '#' in '%s'\n", msg);
+                buffer[k++]='#';
+                break;
+            }
+            n = end - (msg+i);
+            if (n==1) {
+                // ## detected, output #
+                buffer[k++]='#';
+                i += 2;
+                c = msg[i];
+            }
+            else {
+                char type = msg[i+1]; // one of ribs
+                char* digitsEnd;
+                fmiValueReference vr = (fmiValueReference)strtoul(msg+i+2, &digitsEnd, 10);
+                if (digitsEnd != msg+i+2) {
+                    // vr of type detected, e.g. #r12#
+                    ScalarVariable* sv = getSV(fmu, type, vr);
+                    const char* name = sv ? getName(sv) : "?";
+                    int len = strlen(name);
+                    if (len > nBuffer - 1 - k) len = nBuffer - 1 - k;
+                    memcpy(buffer+k, name, len);
+                    k += len;
+                    i += (n+1);
+                    c = msg[i]; 
+                }
+                else {
+                    // could not parse the number
+                    printf("illegal value reference at position %d in '%s'\n", i+2, msg);
+                    buffer[k++]='#';
+                    break;
+                }
+            }
+        }
+    } // while
+    buffer[k] = '\0';
+}
+
+// replace the references in the formatted message msg and print it
+static void printMessage(const char* instanceName, fmiStatus status, 
+        const char* category, const char* msg) {
+    char buffer[MAX_MSG_SIZE];
+    replaceRefsInMessage(msg, buffer, MAX_MSG_SIZE, getLoggerFmu(instanceName));
+    printf("%s %s (%s): %s\n", fmiStatusToString(status), instanceName, category, buffer);
+}
+
+// Parse the conversion specification at f, just after the '%'. Returns the
+// end of the specification, and sets type to the type of its argument and
+// nStars to the number of int arguments for width and precision before it.
+static const char* parseSpec(const char* f, ArgType* type, int* nStars) {
+    int length = 0; // 'h', 'l', 'q' for ll, 'z', 'L', or 0
+    *nStars = 0;
+    *type = argInvalid;
+    if (*f == '%') {
+        *type = argNone;
+        return f + 1;
+    }
+    while (*f && strchr("-+ #0", *f)) f++;
+    if (*f == '*') { (*nStars)++; f++; }
+    else while (*f >= '0' && *f <= '9') f++;
+    if (*f == '.') {
+        f++;
+        if (*f == '*') { (*nStars)++; f++; }
+        else while (*f >= '0' && *f <= '9') f++;
+    }
+    if (*f == 'h') {
+        length = 'h';
+        f++;
+        if (*f == 'h') f++;
+    }
+    else if (*f == 'l') {
+        length = 'l';
+        f++;
+        if (*f == 'l') { length = 'q'; f++; }
+    }
+    else if (*f == 'z' || *f == 'L') length = *f++;
+    if (!*f) return f;
+    switch (*f) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': 
+            switch (length) {
+                case 'l': *type = argLong; break;
+                case 'q': *type = argLongLong; break;
+                case 'z': *type = argSize; break;
+                case 'L': break;
+                default:  *type = argInt;
+            }
+            break;
+        case 'c': 
+            if (!length) *type = argInt; 
+            break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            if (length == 'L') *type = argLongDouble;
+            else if (!length || length == 'l') *type = argDouble;
+            break;
+        case 's': 
+            if (!length) *type = argString; 
+            break;
+        case 'p': 
+            if (!length) *type = argPointer; 
+            break;
+    }
+    return f + 1;
+}
+
+// copy n bytes to p, returns the end of the copy, or NULL if beyond end
+static char* put(char* p, const char* end, const void* value, size_t n) {
+    if (!p || (size_t)(end - p) < n) return NULL;
+    memcpy(p, value, n);
+    return p + n;
+}
+
+#define PUT_ARG(T, promoted) { T v = (T)va_arg(args, promoted); p = put(p, end, &v, sizeof(T)); }
+
+// Copy format and its arguments to p. Returns the end of the copy, 
+// or NULL if they do not fit or format is not supported.
+static char* putArgs(char* p, const char* end, const char* format, va_list args) {
+    const char* f = format;
+    p = put(p, end, format, strlen(format) + 1);
+    while (p && (f = strchr(f, '%'))) {
+        ArgType type;
+        int i, nStars;
+        const char* start = f;
+        f = parseSpec(f + 1, &type, &nStars);
+        if (f - start >= MAX_SPEC_SIZE) return NULL;
+        for (i=0; i<nStars; i++) PUT_ARG(int, int);
+        switch (type) {
+            case argNone:       break;
+            case argInt:        PUT_ARG(int, int); break;
+            case argLong:       PUT_ARG(long, long); break;
+            case argLongLong:   PUT_ARG(long long, long long); break;
+            case argSize:       PUT_ARG(size_t, size_t); break;
+            case argDouble:     PUT_ARG(double, double); break;
+            case argLongDouble: PUT_ARG(long double, long double); break;
+            case argPointer:    PUT_ARG(void*, void*); break;
+            case argString: {
+                const char* s = va_arg(args, const char*);
+                if (!s) s = "(null)";
+                p = put(p, end, s, strlen(s) + 1);
+                break;
+            }
+            default: return NULL;
+        }
+    }
+    return p;
+}
+
+#define PRINT_ARG(T) { \
+    T v; \
+    memcpy(&v, a, sizeof(T)); \
+    a += sizeof(T); \
+    if (nStars == 0) len = snprintf(msg + k, n - k, spec, v); \
+    else if (nStars == 1) len = snprintf(msg + k, n - k, spec, star[0], v); \
+    else len = snprintf(msg + k, n - k, spec, star[0], star[1], v); \
+}
+
+// Format the message whose format and arguments were copied to a
+// by putArgs into msg of size n, truncated if too long
+static void formatRecord(const char* a, char* msg, int n) {
+    const char* f = a;
+    int k = 0;
+    a += strlen(f) + 1;
+    while (*f && k < n - 1) {
+        ArgType type;
+        int i, len = 0, nStars, star[2] = {0, 0};
+        char spec[MAX_SPEC_SIZE];
+        const char* start = f;
+        if (*f != '%') {
+            // copy up to the next '%'
+            const char* percent = strchr(f, '%');
+            len = percent ? percent - f : (int)strlen(f);
+            if (len > n - 1 - k) len = n - 1 - k;
+            memcpy(msg + k, f, len);
+            k += len;
+            f += len;
+            continue;
+        }
+        f = parseSpec(f + 1, &type, &nStars);
+        if (f - start >= MAX_SPEC_SIZE) break; // rejected by putArgs
+        memcpy(spec, start, f - start);
+        spec[f - start] = '\0';
+        for (i=0; i<nStars; i++) {
+            memcpy(&star[i], a, sizeof(int));
+            a += sizeof(int);
+        }
+        switch (type) {
+            case argNone:       msg[k] = '%'; len = 1; break;
+            case argInt:        PRINT_ARG(int); break;
+            case argLong:       PRINT_ARG(long); break;
+            case argLongLong:   PRINT_ARG(long long); break;
+            case argSize:       PRINT_ARG(size_t); break;
+            case argDouble:     PRINT_ARG(double); break;
+            case argLongDouble: PRINT_ARG(long double); break;
+            case argPointer:    PRINT_ARG(void*); break;
+            case argString: {
+                const char* v = a;
+                a += strlen(a) + 1;
+                if (nStars == 0) len = snprintf(msg + k, n - k, spec, v);
+                else if (nStars == 1) len = snprintf(msg + k, n - k, spec, star[0], v);
+                else len = snprintf(msg + k, n - k, spec, star[0], star[1], v);
+                break;
+            }
+            default: break;
+        }
+        if (len < 0 || len > n - 1 - k) len = n - 1 - k; // truncated
+        k += len;
+    }
+    msg[k] = '\0';
+}
+
+// Returns pos advanced by n, wrapping around without overflow
+static long advance(long pos, long n) {
+    return (long)((unsigned long)pos + (unsigned long)n);
+}
+
+// copy at most n-1 chars of s to p, returns the end of the copy
+static char* putTruncated(char* p, const char* s, size_t n) {
+    size_t len = strlen(s);
+    if (len > n - 1) len = n - 1;
+    memcpy(p, s, len);
+    p[len] = '\0';
+    return p + len + 1;
+}
+
+// Copy a message to the buffer. Waits if the buffer is full.
+static void putMessage(const char* instanceName, fmiStatus status, 
+        const char* category, const char* format, va_list args) {
+    LogSlot* slot;
+    LogRecord* r;
+    char *p, *q, *end;
+    va_list copy;
+    long pos = atomicLoad(&tail.value);
+
+    // claim the slot at tail
+    for (;;) {
+        long diff;
+        slot = &slots[pos & (capacity - 1)];
+        diff = advance(atomicLoad(&slot->sequence), -pos);
+        if (diff == 0) {
+            if (atomicCompareExchange(&tail.value, pos, advance(pos, 1))) break;
+        }
+        else if (diff < 0) threadYield(); // full, wait for the oldest message to be printed
+        pos = atomicLoad(&tail.value);
+    }
+
+    // fill it with format and arguments, or the formatted message
+    // if they do not fit or the format is not supported
+    r = &slot->record;
+    r->status = status;
+    end = r->data + RECORD_SIZE;
+    p = putTruncated(r->data, instanceName, RECORD_SIZE / 4);
+    p = putTruncated(p, category, RECORD_SIZE / 4);
+    va_copy(copy, args);
+    q = putArgs(p, end, format, copy);
+    va_end(copy);
+    r->formatted = q == NULL;
+    if (r->formatted) {
+        vsnprintf(p, end - p, format, args);
+        end[-1] = '\0';
+    }
+    atomicStore(&slot->sequence, advance(pos, 1));
+}
+
+// Print the buffered messages up to the current tail. If a message is still
+// being copied, waits for it if wait is 1, or stops otherwise. 
+// Must be called with mutex locked. Returns the number of printed messages.
+static int printMessages(int wait) {
+    int n = 0;
+    long end = atomicLoad(&tail.value);
+    while (head.value != end) {
+        LogSlot* slot = &slots[head.value & (capacity - 1)];
+        LogRecord* r = &slot->record;
+        const char *instanceName, *category, *rest;
+        if (atomicLoad(&slot->sequence) != advance(head.value, 1)) {
+            if (!wait) break;
+            threadYield();
+            continue;
+        }
+        instanceName = r->data;
+        category = instanceName + strlen(instanceName) + 1;
+        rest = category + strlen(category) + 1;
+        if (r->formatted) printMessage(instanceName, (fmiStatus)r->status, category, rest);
+        else {
+            char msg[MAX_MSG_SIZE];
+            formatRecord(rest, msg, MAX_MSG_SIZE);
+            printMessage(instanceName, (fmiStatus)r->status, category, msg);
+        }
+        atomicStore(&slot->sequence, advance(head.value, capacity));
+        head.value = advance(head.value, 1);
+        n++;
+    }
+    return n;
+}
+
+static void printerThread(void* arg) {
+    (void)arg;
+    for (;;) {
+        int n, stop;
+        mutexLock(&mutex);
+        n = printMessages(0);
+        stop = closing;
+        mutexUnlock(&mutex);
+        if (stop) return;
+        if (n == 0) threadSleep(1);
+    }
+}
+
+// Set the filters and start the printing thread if messages are buffered.
+// Call before any other function of the logger. Returns 0 to indicate failure.
+int initLogger(LoggerOptions* o) {
+    long i;
+    options = *o;
+    mutexInit(&mutex);
+    initialized = 1;
+    if (options.bufferSize <= 0) return 1;
+    for (capacity=1; capacity<options.bufferSize; capacity*=2);
+    slots = (LogSlot*)calloc(capacity, sizeof(LogSlot));
+    if (!slots) {
+        printf("error: out of memory\n");
+        return 0;
+    }
+    for (i=0; i<capacity; i++) slots[i].sequence = i;
+    head.value = tail.value = 0;
+    closing = 0;
+    if (!threadCreate(&thread, printerThread, NULL)) {
+        printf("error: Could not start the logger thread\n");
+        free(slots);
+        slots = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+// Print all buffered messages
+void flushLogger(void) {
+    if (!slots) return;
+    mutexLock(&mutex);
+    printMessages(1);
+    mutexUnlock(&mutex);
+}
+
+// Print all buffered messages and stop the printing thread
+void closeLogger(void) {
+    if (slots) {
+        mutexLock(&mutex);
+        closing = 1;
+        mutexUnlock(&mutex);
+        threadJoin(thread);
+        printMessages(1);
+        free(slots);
+        slots = NULL;
+    }
+    if (initialized) {
+        mutexDestroy(&mutex);
+        initialized = 0;
+    }
+}
+
+// Log a message of an FMU. Messages that pass the filters are printed
+// with references like #r12# replaced by variable names, or buffered.
+void fmuLogger(fmiComponent c, fmiString instanceName, fmiStatus status, 
+        fmiString category, fmiString message, ...) {
+    va_list args;
+    int i;
+    (void)c;
+    if (status < options.minStatus) return;
+    if (!instanceName) instanceName = "?";
+    if (!category) category = "?";
+    if (options.nCategories > 0) {
+        for (i=0; i<options.nCategories; i++) {
+            if (!strcmp(category, options.categories[i])) break;
+        }
+        if (i == options.nCategories) return;
+    }
+    va_start(args, message);
+    if (slots) putMessage(instanceName, status, category, message, args);
+    else {
+        char msg[MAX_MSG_SIZE];
+        vsnprintf(msg, MAX_MSG_SIZE, message, args);
+        msg[MAX_MSG_SIZE - 1] = '\0'; // not terminated by _vsnprintf if truncated
+        // the lock keeps instances from being registered during the lookup
+        if (initialized) mutexLock(&mutex);
+        printMessage(instanceName, status, category, msg);
+        if (initialized) mutexUnlock(&mutex);
+    }
+    va_end(args);
+}
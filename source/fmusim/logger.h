@@ -0,0 +1,28 @@
+/* -------------------------------------------------------------------------
+ * logger.h
+ * The logger called by FMUs, with filters and an optional buffer that
+ * defers formatting of the messages to a separate thread.
+ * -------------------------------------------------------------------------*/
+
+#ifndef logger_h
+#define logger_h
+
+#include "main.h"
+
+typedef struct {
+    fmiStatus minStatus;        // log only messages with this status or worse
+    const char** categories;    // if nCategories > 0, log only these categories
+    int nCategories;
+    int bufferSize;             // number of buffered messages, 0 to log directly
+} LoggerOptions;
+
+int initLogger(LoggerOptions* options);
+void flushLogger(void);
+void closeLogger(void);
+void fmuLogger(fmiComponent c, fmiString instanceName, fmiStatus status, 
+        fmiString category, fmiString message, ...);
+int registerLoggerInstance(const char* instanceName, FMU* fmu);
+void unregisterLoggerInstance(const char* instanceName);
+int parseStatus(const char* name, fmiStatus* status);
+
+#endif // logger_h
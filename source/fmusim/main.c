@@ -1,9 +1,9 @@
 /* ------------------------------------------------------------------------- 
  * main.c
  * Implements simulation of a single FMU instance using the forward Euler
- * method for numerical integration.
+ * method or one of the solvers in solver.c for numerical integration.
  * Command syntax: see printHelp()
- * Simulates the given FMU from t = 0 .. tEnd with fixed step size h and 
+ * Simulates the given FMU from t = 0 .. tEnd with step size h and 
  * writes the computed solution to file 'result.csv'.
  * The CSV file (comma-separated values) may e.g. be plotted using 
  * OpenOffice Calc or Microsoft Excel. 
@@ -15,7 +15,6 @@
  * All this is missing here.
  * Free libraries and tools used to implement this simulator:
  *  - eXpat 2.0.1 XML parser, see http://expat.sourceforge.net
- *  - 7z.exe 4.57 zip and unzip tool, see http://www.7-zip.org
  * Copyright 2010 QTronic GmbH. All rights reserved. 
  * -------------------------------------------------------------------------
  */
@@ -24,24 +23,23 @@
 #include <stdio.h>
 #include <string.h>
 #include "main.h"
+#include "fmuzip.h"
+#include "fmuinit.h"
+#include "fmusim.h"
+#include "mdcache.h"
+#include "ensemble.h"
+#include "fmuthread.h"
+#include "profile.h"
 
 #ifndef _MSC_VER
 #include <sys/stat.h>
 #endif
 
-#define XML_FILE  "modelDescription.xml"
-#if WINDOWS
-#define DLL_DIR   "binaries\\win32\\"
-#define DLL_SUFFIX ".dll"
-#else
-#define DLL_DIR   "binaries/linux32/"
-#define DLL_SUFFIX ".so"
+#if !WINDOWS
 #include <unistd.h>
 #endif
 #define BUFSIZE 4096
 
-FMU fmu; // the fmu to simulate
-
 #ifdef _MSC_VER
 // fmuFileName is an absolute path, e.g. "C:\test\a.fmu"
 // or relative to the current dir, e.g. "..\test\a.fmu"
@@ -71,117 +69,440 @@ static char* getFmuPath(const char* fmuFileName){
   return strdup(fmuFileName);
 }
 static char* getTmpPath() {
-  char *tmp = mkdtemp(strdup("fmuTmpXXXXXX"));
-  if (tmp==NULL) {
+  char *tmp = calloc(sizeof(char), strlen("fmuTmpXXXXXX/") + 1);
+  strcpy(tmp, "fmuTmpXXXXXX");
+  if (mkdtemp(tmp)==NULL) {
     fprintf(stderr, "Couldn't create temporary directory\n");
     exit(1);
   }
-  /* return strdup(tmp); */
   return strcat(tmp, "/");
 }
 #endif
 
 static void printHelp(const char* fmusim) {
-    printf("command syntax: %s <model.fmu> <tEnd> <h> <loggingOn> <csv separator>\n", fmusim);
+    printf("command syntax: %s [options] <model.fmu> <tEnd> <h> <loggingOn> <csv separator>\n", fmusim);
     printf("   <model.fmu> .... path to FMU, relative to current dir or absolute, required\n");
     printf("   <tEnd> ......... end  time of simulation, optional, defaults to 1.0 sec\n");
     printf("   <h> ............ step size of simulation, optional, defaults to 0.1 sec\n");
     printf("   <loggingOn> .... 1 to activate logging,   optional, defaults to 0\n");
     printf("   <csv separator>. column separator char in csv file, optional, defaults to ';'\n");
+    printf("options:\n");
+    printf("   -solver <name> . integrate with euler (forward Euler, default), rk4 (Runge-Kutta),\n");
+    printf("                    dopri5 (Dormand-Prince with step size control, h is the max step),\n");
+    printf("                    beuler (backward Euler) or trbdf2 (TR-BDF2 with step size control)\n");
+    printf("                    the implicit beuler and trbdf2 are suited for stiff models\n");
+    printf("   -sparsity <mode> Jacobian of beuler and trbdf2: dense, declared (default) to use\n");
+    printf("                    the DirectDependency of der(x) on states, or probe to also\n");
+    printf("                    find the nonzeros of undeclared rows at the start\n");
+    printf("   -rtol <tol> .... relative tolerance of dopri5, beuler and trbdf2, defaults to 1e-6\n");
+    printf("   -atol <tol> .... absolute tolerance of dopri5, beuler and trbdf2 relative to the\n");
+    printf("                    state nominals, defaults to 1e-6\n");
+    printf("   -memory ........ load the FMU from memory without extracting it (Linux only)\n");
+    printf("   -cache <dir> ... extract and parse the FMU once to <dir> and reuse it in later runs\n");
+    printf("   -binary ........ write the binary file 'result.bin' instead of 'result.csv'\n");
+    printf("   -async <rows> .. write the result in a separate thread, buffering up to <rows> rows\n");
+    printf("   -drop .......... with -async, drop rows when the buffer is full instead of waiting\n");
+    printf("   -interval <dt> . output at t=0, dt, 2*dt, ... and tEnd instead of after every step\n");
+    printf("   -events ........ also output the values before and after each event\n");
+    printf("   -ensemble <file> simulate once for each set of start values in the CSV file, which\n");
+    printf("                    has variable names in the first line, and writes 'result_<n>.csv'\n");
+    printf("   -threads <n> ... with -ensemble, simulate on n threads, defaults to the number of cores\n");
+    printf("   -slice <dt> .... with -ensemble, simulate in slices of dt, so that idle threads can\n");
+    printf("                    take over the sets queued behind long runs\n");
+    printf("   -logstatus <s> . log only messages with status s or worse: ok, warning, discard,\n");
+    printf("                    error or fatal\n");
+    printf("   -logcategory <c> log only messages of category c, may be repeated\n");
+    printf("   -logbuffer <n> . format log messages in a separate thread, buffering up to n messages\n");
+    printf("   -profile ....... print call counts and times of the FMI functions with the summary\n");
+    printf("   -profilejson <file> write call counts, times and latency histograms of the\n");
+    printf("                    FMI functions as JSON to file, implies -profile\n");
+    printf("   -record <var> .. output only variables matching <var>, which is a name,\n");
+    printf("                    a pattern with * and ?, a /regular expression/, or @file\n");
+    printf("                    to read one of these per line from file, may be repeated\n");
 }
 
-int main(int argc, char *argv[]) {
-    const char* fmuFileName;
-    char* fmuPath;
+// Add a filter for -record to output. If arg starts with '@', the filters
+// are read from the named file instead, one per line. Empty lines and 
+// lines starting with '#' are ignored. Returns 0 to indicate failure.
+static int addFilters(OutputOptions* output, const char* arg) {
+    char line[BUFSIZE];
+    FILE* file;
+    if (arg[0]!='@') {
+        output->filters = (const char**)realloc((void*)output->filters, 
+                (output->nFilters + 1) * sizeof(char*));
+        if (!output->filters) return 0;
+        output->filters[output->nFilters++] = strdup(arg);
+        return output->filters[output->nFilters - 1] != NULL;
+    }
+    file = fopen(arg + 1, "r");
+    if (!file) {
+        printf("error: Could not open '%s'\n", arg + 1);
+        return 0;
+    }
+    while (fgets(line, BUFSIZE, file)) {
+        size_t n = strlen(line);
+        while (n>0 && (line[n-1]=='\n' || line[n-1]=='\r' || line[n-1]==' ' || line[n-1]=='\t')) 
+            line[--n] = '\0';
+        if (n==0 || line[0]=='#') continue;
+        if (!addFilters(output, line[0]=='@' ? line + 1 : line)) {
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+// Unzip the FMU to a new temporary directory, or to cacheDir if not NULL,
+// parse the model description and load the dll from there. Returns the 
+// directory, or NULL to indicate failure. A temporary directory must be
+// removed after simulation, a directory in the cache is kept for reuse,
+// together with the binary form of the parsed model description.
+static char* loadFmuFromDisk(const char* fmuPath, const char* cacheDir, FMU* fmu) {
     char* tmpPath;
     char* xmlPath;
     char* dllPath;
-    char* cmd;
+    int ok;
+
+    // unzip the FMU to the tmpPath directory
+    if (cacheDir) {
+        tmpPath = fmuUnzipCached(fmuPath, cacheDir);
+        if (!tmpPath) return NULL;
+    }
+    else {
+        tmpPath = getTmpPath();
+        if (!fmuUnzip(fmuPath, tmpPath)) return NULL;
+    }
+
+    // parse tmpPath\modelDescription.xml
+    xmlPath = calloc(sizeof(char), strlen(tmpPath) + strlen(XML_FILE) + 1);
+    sprintf(xmlPath, "%s%s", tmpPath, XML_FILE);
+    if (cacheDir) {
+        char* binPath = calloc(sizeof(char), strlen(tmpPath) + strlen(XML_CACHE_FILE) + 1);
+        sprintf(binPath, "%s%s", tmpPath, XML_CACHE_FILE);
+        fmu->modelDescription = parseCached(xmlPath, binPath);
+        free(binPath);
+    }
+    else fmu->modelDescription = parse(xmlPath);
+    free(xmlPath);
+    if (!fmu->modelDescription) return NULL;
+
+    // load the FMU dll
+    dllPath = calloc(sizeof(char), strlen(tmpPath) + strlen(DLL_DIR) 
+            + strlen( getModelIdentifier(fmu->modelDescription)) +  strlen(DLL_SUFFIX) + 1);
+    sprintf(dllPath,"%s%s%s%s", tmpPath, DLL_DIR, getModelIdentifier(fmu->modelDescription), DLL_SUFFIX);
+    ok = fmuLoadDll(dllPath, fmu);
+    free(dllPath);
+    return ok ? tmpPath : NULL;
+}
+
+// Decompress the model description and the dll directly from the FMU
+// into memory, parse the model description from there and load the dll 
+// from an anonymous memory file. Returns 0 to indicate failure.
+static int loadFmuFromMemory(const char* fmuPath, FMU* fmu) {
+    ZipArchive* zip;
+    ZipEntry* entry;
+    unsigned char* data;
+    char* dllName;
+    int ok;
+
+    zip = zipOpen(fmuPath);
+    if (!zip) return 0;
+
+    // parse modelDescription.xml
+    entry = zipFind(zip, XML_FILE);
+    if (!entry) {
+        printf("error: No %s in '%s'\n", XML_FILE, fmuPath);
+        zipClose(zip);
+        return 0;
+    }
+    data = zipRead(zip, entry);
+    if (!data) {
+        zipClose(zip);
+        return 0;
+    }
+    fmu->modelDescription = parseBuffer((const char*)data, entry->size, XML_FILE);
+    free(data);
+    if (!fmu->modelDescription) {
+        zipClose(zip);
+        return 0;
+    }
+
+    // load the FMU dll
+    dllName = calloc(sizeof(char), strlen(ZIP_DLL_DIR) 
+            + strlen(getModelIdentifier(fmu->modelDescription)) + strlen(DLL_SUFFIX) + 1);
+    sprintf(dllName, "%s%s%s", ZIP_DLL_DIR, getModelIdentifier(fmu->modelDescription), DLL_SUFFIX);
+    entry = zipFind(zip, dllName);
+    if (!entry) {
+        printf("error: No %s in '%s'\n", dllName, fmuPath);
+        free(dllName);
+        zipClose(zip);
+        return 0;
+    }
+    data = zipRead(zip, entry);
+    ok = data && fmuLoadDllFromMemory(data, entry->size, dllName, fmu);
+    free(data);
+    free(dllName);
+    zipClose(zip);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const char* fmuFileName;
+    char* fmuPath;
+    char* tmpPath = NULL;
+    int arg = 1; // index of the first positional argument
     
     // define default argument values
     double tEnd = 1.0;
     double h=0.1;
     int loggingOn = 0;
-    char csv_separator = ';';
+    int loadFromMemory = 0;
+    const char* cacheDir = NULL;
+    const char* tablePath = NULL;
+    int nThreads = 0;
+    double slice = 0;
+    LoggerOptions logger;
+    int profile = 0;
+    const char* profilePath = NULL;
+    FMU fmu; // the fmu to simulate
+    ParameterTable* table = NULL;
+    int ok;
+    OutputOptions output;
+    SolverOptions solver;
+
+    solver.method = eulerSolver;
+    solver.sparsity = declaredSparsity;
+    solver.relTol = 1e-6;
+    solver.absTol = 1e-6;
+    output.format = csvFormat;
+    output.separator = ';';
+    output.bufferRows = 0;
+    output.dropRows = 0;
+    output.interval = 0;
+    output.eventRows = 0;
+    output.filters = NULL;
+    output.nFilters = 0;
+    logger.minStatus = fmiOK;
+    logger.categories = NULL;
+    logger.nCategories = 0;
+    logger.bufferSize = 0;
+
+    // parse command line options
+    while (arg<argc && argv[arg][0]=='-') {
+        if (!strcmp(argv[arg], "-memory")) {
+            loadFromMemory = 1;
+        }
+        else if (!strcmp(argv[arg], "-cache") && arg+1<argc) {
+            cacheDir = argv[++arg];
+        }
+        else if (!strcmp(argv[arg], "-binary")) {
+            output.format = binaryFormat;
+        }
+        else if (!strcmp(argv[arg], "-async") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%d", &output.bufferRows) != 1 || output.bufferRows<1) {
+                printf("error: The given number of rows (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-drop")) {
+            output.dropRows = 1;
+        }
+        else if (!strcmp(argv[arg], "-interval") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%lf", &output.interval) != 1 || output.interval<=0) {
+                printf("error: The given output interval (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-events")) {
+            output.eventRows = 1;
+        }
+        else if (!strcmp(argv[arg], "-solver") && arg+1<argc) {
+            if (!parseSolverMethod(argv[++arg], &solver.method)) {
+                printf("error: Unknown solver %s\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-sparsity") && arg+1<argc) {
+            arg++;
+            if (!strcmp(argv[arg], "dense")) solver.sparsity = denseSparsity;
+            else if (!strcmp(argv[arg], "declared")) solver.sparsity = declaredSparsity;
+            else if (!strcmp(argv[arg], "probe")) solver.sparsity = probedSparsity;
+            else {
+                printf("error: Unknown sparsity mode %s\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-rtol") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%lf", &solver.relTol) != 1 || solver.relTol<=0) {
+                printf("error: The given relative tolerance (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-atol") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%lf", &solver.absTol) != 1 || solver.absTol<=0) {
+                printf("error: The given absolute tolerance (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-ensemble") && arg+1<argc) {
+            tablePath = argv[++arg];
+        }
+        else if (!strcmp(argv[arg], "-threads") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%d", &nThreads) != 1 || nThreads<1) {
+                printf("error: The given number of threads (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-slice") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%lf", &slice) != 1 || slice<=0) {
+                printf("error: The given slice (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-logstatus") && arg+1<argc) {
+            if (!parseStatus(argv[++arg], &logger.minStatus)) {
+                printf("error: Unknown status %s\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-logcategory") && arg+1<argc) {
+            logger.categories = (const char**)realloc((void*)logger.categories, 
+                    (logger.nCategories + 1) * sizeof(char*));
+            if (!logger.categories) {
+                printf("error: out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+            logger.categories[logger.nCategories++] = argv[++arg];
+        }
+        else if (!strcmp(argv[arg], "-logbuffer") && arg+1<argc) {
+            if (sscanf(argv[++arg], "%d", &logger.bufferSize) != 1 || logger.bufferSize<1) {
+                printf("error: The given buffer size (%s) is not a positive number\n", argv[arg]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (!strcmp(argv[arg], "-profile")) {
+            profile = 1;
+        }
+        else if (!strcmp(argv[arg], "-profilejson") && arg+1<argc) {
+            profile = 1;
+            profilePath = argv[++arg];
+        }
+        else if (!strcmp(argv[arg], "-record") && arg+1<argc) {
+            if (!addFilters(&output, argv[++arg])) exit(EXIT_FAILURE);
+        }
+        else {
+            printf("error: Unknown option %s\n", argv[arg]);
+            printHelp(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        arg++;
+    }
 
     // parse command line arguments
-    if (argc>1) {
-        fmuFileName = argv[1];
+    if (argc>arg) {
+        fmuFileName = argv[arg];
     }
     else {
         printf("error: no fmu file\n");
         printHelp(argv[0]);
         exit(EXIT_FAILURE);
     }
-    if (argc>2) {
-        if (sscanf(argv[2],"%lf", &tEnd) != 1) {
-            printf("error: The given end time (%s) is not a number\n", argv[2]);
+    if (argc>arg+1) {
+        if (sscanf(argv[arg+1],"%lf", &tEnd) != 1) {
+            printf("error: The given end time (%s) is not a number\n", argv[arg+1]);
             exit(EXIT_FAILURE);
         }
     }
-    if (argc>3) {
-        if (sscanf(argv[3],"%lf", &h) != 1) {
-            printf("error: The given stepsize (%s) is not a number\n", argv[3]);
+    if (argc>arg+2) {
+        if (sscanf(argv[arg+2],"%lf", &h) != 1) {
+            printf("error: The given stepsize (%s) is not a number\n", argv[arg+2]);
             exit(EXIT_FAILURE);
         }
     }
-    if (argc>4) {
-        if (sscanf(argv[4],"%d", &loggingOn) != 1 || loggingOn<0 || loggingOn>1) {
-            printf("error: The given logging flag (%s) is not boolean\n", argv[4]);
+    if (argc>arg+3) {
+        if (sscanf(argv[arg+3],"%d", &loggingOn) != 1 || loggingOn<0 || loggingOn>1) {
+            printf("error: The given logging flag (%s) is not boolean\n", argv[arg+3]);
             exit(EXIT_FAILURE);
         }
     }
-    if (argc>5) {
-        if (strlen(argv[5]) != 1) {
-            printf("error: The given CSV separator char (%s) is not valid\n", argv[5]);
+    if (argc>arg+4) {
+        if (strlen(argv[arg+4]) != 1) {
+            printf("error: The given CSV separator char (%s) is not valid\n", argv[arg+4]);
             exit(EXIT_FAILURE);
         }
-        csv_separator = argv[5][0];
+        output.separator = argv[arg+4][0];
     }
-    if (argc>6) {
-        printf("warning: Ignoring %d additional arguments: %s ...\n", argc-6, argv[6]);
+    if (argc>arg+5) {
+        printf("warning: Ignoring %d additional arguments: %s ...\n", argc-arg-5, argv[arg+5]);
         printHelp(argv[0]);
     }
 
+    if (output.dropRows && !output.bufferRows) {
+        printf("error: Option -drop requires -async\n");
+        exit(EXIT_FAILURE);
+    }
+    if (nThreads && !tablePath) {
+        printf("error: Option -threads requires -ensemble\n");
+        exit(EXIT_FAILURE);
+    }
+    if (slice && !tablePath) {
+        printf("error: Option -slice requires -ensemble\n");
+        exit(EXIT_FAILURE);
+    }
+    if (loadFromMemory && cacheDir) {
+        printf("error: Options -memory and -cache cannot be combined\n");
+        exit(EXIT_FAILURE);
+    }
+
     // get absolute path to FMU, NULL if not found
     fmuPath = getFmuPath(fmuFileName);
     if (!fmuPath) exit(EXIT_FAILURE);
 
-    // unzip the FMU to the tmpPath directory
-    tmpPath = getTmpPath();
-    if (!fmuUnzip(fmuPath, tmpPath)) exit(EXIT_FAILURE);
-
-    // parse tmpPath\modelDescription.xml
-    xmlPath = calloc(sizeof(char), strlen(tmpPath) + strlen(XML_FILE) + 1);
-    sprintf(xmlPath, "%s%s", tmpPath, XML_FILE);
-    fmu.modelDescription = parse(xmlPath);
-    free(xmlPath);
-    if (!fmu.modelDescription) exit(EXIT_FAILURE);
-
-    // load the FMU dll
-    dllPath = calloc(sizeof(char), strlen(tmpPath) + strlen(DLL_DIR) 
-            + strlen( getModelIdentifier(fmu.modelDescription)) +  strlen(DLL_SUFFIX) + 1);
-    sprintf(dllPath,"%s%s%s%s", tmpPath, DLL_DIR, getModelIdentifier(fmu.modelDescription), DLL_SUFFIX);
-    if (!fmuLoadDll(dllPath, &fmu)) exit(EXIT_FAILURE); 
-    free(dllPath);
+    // load model description and dll of the FMU
+    if (loadFromMemory) {
+        if (!loadFmuFromMemory(fmuPath, &fmu)) exit(EXIT_FAILURE);
+    }
+    else {
+        tmpPath = loadFmuFromDisk(fmuPath, cacheDir, &fmu);
+        if (!tmpPath) exit(EXIT_FAILURE);
+    }
     free(fmuPath);
+    if (!initLogger(&logger)) exit(EXIT_FAILURE);
+    if (profile && !profileFmu(&fmu)) exit(EXIT_FAILURE);
 
     // run the simulation
     printf("FMU Simulator: run '%s' from t=0..%g with step size h=%g, loggingOn=%d, csv separator='%c'\n", 
-            fmuFileName, tEnd, h, loggingOn, csv_separator);
-    fmuSimulate(&fmu, tEnd, h, loggingOn, csv_separator);
+            fmuFileName, tEnd, h, loggingOn, output.separator);
+    if (tablePath) {
+        SimulationOptions options;
+        options.tEnd = tEnd;
+        options.h = h;
+        options.loggingOn = loggingOn;
+        options.solver = &solver;
+        options.output = &output;
+        table = readParameterTable(fmu.modelDescription, tablePath, output.separator);
+        ok = table && runEnsemble(&fmu, &options, table, 
+                nThreads ? nThreads : processorCount(), slice);
+        freeParameterTable(table);
+    }
+    else ok = fmuSimulate(&fmu, tEnd, h, loggingOn, &solver, &output);
+    closeLogger();
+    if (profilePath && !writeProfileJson(profilePath)) ok = 0;
+    freeProfile();
 
-#if WINDOWS
-    /* Remove temp file directory? */
-#else
-    cmd = calloc(sizeof(char), strlen(tmpPath)+8);
-    sprintf(cmd, "rm -rf %s", tmpPath);
-    printf("Removing %s\n", tmpPath);
-    system(cmd);
-#endif
-    free(tmpPath);
+    if (tmpPath) {
+        if (!cacheDir) {
+            printf("Removing %s\n", tmpPath);
+            if (!fmuRemoveDir(tmpPath)) printf("warning: Could not remove %s\n", tmpPath);
+        }
+        free(tmpPath);
+    }
 
     // release FMU 
     fmuFree(&fmu);
-    return EXIT_SUCCESS;
+    while (output.nFilters > 0) free((void*)output.filters[--output.nFilters]);
+    free((void*)output.filters);
+    free((void*)logger.categories);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -19,6 +19,19 @@
 #include "fmiModelFunctions.h"
 #include "xml_parser.h"
 
+// location of the model description and the binaries within an FMU
+#define XML_FILE  "modelDescription.xml"
+#define XML_CACHE_FILE "modelDescription.bin" // parsed XML_FILE, see mdcache.c
+#if WINDOWS
+#define DLL_DIR   "binaries\\win32\\"
+#define ZIP_DLL_DIR "binaries/win32/" // DLL_DIR as stored in the zip archive
+#define DLL_SUFFIX ".dll"
+#else
+#define DLL_DIR   "binaries/linux32/"
+#define ZIP_DLL_DIR DLL_DIR
+#define DLL_SUFFIX ".so"
+#endif
+
 typedef const char* (*fGetModelTypesPlatform)();
 typedef const char* (*fGetVersion)();
 typedef fmiComponent (*fInstantiateModel)(fmiString instanceName, fmiString GUID,
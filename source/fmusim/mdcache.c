@@ -0,0 +1,575 @@
+/* -------------------------------------------------------------------------
+ * mdcache.c
+ * Writes a parsed model description to a compact binary file and loads
+ * it back by mapping the file into memory. Loading needs no XML parsing,
+ * no string interning and no number conversion: the AST is rebuilt in one
+ * arena from the words of the file, the strings are copied with a single
+ * memcpy and only the hash index is computed again.
+ * A binary file is used only if it was written from an XML file of the
+ * same size and CRC-32, and by the same version of this code. Any change
+ * of the XML file, for example of the GUID, thus invalidates it.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "main.h"
+#include "fmuzip.h"
+#include "mdcache.h"
+
+#if WINDOWS
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MDC_MAX_DEPTH 8 // the deepest AST nesting is md, list, element, list, element
+
+// -------------------------------------------------------------------------
+// Writing
+
+// Output of the encoder: words and strings grow by doubling. A hash set
+// maps string pointers to references, so that strings interned by the
+// parser are written only once.
+typedef struct {
+    unsigned int* words;
+    size_t nWords, wordsSize;
+    char* strings;
+    size_t nStrings, stringsSize;
+    const char** keys;         // string pointers, open addressing
+    unsigned int* refs;        // references of keys
+    size_t tableSize, tableCount;
+    int failed;                // 1 if out of memory or the AST is invalid
+} Writer;
+
+static void writeWord(Writer* w, unsigned int x) {
+    if (w->nWords == w->wordsSize) {
+        size_t size = w->wordsSize ? 2 * w->wordsSize : 1024;
+        unsigned int* words = (unsigned int*)realloc(w->words, size * sizeof(unsigned int));
+        if (!words) {
+            w->failed = 1;
+            return;
+        }
+        w->words = words;
+        w->wordsSize = size;
+    }
+    w->words[w->nWords++] = x;
+}
+
+static void writeDouble(Writer* w, double x) {
+    unsigned int half[2];
+    memcpy(half, &x, sizeof(double));
+    writeWord(w, half[0]);
+    writeWord(w, half[1]);
+}
+
+static size_t hashPointer(const char* s) {
+    return ((size_t)s >> 3) * 2654435761u;
+}
+
+// Returns the reference of s, 0 for NULL
+static unsigned int stringRef(Writer* w, const char* s) {
+    size_t i, n, mask;
+    if (!s) return 0;
+    if (2 * (w->tableCount + 1) > w->tableSize) {
+        // grow and rehash the table of written strings
+        size_t size = w->tableSize ? 2 * w->tableSize : 1024;
+        const char** keys = (const char**)calloc(size, sizeof(char*));
+        unsigned int* refs = (unsigned int*)calloc(size, sizeof(unsigned int));
+        if (!keys || !refs) {
+            free((void*)keys);
+            free(refs);
+            w->failed = 1;
+            return 0;
+        }
+        for (i=0; i<w->tableSize; i++) {
+            if (!w->keys[i]) continue;
+            for (n=hashPointer(w->keys[i]) & (size-1); keys[n]; n=(n+1) & (size-1));
+            keys[n] = w->keys[i];
+            refs[n] = w->refs[i];
+        }
+        free((void*)w->keys);
+        free(w->refs);
+        w->keys = keys;
+        w->refs = refs;
+        w->tableSize = size;
+    }
+    mask = w->tableSize - 1;
+    for (i=hashPointer(s) & mask; w->keys[i]; i=(i+1) & mask)
+        if (w->keys[i] == s) return w->refs[i];
+    n = strlen(s) + 1;
+    if (w->nStrings + n > w->stringsSize) {
+        size_t size = 2 * (w->nStrings + n);
+        char* strings = (char*)realloc(w->strings, size);
+        if (!strings) {
+            w->failed = 1;
+            return 0;
+        }
+        w->strings = strings;
+        w->stringsSize = size;
+    }
+    memcpy(w->strings + w->nStrings, s, n);
+    w->keys[i] = s;
+    w->refs[i] = (unsigned int)w->nStrings + 1;
+    w->tableCount++;
+    w->nStrings += n;
+    return w->refs[i];
+}
+
+// Returns the index of the attribute name in attNames, or -1
+static int attIndex(const char* name) {
+    int a;
+    for (a=0; a<SIZEOF_ATT; a++)
+        if (attNames[a] == name) return a; // names are replaced by attNames
+    for (a=0; a<SIZEOF_ATT; a++)
+        if (!strcmp(attNames[a], name)) return a;
+    return -1;
+}
+
+static void writeNode(Writer* w, void* element);
+
+// A list is written as its length + 1, 0 for NULL, followed by its elements
+static void writeList(Writer* w, void** list) {
+    unsigned int i, n = 0;
+    if (!list) {
+        writeWord(w, 0);
+        return;
+    }
+    while (list[n]) n++;
+    writeWord(w, n + 1);
+    for (i=0; i<n; i++) writeNode(w, list[i]);
+}
+
+// An optional element is written as 0 for NULL, or 1 followed by the element
+static void writeOptional(Writer* w, void* element) {
+    writeWord(w, element ? 1 : 0);
+    if (element) writeNode(w, element);
+}
+
+// A node is written as its type, the number of attribute words,
+// the attributes as pairs of attribute index and string reference,
+// followed by the fields that depend on the type of the node
+static void writeNode(Writer* w, void* element) {
+    Element* e = (Element*)element;
+    int i;
+    writeWord(w, e->type);
+    writeWord(w, e->n);
+    for (i=0; i<e->n; i+=2) {
+        int a = attIndex(e->attributes[i]);
+        if (a < 0) w->failed = 1;
+        writeWord(w, a);
+        writeWord(w, stringRef(w, e->attributes[i+1]));
+    }
+    switch (getAstNodeType(e->type)) {
+        case astElement:
+            break;
+        case astListElement:
+            writeList(w, (void**)((ListElement*)e)->list);
+            break;
+        case astType:
+            writeOptional(w, ((Type*)e)->typeSpec);
+            break;
+        case astScalarVariable: {
+            ScalarVariable* sv = (ScalarVariable*)e;
+            if (!sv->decoded) w->failed = 1;
+            writeOptional(w, sv->typeSpec);
+            writeList(w, (void**)sv->directDependencies);
+            writeWord(w, sv->vr);
+            writeWord(w, sv->causality);
+            writeWord(w, sv->variability);
+            writeWord(w, sv->alias);
+            writeWord(w, sv->baseType);
+            writeWord(w, sv->defined);
+            writeDouble(w, sv->start);
+            writeDouble(w, sv->nominal);
+            writeDouble(w, sv->min);
+            writeDouble(w, sv->max);
+            break;
+        }
+        case astModelDescription: {
+            ModelDescription* md = (ModelDescription*)e;
+            writeList(w, (void**)md->unitDefinitions);
+            writeList(w, (void**)md->typeDefinitions);
+            writeOptional(w, md->defaultExperiment);
+            writeList(w, (void**)md->vendorAnnotations);
+            writeList(w, (void**)md->modelVariables);
+            break;
+        }
+    }
+}
+
+// Create a new file next to path, named path.XXXXXX, for writing
+static FILE* createTmpFile(char* path) {
+#if WINDOWS
+    if (!_mktemp(path)) return NULL;
+    return fopen(path, "wb");
+#else
+    FILE* file;
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    file = fdopen(fd, "wb");
+    if (!file) close(fd);
+    return file;
+#endif
+}
+
+// Write the binary form of md to binPath. The file is written to a private
+// file first, which is then renamed, so that concurrent runs never see a
+// partially written file. xmlSize and xmlCrc identify the XML file of md.
+// Returns 0 to indicate failure.
+int writeModelDescriptionCache(ModelDescription* md, const char* binPath,
+        unsigned int xmlSize, unsigned int xmlCrc) {
+    Writer w;
+    MdcHeader header;
+    unsigned char* data = NULL;
+    size_t n = 0;
+    char* tmpPath = NULL;
+    FILE* file = NULL;
+    int ok = 0;
+
+    memset(&w, 0, sizeof(Writer));
+    header.magic = MDC_MAGIC;
+    header.version = MDC_VERSION;
+    header.xmlSize = xmlSize;
+    header.xmlCrc = xmlCrc;
+    header.guid = stringRef(&w, getString(md, att_guid));
+    writeNode(&w, md);
+    if (w.failed) goto done;
+    header.nWords = (unsigned int)w.nWords;
+    header.nStrings = (unsigned int)w.nStrings;
+
+    // header, words and strings are written with a single fwrite
+    n = sizeof(MdcHeader) + w.nWords * sizeof(unsigned int) + w.nStrings;
+    data = (unsigned char*)malloc(n);
+    tmpPath = (char*)calloc(sizeof(char), strlen(binPath) + 8);
+    if (!data || !tmpPath) goto done;
+    memcpy(data + sizeof(MdcHeader), w.words, w.nWords * sizeof(unsigned int));
+    memcpy(data + sizeof(MdcHeader) + w.nWords * sizeof(unsigned int), w.strings, w.nStrings);
+    header.crc = zipCrc32(data + sizeof(MdcHeader), n - sizeof(MdcHeader));
+    memcpy(data, &header, sizeof(MdcHeader));
+
+    sprintf(tmpPath, "%s.XXXXXX", binPath);
+    file = createTmpFile(tmpPath);
+    if (!file) goto done;
+    ok = fwrite(data, 1, n, file) == n;
+    ok = !fclose(file) && ok;
+#if WINDOWS
+    ok = ok && MoveFileEx(tmpPath, binPath, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && !rename(tmpPath, binPath);
+#endif
+    if (!ok) remove(tmpPath);
+
+done:
+    free(w.words);
+    free(w.strings);
+    free((void*)w.keys);
+    free(w.refs);
+    free(data);
+    free(tmpPath);
+    return ok;
+}
+
+// -------------------------------------------------------------------------
+// Reading
+
+// Input of the decoder. Every read is checked against the bounds
+// of the file, and every node and enum value against the types the
+// parser produces at its place, so that a damaged file cannot cause
+// a crash.
+typedef struct {
+    const unsigned int* words;
+    size_t nWords, pos;
+    const char* strings;       // copy of the string table in the arena
+    size_t nStrings;
+    Arena* arena;              // holds the AST being built
+    int failed;                // 1 if the file is invalid or out of memory
+} Reader;
+
+static unsigned int readWord(Reader* r) {
+    if (r->pos >= r->nWords) {
+        r->failed = 1;
+        return 0;
+    }
+    return r->words[r->pos++];
+}
+
+static double readDouble(Reader* r) {
+    unsigned int half[2];
+    double x;
+    half[0] = readWord(r);
+    half[1] = readWord(r);
+    memcpy(&x, half, sizeof(double));
+    return x;
+}
+
+static const char* readString(Reader* r) {
+    unsigned int ref = readWord(r);
+    if (!ref) return NULL;
+    if (ref > r->nStrings) {
+        r->failed = 1;
+        return NULL;
+    }
+    return r->strings + ref - 1;
+}
+
+// Read an enum value in the range first..last
+static Enu readEnum(Reader* r, Enu first, Enu last) {
+    unsigned int e = readWord(r);
+    if (e < (unsigned int)first || e > (unsigned int)last) {
+        r->failed = 1;
+        return first;
+    }
+    return (Enu)e;
+}
+
+// Returns the type of the items of a list element of the given type,
+// as popped by the parser
+static Elm listItemType(Elm type) {
+    switch (type) {
+        case elm_UnitDefinitions:   return elm_BaseUnit;
+        case elm_BaseUnit:          return elm_DisplayUnitDefinition;
+        case elm_TypeDefinitions:   return elm_Type;
+        case elm_EnumerationType:   return elm_Item;
+        case elm_VendorAnnotations: return elm_Tool;
+        case elm_Tool:              return elm_Annotation;
+        case elm_ModelVariables:    return elm_ScalarVariable;
+        default:                    return elm_Name; // elm_DirectDependency
+    }
+}
+
+static void* readNode(Reader* r, int depth, Elm first, Elm last);
+
+// Read a list of nodes of the given type
+static void** readList(Reader* r, int depth, Elm type) {
+    unsigned int i, n = readWord(r);
+    void** list;
+    if (n-- == 0) return NULL;
+    if (n > (r->nWords - r->pos) / 2) { // each node takes at least 2 words
+        r->failed = 1;
+        return NULL;
+    }
+    list = (void**)arenaAlloc(r->arena, (n + 1) * sizeof(void*));
+    if (!list) r->failed = 1;
+    for (i=0; i<n && !r->failed; i++) list[i] = readNode(r, depth, type, type);
+    return list; // NULL-terminated, since arena memory is zeroed
+}
+
+static void* readOptional(Reader* r, int depth, Elm first, Elm last) {
+    return readWord(r) ? readNode(r, depth, first, last) : NULL;
+}
+
+// Read a node with a type in the range first..last
+// Returns NULL to indicate failure
+static void* readNode(Reader* r, int depth, Elm first, Elm last) {
+    static const size_t sizes[] = { sizeof(Element), sizeof(ListElement),
+            sizeof(Type), sizeof(ScalarVariable), sizeof(ModelDescription) };
+    Elm type = (Elm)readWord(r);
+    unsigned int i, n = readWord(r);
+    AstNodeType ast;
+    Element* e;
+    if (r->failed || type < first || type > last || depth > MDC_MAX_DEPTH
+            || n % 2 || n > r->nWords - r->pos) {
+        r->failed = 1;
+        return NULL;
+    }
+    ast = getAstNodeType(type);
+    e = (Element*)arenaAlloc(r->arena, sizes[ast]);
+    if (!e) {
+        r->failed = 1;
+        return NULL;
+    }
+    e->type = type;
+    e->n = n;
+    if (n > 0) {
+        e->attributes = (const char**)arenaAlloc(r->arena, n * sizeof(char*));
+        if (!e->attributes) {
+            r->failed = 1;
+            return NULL;
+        }
+    }
+    for (i=0; i<n; i+=2) {
+        unsigned int a = readWord(r);
+        if (a >= SIZEOF_ATT) r->failed = 1;
+        e->attributes[i] = r->failed ? NULL : attNames[a];
+        e->attributes[i+1] = readString(r);
+    }
+    switch (ast) {
+        case astElement:
+            break;
+        case astListElement:
+            ((ListElement*)e)->list = (Element**)readList(r, depth + 1, listItemType(type));
+            break;
+        case astType:
+            ((Type*)e)->typeSpec = (Element*)readOptional(r, depth + 1,
+                    elm_RealType, elm_EnumerationType);
+            break;
+        case astScalarVariable: {
+            ScalarVariable* sv = (ScalarVariable*)e;
+            sv->typeSpec = (Element*)readOptional(r, depth + 1, elm_Real, elm_Enumeration);
+            sv->directDependencies = (Element**)readList(r, depth + 1, elm_Name);
+            sv->vr = readWord(r);
+            sv->causality = readEnum(r, enu_input, enu_none);
+            sv->variability = readEnum(r, enu_constant, enu_continuous);
+            sv->alias = readEnum(r, enu_noAlias, enu_negatedAlias);
+            sv->baseType = (Elm)readWord(r);
+            if (sv->baseType < elm_Real || sv->baseType > elm_String) r->failed = 1;
+            sv->defined = readWord(r);
+            sv->start = readDouble(r);
+            sv->nominal = readDouble(r);
+            sv->min = readDouble(r);
+            sv->max = readDouble(r);
+            sv->decoded = 1;
+            break;
+        }
+        case astModelDescription: {
+            ModelDescription* md = (ModelDescription*)e;
+            md->unitDefinitions = (ListElement**)readList(r, depth + 1, elm_BaseUnit);
+            md->typeDefinitions = (Type**)readList(r, depth + 1, elm_Type);
+            md->defaultExperiment = (Element*)readOptional(r, depth + 1,
+                    elm_DefaultExperiment, elm_DefaultExperiment);
+            md->vendorAnnotations = (ListElement**)readList(r, depth + 1, elm_Tool);
+            md->modelVariables = (ScalarVariable**)readList(r, depth + 1, elm_ScalarVariable);
+            break;
+        }
+    }
+    return r->failed ? NULL : e;
+}
+
+// Map the file at path read-only into memory.
+// Returns NULL if the file does not exist or is empty.
+static const unsigned char* mapFile(const char* path, size_t* size) {
+#if WINDOWS
+    HANDLE file, mapping;
+    const unsigned char* data;
+    file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    *size = GetFileSize(file, NULL);
+    if (*size == 0 || *size == INVALID_FILE_SIZE) {
+        CloseHandle(file);
+        return NULL;
+    }
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return NULL;
+    data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // the view keeps the mapping alive
+    return data;
+#else
+    struct stat st;
+    void* data;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    *size = (size_t)st.st_size;
+    data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    return data == MAP_FAILED ? NULL : (const unsigned char*)data;
+#endif
+}
+
+static void unmapFile(const unsigned char* data, size_t size) {
+#if WINDOWS
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+// Load the model description from the binary file at binPath, if that was
+// written from an XML file with the given size and CRC-32. Returns NULL if
+// the file is missing, stale or damaged. Otherwise, the receiver must call
+// freeElement(md) to release AST memory.
+ModelDescription* readModelDescriptionCache(const char* binPath,
+        unsigned int xmlSize, unsigned int xmlCrc) {
+    MdcHeader header;
+    Reader r;
+    ModelDescription* md = NULL;
+    const char* guid;
+    size_t size;
+    const unsigned char* data = mapFile(binPath, &size);
+    if (!data) return NULL;
+
+    memset(&r, 0, sizeof(Reader));
+    if (size < sizeof(MdcHeader)) goto done;
+    memcpy(&header, data, sizeof(MdcHeader));
+    if (header.magic != MDC_MAGIC || header.version != MDC_VERSION
+            || header.xmlSize != xmlSize || header.xmlCrc != xmlCrc
+            || header.nWords > (size - sizeof(MdcHeader)) / sizeof(unsigned int)
+            || size != sizeof(MdcHeader) + header.nWords * sizeof(unsigned int) + header.nStrings
+            || header.nStrings == 0 || data[size - 1] != '\0'
+            || header.crc != zipCrc32(data + sizeof(MdcHeader), size - sizeof(MdcHeader)))
+        goto done; // stale or damaged
+
+    // the mapping is page aligned and the header has a multiple of 4 bytes
+    r.words = (const unsigned int*)(data + sizeof(MdcHeader));
+    r.nWords = header.nWords;
+    r.nStrings = header.nStrings;
+    r.arena = arenaNew(header.nStrings + 2 * header.nWords * sizeof(unsigned int));
+    if (!r.arena) goto done;
+    r.strings = (const char*)arenaAlloc(r.arena, r.nStrings);
+    if (!r.strings) goto done;
+    memcpy((char*)r.strings, r.words + r.nWords, r.nStrings);
+    guid = header.guid && header.guid <= r.nStrings ? r.strings + header.guid - 1 : NULL;
+    md = (ModelDescription*)readNode(&r, 0, elm_fmiModelDescription, elm_fmiModelDescription);
+    if (r.failed || r.pos != r.nWords
+            || !guid || !getString(md, att_guid) || strcmp(guid, getString(md, att_guid))) {
+        md = NULL;
+        goto done;
+    }
+    md->arena = r.arena; // the AST owns the arena from now on
+    r.arena = NULL;
+    if (!indexModelDescription(md)) {
+        freeElement(md);
+        md = NULL;
+    }
+
+done:
+    arenaFree(r.arena);
+    unmapFile(data, size);
+    return md;
+}
+
+// Parse the XML file at xmlPath, using the binary file at binPath as
+// a cache: if binPath holds the current content of xmlPath, it is loaded
+// instead. Otherwise xmlPath is parsed and binPath is (re)written.
+// Returns NULL to indicate failure. Otherwise, the receiver must call
+// freeElement(md) to release AST memory.
+ModelDescription* parseCached(const char* xmlPath, const char* binPath) {
+    ModelDescription* md;
+    unsigned char* xml;
+    unsigned int crc;
+    long n;
+    FILE* file = fopen(xmlPath, "rb");
+    if (!file) {
+        printf("Cannot open file '%s'\n", xmlPath);
+        return NULL; // failure
+    }
+    fseek(file, 0, SEEK_END);
+    n = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    xml = (unsigned char*)malloc(n > 0 ? n : 1);
+    if (n < 0 || !xml || fread(xml, 1, n, file) != (size_t)n) {
+        printf("error: Could not read file '%s'\n", xmlPath);
+        free(xml);
+        fclose(file);
+        return NULL; // failure
+    }
+    fclose(file);
+    crc = zipCrc32(xml, n);
+    md = readModelDescriptionCache(binPath, (unsigned int)n, crc);
+    if (!md) {
+        md = parseBuffer((const char*)xml, n, xmlPath);
+        if (md && !writeModelDescriptionCache(md, binPath, (unsigned int)n, crc))
+            printf("warning: Could not write '%s'\n", binPath);
+    }
+    free(xml);
+    return md;
+}
@@ -0,0 +1,36 @@
+/* -------------------------------------------------------------------------
+ * mdcache.h
+ * A compact binary form of a parsed and validated model description,
+ * that is loaded much faster than the XML file can be parsed.
+ * -------------------------------------------------------------------------*/
+
+#ifndef mdcache_h
+#define mdcache_h
+
+#include "xml_parser.h"
+
+#define MDC_MAGIC   0x42444d46 // "FMDB", also detects a different byte order
+#define MDC_VERSION 1          // increment whenever the layout changes
+
+// Start of a binary model description file. The header is followed by
+// nWords 32-bit words that encode the AST in preorder, followed by a
+// table of nStrings bytes of '\0'-terminated strings. Strings are
+// referenced by their offset in the table plus 1, 0 stands for NULL.
+typedef struct {
+    unsigned int magic;        // MDC_MAGIC
+    unsigned int version;      // MDC_VERSION
+    unsigned int xmlSize;      // size of the XML file encoded here
+    unsigned int xmlCrc;       // CRC-32 of the XML file encoded here
+    unsigned int guid;         // reference to the GUID of the model
+    unsigned int nWords;       // number of words after the header
+    unsigned int nStrings;     // size of the string table
+    unsigned int crc;          // CRC-32 of words and strings
+} MdcHeader;
+
+int writeModelDescriptionCache(ModelDescription* md, const char* binPath,
+        unsigned int xmlSize, unsigned int xmlCrc);
+ModelDescription* readModelDescriptionCache(const char* binPath,
+        unsigned int xmlSize, unsigned int xmlCrc);
+ModelDescription* parseCached(const char* xmlPath, const char* binPath);
+
+#endif // mdcache_h
@@ -0,0 +1,279 @@
+/* -------------------------------------------------------------------------
+ * numfmt.c
+ * Fast conversion of numbers to text for writing result files.
+ * formatDouble writes the shortest decimal string that reads back as the
+ * same double, using the Grisu2 algorithm by Florian Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", PLDI 2010.
+ * In rare cases, Grisu2 produces one digit more than needed, but the
+ * result always reads back exactly. The layout is the one of printf %.16g.
+ * -------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "numfmt.h"
+
+#ifdef _MSC_VER
+typedef unsigned __int64 u64;
+#define U64(x) x##ui64
+#else
+typedef unsigned long long u64;
+#define U64(x) x##ULL
+#endif
+
+#define SIGNIFICAND_MASK U64(0x000fffffffffffff)
+#define HIDDEN_BIT       U64(0x0010000000000000)
+#define EXPONENT_MASK    U64(0x7ff0000000000000)
+
+// A floating-point number f * 2^e with a 64-bit significand
+typedef struct {
+    u64 f;
+    int e;
+} DiyFp;
+
+// Normalized 10^k for k = -348, -340, ..., 340, rounded to 64 bits
+static const DiyFp cachedPowers[] = {
+    {U64(0xfa8fd5a0081c0288), -1220}, {U64(0xbaaee17fa23ebf76), -1193}, {U64(0x8b16fb203055ac76), -1166}, {U64(0xcf42894a5dce35ea), -1140},
+    {U64(0x9a6bb0aa55653b2d), -1113}, {U64(0xe61acf033d1a45df), -1087}, {U64(0xab70fe17c79ac6ca), -1060}, {U64(0xff77b1fcbebcdc4f), -1034},
+    {U64(0xbe5691ef416bd60c), -1007}, {U64(0x8dd01fad907ffc3c), -980}, {U64(0xd3515c2831559a83), -954}, {U64(0x9d71ac8fada6c9b5), -927},
+    {U64(0xea9c227723ee8bcb), -901}, {U64(0xaecc49914078536d), -874}, {U64(0x823c12795db6ce57), -847}, {U64(0xc21094364dfb5637), -821},
+    {U64(0x9096ea6f3848984f), -794}, {U64(0xd77485cb25823ac7), -768}, {U64(0xa086cfcd97bf97f4), -741}, {U64(0xef340a98172aace5), -715},
+    {U64(0xb23867fb2a35b28e), -688}, {U64(0x84c8d4dfd2c63f3b), -661}, {U64(0xc5dd44271ad3cdba), -635}, {U64(0x936b9fcebb25c996), -608},
+    {U64(0xdbac6c247d62a584), -582}, {U64(0xa3ab66580d5fdaf6), -555}, {U64(0xf3e2f893dec3f126), -529}, {U64(0xb5b5ada8aaff80b8), -502},
+    {U64(0x87625f056c7c4a8b), -475}, {U64(0xc9bcff6034c13053), -449}, {U64(0x964e858c91ba2655), -422}, {U64(0xdff9772470297ebd), -396},
+    {U64(0xa6dfbd9fb8e5b88f), -369}, {U64(0xf8a95fcf88747d94), -343}, {U64(0xb94470938fa89bcf), -316}, {U64(0x8a08f0f8bf0f156b), -289},
+    {U64(0xcdb02555653131b6), -263}, {U64(0x993fe2c6d07b7fac), -236}, {U64(0xe45c10c42a2b3b06), -210}, {U64(0xaa242499697392d3), -183},
+    {U64(0xfd87b5f28300ca0e), -157}, {U64(0xbce5086492111aeb), -130}, {U64(0x8cbccc096f5088cc), -103}, {U64(0xd1b71758e219652c), -77},
+    {U64(0x9c40000000000000), -50}, {U64(0xe8d4a51000000000), -24}, {U64(0xad78ebc5ac620000), 3}, {U64(0x813f3978f8940984), 30},
+    {U64(0xc097ce7bc90715b3), 56}, {U64(0x8f7e32ce7bea5c70), 83}, {U64(0xd5d238a4abe98068), 109}, {U64(0x9f4f2726179a2245), 136},
+    {U64(0xed63a231d4c4fb27), 162}, {U64(0xb0de65388cc8ada8), 189}, {U64(0x83c7088e1aab65db), 216}, {U64(0xc45d1df942711d9a), 242},
+    {U64(0x924d692ca61be758), 269}, {U64(0xda01ee641a708dea), 295}, {U64(0xa26da3999aef774a), 322}, {U64(0xf209787bb47d6b85), 348},
+    {U64(0xb454e4a179dd1877), 375}, {U64(0x865b86925b9bc5c2), 402}, {U64(0xc83553c5c8965d3d), 428}, {U64(0x952ab45cfa97a0b3), 455},
+    {U64(0xde469fbd99a05fe3), 481}, {U64(0xa59bc234db398c25), 508}, {U64(0xf6c69a72a3989f5c), 534}, {U64(0xb7dcbf5354e9bece), 561},
+    {U64(0x88fcf317f22241e2), 588}, {U64(0xcc20ce9bd35c78a5), 614}, {U64(0x98165af37b2153df), 641}, {U64(0xe2a0b5dc971f303a), 667},
+    {U64(0xa8d9d1535ce3b396), 694}, {U64(0xfb9b7cd9a4a7443c), 720}, {U64(0xbb764c4ca7a44410), 747}, {U64(0x8bab8eefb6409c1a), 774},
+    {U64(0xd01fef10a657842c), 800}, {U64(0x9b10a4e5e9913129), 827}, {U64(0xe7109bfba19c0c9d), 853}, {U64(0xac2820d9623bf429), 880},
+    {U64(0x80444b5e7aa7cf85), 907}, {U64(0xbf21e44003acdd2d), 933}, {U64(0x8e679c2f5e44ff8f), 960}, {U64(0xd433179d9c8cb841), 986},
+    {U64(0x9e19db92b4e31ba9), 1013}, {U64(0xeb96bf6ebadf77d9), 1039}, {U64(0xaf87023b9bf0ee6b), 1066},
+};
+
+static const u64 powersOf10[] = {
+    U64(1), U64(10), U64(100), U64(1000), U64(10000), U64(100000), U64(1000000),
+    U64(10000000), U64(100000000), U64(1000000000), U64(10000000000),
+    U64(100000000000), U64(1000000000000), U64(10000000000000),
+    U64(100000000000000), U64(1000000000000000), U64(10000000000000000),
+    U64(100000000000000000), U64(1000000000000000000), U64(10000000000000000000)
+};
+
+// product of x and y, rounded to the upper 64 bits
+static DiyFp multiply(DiyFp x, DiyFp y) {
+    const u64 M32 = 0xffffffff;
+    u64 a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+    u64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    u64 tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (U64(1) << 31);
+    DiyFp r;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static DiyFp normalize(DiyFp x) {
+    while (!(x.f & (U64(1) << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+// Compute the boundaries m- and m+ of v, halfway to the neighbouring 
+// doubles, with the exponent of the normalized m+
+static void boundaries(DiyFp v, DiyFp* mMinus, DiyFp* mPlus) {
+    DiyFp pl, mi;
+    pl.f = (v.f << 1) + 1;
+    pl.e = v.e - 1;
+    while (!(pl.f & (HIDDEN_BIT << 1))) {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 10; // 64 - 52 - 2 
+    pl.e -= 10;
+    if (v.f == HIDDEN_BIT) { // the lower neighbour is closer
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    }
+    else {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *mMinus = mi;
+    *mPlus = pl;
+}
+
+// Returns a cached power c = 10^-k, such that the exponent 
+// of c times a number with exponent e is in [-60, -32]
+static DiyFp cachedPower(int e, int* k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // dk must be positive
+    int i = (int)dk;
+    if (dk - i > 0.0) i++;
+    i = (i >> 3) + 1;
+    *k = -(-348 + i * 8);
+    return cachedPowers[i];
+}
+
+// Move the last digit down while the result gets closer to w
+static void grisuRound(char* buffer, int n, u64 delta, u64 rest, u64 tenKappa, u64 wpw) {
+    while (rest < wpw && delta - rest >= tenKappa 
+            && (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+        buffer[n - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static int countDigits(unsigned int n) {
+    int d = 1;
+    while (d < 10 && n >= powersOf10[d]) d++;
+    return d;
+}
+
+// Generate the shortest digits of w within [mp - delta, mp] into buffer.
+// Returns the number of digits, the value is digits * 10^k.
+static int digitGen(DiyFp w, DiyFp mp, u64 delta, char* buffer, int* k) {
+    DiyFp one;
+    u64 wpw = mp.f - w.f;
+    unsigned int p1;
+    u64 p2;
+    int kappa, n = 0;
+    one.f = U64(1) << -mp.e;
+    one.e = mp.e;
+    p1 = (unsigned int)(mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+    kappa = countDigits(p1);
+    while (kappa > 0) {
+        unsigned int d = (unsigned int)(p1 / powersOf10[kappa - 1]);
+        p1 %= (unsigned int)powersOf10[kappa - 1];
+        if (d || n) buffer[n++] = (char)('0' + d);
+        kappa--;
+        if ((((u64)p1) << -one.e) + p2 <= delta) {
+            *k += kappa;
+            grisuRound(buffer, n, delta, (((u64)p1) << -one.e) + p2, powersOf10[kappa] << -one.e, wpw);
+            return n;
+        }
+    }
+    for (;;) {
+        unsigned int d;
+        p2 *= 10;
+        delta *= 10;
+        d = (unsigned int)(p2 >> -one.e);
+        if (d || n) buffer[n++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            grisuRound(buffer, n, delta, p2, one.f, -kappa < 20 ? wpw * powersOf10[-kappa] : 0);
+            return n;
+        }
+    }
+}
+
+// write exponent e as printf does, with sign and at least 2 digits
+static int formatExponent(char* buffer, int e) {
+    int n = 0;
+    buffer[n++] = 'e';
+    buffer[n++] = e < 0 ? '-' : '+';
+    if (e < 0) e = -e;
+    if (e >= 100) buffer[n++] = (char)('0' + e / 100);
+    buffer[n++] = (char)('0' + e / 10 % 10);
+    buffer[n++] = (char)('0' + e % 10);
+    return n;
+}
+
+// Write v to buffer, which must hold at least NUMFMT_DOUBLE_SIZE chars, 
+// using the given decimal point, e.g. '.' or ','. The buffer is not 
+// terminated. Returns the number of chars written.
+int formatDouble(char* buffer, double v, char decimalPoint) {
+    DiyFp w, mMinus, mPlus, c;
+    char digits[20];
+    u64 bits;
+    int n, k, x, i, len = 0;
+    memcpy(&bits, &v, sizeof(double));
+    if (bits >> 63) buffer[len++] = '-';
+    if ((bits & EXPONENT_MASK) == EXPONENT_MASK) {
+        if (bits & SIGNIFICAND_MASK) {
+            memcpy(buffer, "nan", 3); // no sign, as for printf on Windows
+            return 3;
+        }
+        memcpy(buffer + len, "inf", 3);
+        return len + 3;
+    }
+    if (!(bits << 1)) { // +0 or -0
+        buffer[len++] = '0';
+        return len;
+    }
+
+    // Grisu2
+    if (bits & EXPONENT_MASK) {
+        w.f = (bits & SIGNIFICAND_MASK) + HIDDEN_BIT;
+        w.e = (int)((bits & EXPONENT_MASK) >> 52) - 1075;
+    }
+    else { // subnormal
+        w.f = bits & SIGNIFICAND_MASK;
+        w.e = -1074;
+    }
+    boundaries(w, &mMinus, &mPlus);
+    c = cachedPower(mPlus.e, &k);
+    w = multiply(normalize(w), c);
+    mPlus = multiply(mPlus, c);
+    mMinus = multiply(mMinus, c);
+    mMinus.f++;
+    mPlus.f--;
+    n = digitGen(w, mPlus, mPlus.f - mMinus.f, digits, &k);
+    while (n > 1 && digits[n - 1] == '0') { // v is digits * 10^k
+        n--;
+        k++;
+    }
+
+    // layout of printf %.16g, as used for result files before
+    x = n + k - 1; // decimal exponent of the first digit
+    if (x < -4 || x >= 16) {
+        buffer[len++] = digits[0];
+        if (n > 1) {
+            buffer[len++] = decimalPoint;
+            memcpy(buffer + len, digits + 1, n - 1);
+            len += n - 1;
+        }
+        return len + formatExponent(buffer + len, x);
+    }
+    if (k >= 0) { // integer
+        memcpy(buffer + len, digits, n);
+        len += n;
+        for (i=0; i<k; i++) buffer[len++] = '0';
+        return len;
+    }
+    if (x >= 0) { // 1 <= |v|
+        memcpy(buffer + len, digits, x + 1);
+        len += x + 1;
+        buffer[len++] = decimalPoint;
+        memcpy(buffer + len, digits + x + 1, n - x - 1);
+        return len + n - x - 1;
+    }
+    buffer[len++] = '0'; // |v| < 1
+    buffer[len++] = decimalPoint;
+    for (i=0; i<-x-1; i++) buffer[len++] = '0';
+    memcpy(buffer + len, digits, n);
+    return len + n;
+}
+
+// Write v in decimal to buffer, which must hold at least NUMFMT_INT_SIZE
+// chars. The buffer is not terminated. Returns the number of chars written.
+int formatInt(char* buffer, int v) {
+    char digits[10];
+    unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+    int n = 0, len = 0;
+    if (v < 0) buffer[len++] = '-';
+    do {
+        digits[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    while (n) buffer[len++] = digits[--n];
+    return len;
+}
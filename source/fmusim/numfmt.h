@@ -0,0 +1,15 @@
+/* -------------------------------------------------------------------------
+ * numfmt.h
+ * Fast conversion of numbers to text for writing result files.
+ * -------------------------------------------------------------------------*/
+
+#ifndef numfmt_h
+#define numfmt_h
+
+#define NUMFMT_DOUBLE_SIZE 25 // e.g. -2.2250738585072014e-308
+#define NUMFMT_INT_SIZE    11 // e.g. -2147483648
+
+int formatDouble(char* buffer, double v, char decimalPoint);
+int formatInt(char* buffer, int v);
+
+#endif // numfmt_h
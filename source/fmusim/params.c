@@ -0,0 +1,220 @@
+/* -------------------------------------------------------------------------
+ * params.c
+ * A table of parameter and start value sets, read from a CSV file.
+ * The first line holds the names of the variables, each further line
+ * one set of values, separated by the CSV separator. Empty lines and 
+ * lines starting with '#' are ignored. Booleans are given as 0, 1, 
+ * false or true, Strings without quotes.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "params.h"
+
+#define ARENA_BLOCKSIZE 4096
+
+// Returns the contents of the file at path, terminated by '\0',
+// or NULL to indicate failure
+static char* readFile(const char* path) {
+    FILE* file = fopen(path, "rb");
+    char* text = NULL;
+    long n;
+    if (!file) {
+        printf("error: Could not open parameter table %s\n", path);
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) == 0 && (n = ftell(file)) >= 0 
+            && fseek(file, 0, SEEK_SET) == 0) {
+        text = (char*)malloc(n + 1);
+        if (text && fread(text, 1, n, file) == (size_t)n) text[n] = '\0';
+        else {
+            printf("error: Could not read parameter table %s\n", path);
+            free(text);
+            text = NULL;
+        }
+    }
+    fclose(file);
+    return text;
+}
+
+// Split line at separator into at most max cells, which are trimmed in place.
+// Returns the number of cells.
+static int splitLine(char* line, char separator, char** cells, int max) {
+    int n = 0;
+    for (;;) {
+        char* end = strchr(line, separator);
+        char* last;
+        if (end) *end = '\0';
+        while (isspace((unsigned char)*line)) line++;
+        last = line + strlen(line);
+        while (last > line && isspace((unsigned char)last[-1])) *--last = '\0';
+        if (n < max) cells[n] = line;
+        n++;
+        if (!end) return n;
+        line = end + 1;
+    }
+}
+
+// Returns the number of cells of the given line
+static int countCells(const char* line, char separator) {
+    int n = 1;
+    while ((line = strchr(line, separator)) != NULL) {
+        line++;
+        n++;
+    }
+    return n;
+}
+
+// Parse the text of a cell into value, for the type of sv.
+// Returns 0 to indicate failure.
+static int parseValue(ParameterTable* table, ScalarVariable* sv, const char* text,
+        ParameterValue* value) {
+    char* end;
+    int negated = getAlias(sv) == enu_negatedAlias;
+    switch (sv->baseType) {
+        case elm_Real:
+        case elm_Integer:
+            value->number = strtod(text, &end);
+            if (end == text || *end) return 0;
+            if (sv->baseType == elm_Integer && value->number != (fmiInteger)value->number) return 0;
+            if (negated) value->number = -value->number;
+            return 1;
+        case elm_Boolean:
+            if (!strcmp(text, "1") || !strcmp(text, "true")) value->number = 1;
+            else if (!strcmp(text, "0") || !strcmp(text, "false")) value->number = 0;
+            else return 0;
+            if (negated) value->number = !value->number;
+            return 1;
+        case elm_String:
+            value->string = arenaStrdup(table->arena, text);
+            return value->string != NULL;
+        default:
+            return 0;
+    }
+}
+
+// Returns NULL to indicate failure
+ParameterTable* readParameterTable(ModelDescription* md, const char* path, char separator) {
+    ParameterTable* table = NULL;
+    char* text = readFile(path);
+    char* line;
+    char* next;
+    char** cells = NULL;
+    int i, n, lineNumber = 0, maxRows = 0;
+    if (!text) return NULL;
+
+    // count the lines to allocate all rows at once
+    for (line = text; line; line = strchr(line + 1, '\n')) maxRows++;
+    table = (ParameterTable*)calloc(1, sizeof(ParameterTable));
+    if (!table || !(table->arena = arenaNew(ARENA_BLOCKSIZE))) goto outOfMemory;
+
+    for (line = text; line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        lineNumber++;
+        n = (int)strlen(line);
+        if (n > 0 && line[n-1] == '\r') line[--n] = '\0';
+        if (n == 0 || line[0] == '#') continue;
+
+        if (!table->vars) {
+            // the header with the variable names
+            table->nColumns = countCells(line, separator);
+            table->vars = (ScalarVariable**)arenaAlloc(table->arena, 
+                    table->nColumns * sizeof(ScalarVariable*));
+            table->values = (ParameterValue*)arenaAlloc(table->arena, 
+                    (size_t)maxRows * table->nColumns * sizeof(ParameterValue));
+            cells = (char**)arenaAlloc(table->arena, table->nColumns * sizeof(char*));
+            if (!table->vars || !table->values || !cells) goto outOfMemory;
+            splitLine(line, separator, cells, table->nColumns);
+            for (i=0; i<table->nColumns; i++) {
+                ScalarVariable* sv = getVariableByName(md, cells[i]);
+                if (!sv) {
+                    printf("error: %s: Unknown variable '%s'\n", path, cells[i]);
+                    goto fail;
+                }
+                if (getVariability(sv) == enu_constant 
+                        || (!(sv->defined & hasStart) && getCausality(sv) != enu_input)) {
+                    printf("error: %s: Variable '%s' has no start value and is no input\n", 
+                            path, cells[i]);
+                    goto fail;
+                }
+                table->vars[i] = sv;
+            }
+            continue;
+        }
+
+        // a set of values
+        n = splitLine(line, separator, cells, table->nColumns);
+        if (n != table->nColumns) {
+            printf("error: %s line %d: Found %d values, expected %d\n", 
+                    path, lineNumber, n, table->nColumns);
+            goto fail;
+        }
+        for (i=0; i<n; i++) {
+            ParameterValue* value = &table->values[(size_t)table->nRows * n + i];
+            if (!parseValue(table, table->vars[i], cells[i], value)) {
+                printf("error: %s line %d: Invalid value '%s' for %s\n", 
+                        path, lineNumber, cells[i], getName(table->vars[i]));
+                goto fail;
+            }
+        }
+        table->nRows++;
+    }
+    if (table->nRows == 0) {
+        printf("error: %s: No parameter sets found\n", path);
+        goto fail;
+    }
+    free(text);
+    return table;
+
+outOfMemory:
+    printf("error: out of memory\n");
+fail:
+    free(text);
+    freeParameterTable(table);
+    return NULL;
+}
+
+// Set the values of the given row in the instance c of fmu.
+// Returns 0 to indicate failure.
+int setParameters(FMU* fmu, fmiComponent c, ParameterTable* table, int row) {
+    int i;
+    fmiStatus fmiFlag = fmiOK;
+    for (i=0; i<table->nColumns; i++) {
+        ScalarVariable* sv = table->vars[i];
+        ParameterValue* value = &table->values[(size_t)row * table->nColumns + i];
+        fmiInteger integerValue;
+        fmiBoolean booleanValue;
+        switch (sv->baseType) {
+            case elm_Real:
+                fmiFlag = fmu->setReal(c, &sv->vr, 1, &value->number);
+                break;
+            case elm_Integer:
+                integerValue = (fmiInteger)value->number;
+                fmiFlag = fmu->setInteger(c, &sv->vr, 1, &integerValue);
+                break;
+            case elm_Boolean:
+                booleanValue = value->number != 0;
+                fmiFlag = fmu->setBoolean(c, &sv->vr, 1, &booleanValue);
+                break;
+            case elm_String:
+                fmiFlag = fmu->setString(c, &sv->vr, 1, &value->string);
+                break;
+            default:
+                break;
+        }
+        if (fmiFlag > fmiWarning) {
+            printf("error: Could not set %s\n", getName(sv));
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void freeParameterTable(ParameterTable* table) {
+    if (!table) return;
+    arenaFree(table->arena);
+    free(table);
+}
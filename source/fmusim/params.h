@@ -0,0 +1,30 @@
+/* -------------------------------------------------------------------------
+ * params.h
+ * A table of parameter and start value sets, one set per row, 
+ * that are applied to model instances before initialization.
+ * -------------------------------------------------------------------------*/
+
+#ifndef params_h
+#define params_h
+
+#include "main.h"
+#include "arena.h"
+
+typedef struct {
+    fmiReal number;         // value of a Real, Integer or Boolean
+    const char* string;     // value of a String
+} ParameterValue;
+
+typedef struct {
+    int nColumns;
+    ScalarVariable** vars;  // the variable set by each column
+    int nRows;
+    ParameterValue* values; // nRows * nColumns values, by rows
+    Arena* arena;           // holds the table and its strings
+} ParameterTable;
+
+ParameterTable* readParameterTable(ModelDescription* md, const char* path, char separator);
+int setParameters(FMU* fmu, fmiComponent c, ParameterTable* table, int row);
+void freeParameterTable(ParameterTable* table);
+
+#endif // params_h
@@ -0,0 +1,401 @@
+/* -------------------------------------------------------------------------
+ * profile.c
+ * Call counts, times and latency histograms of the FMI functions.
+ * profileFmu replaces the function pointers of an FMU by wrappers that
+ * time each call. Each thread records its calls in its own statistics,
+ * so that threads simulating in parallel do not contend. The statistics
+ * of all threads are summed up for the report.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "profile.h"
+#include "fmuthread.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#include <time.h>
+#define THREAD_LOCAL __thread
+#endif
+
+// bucket b of a histogram counts calls that took less than 2^b ns,
+// but not less than 2^(b-1) ns. The last bucket counts all longer calls.
+#define PROFILE_BUCKETS 32
+
+// indexes of the profiled functions
+typedef enum {
+    pInstantiateModel, pFreeModelInstance, pSetDebugLogging, pSetTime, 
+    pSetContinuousStates, pCompletedIntegratorStep, pSetReal, pSetInteger,
+    pSetBoolean, pSetString, pInitialize, pGetDerivatives, pGetEventIndicators,
+    pGetReal, pGetInteger, pGetBoolean, pGetString, pEventUpdate, 
+    pGetContinuousStates, pGetNominalContinuousStates, pGetStateValueReferences,
+    pTerminate, N_PROFILED
+} ProfiledFunction;
+
+static const char* functionNames[N_PROFILED] = {
+    "fmiInstantiateModel", "fmiFreeModelInstance", "fmiSetDebugLogging", "fmiSetTime",
+    "fmiSetContinuousStates", "fmiCompletedIntegratorStep", "fmiSetReal", "fmiSetInteger",
+    "fmiSetBoolean", "fmiSetString", "fmiInitialize", "fmiGetDerivatives", "fmiGetEventIndicators",
+    "fmiGetReal", "fmiGetInteger", "fmiGetBoolean", "fmiGetString", "fmiEventUpdate",
+    "fmiGetContinuousStates", "fmiGetNominalContinuousStates", "fmiGetStateValueReferences",
+    "fmiTerminate"
+};
+
+typedef struct {
+    unsigned long long calls;
+    double time;                                // total time in s
+    double maxTime;                             // time of the longest call in s
+    unsigned long long histogram[PROFILE_BUCKETS];
+} FunctionProfile;
+
+// the statistics of one thread
+typedef struct ThreadProfile {
+    FunctionProfile functions[N_PROFILED];
+    struct ThreadProfile* next;
+} ThreadProfile;
+
+static FMU model;                               // the functions of the profiled FMU
+static int active;                              // 1 if an FMU is profiled
+static double startTime;                        // time when profiling started
+static Mutex mutex;                             // protects threads
+static ThreadProfile* threads;                  // the statistics of all threads
+static THREAD_LOCAL ThreadProfile* current;     // the statistics of this thread
+
+// Returns a monotonic time in s
+static double now(void) {
+#ifdef _MSC_VER
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+#endif
+}
+
+// add a call of function f that took dt s to the statistics of this thread
+static void record(ProfiledFunction f, double dt) {
+    FunctionProfile* p;
+    int b;
+    if (!current) {
+        current = (ThreadProfile*)calloc(1, sizeof(ThreadProfile));
+        if (!current) return; // not recorded
+        mutexLock(&mutex);
+        current->next = threads;
+        threads = current;
+        mutexUnlock(&mutex);
+    }
+    p = &current->functions[f];
+    p->calls++;
+    p->time += dt;
+    if (dt > p->maxTime) p->maxTime = dt;
+    frexp(dt * 1e9, &b);
+    if (b < 0) b = 0;
+    if (b >= PROFILE_BUCKETS) b = PROFILE_BUCKETS - 1;
+    p->histogram[b]++;
+}
+
+// execute call, a call of a function of the model, and record it as f
+#define TIMED(f, call) { \
+    double t0 = now(); \
+    call; \
+    record(f, now() - t0); \
+}
+
+static fmiComponent timedInstantiateModel(fmiString instanceName, fmiString GUID,
+        fmiCallbackFunctions functions, fmiBoolean loggingOn) {
+    fmiComponent c;
+    TIMED(pInstantiateModel, c = model.instantiateModel(instanceName, GUID, functions, loggingOn));
+    return c;
+}
+
+static void timedFreeModelInstance(fmiComponent c) {
+    TIMED(pFreeModelInstance, model.freeModelInstance(c));
+}
+
+static fmiStatus timedSetDebugLogging(fmiComponent c, fmiBoolean loggingOn) {
+    fmiStatus s;
+    TIMED(pSetDebugLogging, s = model.setDebugLogging(c, loggingOn));
+    return s;
+}
+
+static fmiStatus timedSetTime(fmiComponent c, fmiReal time) {
+    fmiStatus s;
+    TIMED(pSetTime, s = model.setTime(c, time));
+    return s;
+}
+
+static fmiStatus timedSetContinuousStates(fmiComponent c, const fmiReal x[], size_t nx) {
+    fmiStatus s;
+    TIMED(pSetContinuousStates, s = model.setContinuousStates(c, x, nx));
+    return s;
+}
+
+static fmiStatus timedCompletedIntegratorStep(fmiComponent c, fmiBoolean* callEventUpdate) {
+    fmiStatus s;
+    TIMED(pCompletedIntegratorStep, s = model.completedIntegratorStep(c, callEventUpdate));
+    return s;
+}
+
+static fmiStatus timedSetReal(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        const fmiReal value[]) {
+    fmiStatus s;
+    TIMED(pSetReal, s = model.setReal(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedSetInteger(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        const fmiInteger value[]) {
+    fmiStatus s;
+    TIMED(pSetInteger, s = model.setInteger(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedSetBoolean(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        const fmiBoolean value[]) {
+    fmiStatus s;
+    TIMED(pSetBoolean, s = model.setBoolean(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedSetString(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        const fmiString value[]) {
+    fmiStatus s;
+    TIMED(pSetString, s = model.setString(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedInitialize(fmiComponent c, fmiBoolean toleranceControlled, 
+        fmiReal relativeTolerance, fmiEventInfo* eventInfo) {
+    fmiStatus s;
+    TIMED(pInitialize, s = model.initialize(c, toleranceControlled, relativeTolerance, eventInfo));
+    return s;
+}
+
+static fmiStatus timedGetDerivatives(fmiComponent c, fmiReal derivatives[], size_t nx) {
+    fmiStatus s;
+    TIMED(pGetDerivatives, s = model.getDerivatives(c, derivatives, nx));
+    return s;
+}
+
+static fmiStatus timedGetEventIndicators(fmiComponent c, fmiReal eventIndicators[], size_t ni) {
+    fmiStatus s;
+    TIMED(pGetEventIndicators, s = model.getEventIndicators(c, eventIndicators, ni));
+    return s;
+}
+
+static fmiStatus timedGetReal(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        fmiReal value[]) {
+    fmiStatus s;
+    TIMED(pGetReal, s = model.getReal(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedGetInteger(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        fmiInteger value[]) {
+    fmiStatus s;
+    TIMED(pGetInteger, s = model.getInteger(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedGetBoolean(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        fmiBoolean value[]) {
+    fmiStatus s;
+    TIMED(pGetBoolean, s = model.getBoolean(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedGetString(fmiComponent c, const fmiValueReference vr[], size_t nvr, 
+        fmiString value[]) {
+    fmiStatus s;
+    TIMED(pGetString, s = model.getString(c, vr, nvr, value));
+    return s;
+}
+
+static fmiStatus timedEventUpdate(fmiComponent c, fmiBoolean intermediateResults, 
+        fmiEventInfo* eventInfo) {
+    fmiStatus s;
+    TIMED(pEventUpdate, s = model.eventUpdate(c, intermediateResults, eventInfo));
+    return s;
+}
+
+static fmiStatus timedGetContinuousStates(fmiComponent c, fmiReal states[], size_t nx) {
+    fmiStatus s;
+    TIMED(pGetContinuousStates, s = model.getContinuousStates(c, states, nx));
+    return s;
+}
+
+static fmiStatus timedGetNominalContinuousStates(fmiComponent c, fmiReal x_nominal[], size_t nx) {
+    fmiStatus s;
+    TIMED(pGetNominalContinuousStates, s = model.getNominalContinuousStates(c, x_nominal, nx));
+    return s;
+}
+
+static fmiStatus timedGetStateValueReferences(fmiComponent c, fmiValueReference vrx[], size_t nx) {
+    fmiStatus s;
+    TIMED(pGetStateValueReferences, s = model.getStateValueReferences(c, vrx, nx));
+    return s;
+}
+
+static fmiStatus timedTerminate(fmiComponent c) {
+    fmiStatus s;
+    TIMED(pTerminate, s = model.terminate(c));
+    return s;
+}
+
+// replace the function pointer f of fmu by wrapper w, unless not bound
+#define WRAP(f, w) if (fmu->f) fmu->f = w
+
+// Time all calls of the functions of fmu from now on. Only one FMU can be
+// profiled. Call before simulating in parallel. Returns 0 to indicate failure.
+int profileFmu(FMU* fmu) {
+    if (active) {
+        printf("error: Only one FMU can be profiled\n");
+        return 0;
+    }
+    model = *fmu;
+    mutexInit(&mutex);
+    active = 1;
+    startTime = now();
+    WRAP(instantiateModel, timedInstantiateModel);
+    WRAP(freeModelInstance, timedFreeModelInstance);
+    WRAP(setDebugLogging, timedSetDebugLogging);
+    WRAP(setTime, timedSetTime);
+    WRAP(setContinuousStates, timedSetContinuousStates);
+    WRAP(completedIntegratorStep, timedCompletedIntegratorStep);
+    WRAP(setReal, timedSetReal);
+    WRAP(setInteger, timedSetInteger);
+    WRAP(setBoolean, timedSetBoolean);
+    WRAP(setString, timedSetString);
+    WRAP(initialize, timedInitialize);
+    WRAP(getDerivatives, timedGetDerivatives);
+    WRAP(getEventIndicators, timedGetEventIndicators);
+    WRAP(getReal, timedGetReal);
+    WRAP(getInteger, timedGetInteger);
+    WRAP(getBoolean, timedGetBoolean);
+    WRAP(getString, timedGetString);
+    WRAP(eventUpdate, timedEventUpdate);
+    WRAP(getContinuousStates, timedGetContinuousStates);
+    WRAP(getNominalContinuousStates, timedGetNominalContinuousStates);
+    WRAP(getStateValueReferences, timedGetStateValueReferences);
+    WRAP(terminate, timedTerminate);
+    return 1;
+}
+
+// sum up the statistics of all threads in total, returns the total time in s
+// and sets nThreads to the number of threads that called the functions.
+// Must not be called while profiled functions run.
+static double sumProfiles(FunctionProfile total[N_PROFILED], int* nThreads) {
+    ThreadProfile* t;
+    double time = 0;
+    int f, b;
+    memset(total, 0, N_PROFILED * sizeof(FunctionProfile));
+    *nThreads = 0;
+    for (t=threads; t; t=t->next) {
+        (*nThreads)++;
+        for (f=0; f<N_PROFILED; f++) {
+            FunctionProfile* p = &t->functions[f];
+            total[f].calls += p->calls;
+            total[f].time += p->time;
+            if (p->maxTime > total[f].maxTime) total[f].maxTime = p->maxTime;
+            for (b=0; b<PROFILE_BUCKETS; b++) total[f].histogram[b] += p->histogram[b];
+        }
+    }
+    for (f=0; f<N_PROFILED; f++) time += total[f].time;
+    return time;
+}
+
+// Returns an upper bound in s of the duration of the given fraction of 
+// the calls with the shortest durations, e.g. 0.5 for the median
+static double quantile(FunctionProfile* p, double fraction) {
+    unsigned long long n = 0;
+    int b;
+    for (b=0; b<PROFILE_BUCKETS - 1; b++) {
+        n += p->histogram[b];
+        if (n >= fraction * p->calls) break;
+    }
+    if (b == PROFILE_BUCKETS - 1 || ldexp(1e-9, b) > p->maxTime) return p->maxTime;
+    return ldexp(1e-9, b);
+}
+
+// Print the statistics of the functions called so far, if profiling
+void printProfile(void) {
+    FunctionProfile total[N_PROFILED];
+    double time, wallTime;
+    int f, nThreads;
+    if (!active) return;
+    time = sumProfiles(total, &nThreads);
+    wallTime = now() - startTime;
+    printf("FMI function calls\n");
+    printf("  %-29s %12s %11s %10s %10s %10s %10s\n", "function", "calls", "total [s]", 
+            "mean [us]", "p50 [us]", "p99 [us]", "max [us]");
+    for (f=0; f<N_PROFILED; f++) {
+        FunctionProfile* p = &total[f];
+        if (p->calls == 0) continue;
+        printf("  %-29s %12llu %11.6f %10.3f %10.3f %10.3f %10.3f\n", functionNames[f], 
+                p->calls, p->time, 1e6 * p->time / p->calls, 1e6 * quantile(p, 0.5), 
+                1e6 * quantile(p, 0.99), 1e6 * p->maxTime);
+    }
+    if (nThreads > 1) printf("  time in FMI functions %g s, summed over %d threads, in %g s\n", 
+            time, nThreads, wallTime);
+    else printf("  time in FMI functions %g s of %g s (%.1f%%)\n", time, wallTime, 
+            wallTime > 0 ? 100 * time / wallTime : 0);
+}
+
+// Write the statistics of the functions called so far as JSON to path.
+// Histogram bucket {"below": t, "calls": n} counts calls shorter than t ns,
+// and not shorter than the bound of the previous bucket.
+// Returns 0 to indicate failure.
+int writeProfileJson(const char* path) {
+    FunctionProfile total[N_PROFILED];
+    double time;
+    int f, b, nThreads, first = 1;
+    FILE* file;
+    if (!active) return 1;
+    file = fopen(path, "w");
+    if (!file) {
+        printf("error: Could not open '%s'\n", path);
+        return 0;
+    }
+    time = sumProfiles(total, &nThreads);
+    fprintf(file, "{\n  \"wallTime\": %.9g,\n  \"fmiTime\": %.9g,\n  \"threads\": %d,"
+            "\n  \"functions\": [", now() - startTime, time, nThreads);
+    for (f=0; f<N_PROFILED; f++) {
+        FunctionProfile* p = &total[f];
+        int firstBucket = 1;
+        if (p->calls == 0) continue;
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"calls\": %llu, \"time\": %.9g, \"maxTime\": %.9g,"
+                "\n     \"histogram\": [", first ? "" : ",", functionNames[f], p->calls, p->time, p->maxTime);
+        for (b=0; b<PROFILE_BUCKETS; b++) {
+            if (p->histogram[b] == 0) continue;
+            if (b < PROFILE_BUCKETS - 1) fprintf(file, "%s{\"below\": %.0f, \"calls\": %llu}", 
+                    firstBucket ? "" : ", ", ldexp(1, b), p->histogram[b]);
+            else fprintf(file, "%s{\"below\": null, \"calls\": %llu}", 
+                    firstBucket ? "" : ", ", p->histogram[b]);
+            firstBucket = 0;
+        }
+        fprintf(file, "]}");
+        first = 0;
+    }
+    fprintf(file, "\n  ]\n}\n");
+    fclose(file);
+    return 1;
+}
+
+// release the statistics
+void freeProfile(void) {
+    if (!active) return;
+    while (threads) {
+        ThreadProfile* next = threads->next;
+        free(threads);
+        threads = next;
+    }
+    current = NULL;
+    mutexDestroy(&mutex);
+    active = 0;
+}
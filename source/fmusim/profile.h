@@ -0,0 +1,16 @@
+/* -------------------------------------------------------------------------
+ * profile.h
+ * Call counts, times and latency histograms of the FMI functions.
+ * -------------------------------------------------------------------------*/
+
+#ifndef profile_h
+#define profile_h
+
+#include "main.h"
+
+int profileFmu(FMU* fmu);
+void printProfile(void);
+int writeProfileJson(const char* path);
+void freeProfile(void);
+
+#endif // profile_h
@@ -0,0 +1,183 @@
+/* -------------------------------------------------------------------------
+ * scheduler.c
+ * Work-stealing execution of tasks by a pool of worker threads.
+ * Each worker owns a deque of tasks. It takes tasks from the bottom of its
+ * own deque, and puts a task that wants to run again back to the bottom,
+ * so that it continues its own work first. A worker with an empty deque 
+ * steals the oldest task from the top of the deque of another worker.
+ * Tasks are coarse, e.g. a slice of a simulation, so each deque is 
+ * protected by a mutex of its own, which is hardly ever contended.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scheduler.h"
+#include "fmuthread.h"
+
+typedef struct {
+    Mutex mutex;        // protects the fields below
+    int top;            // index of the oldest task
+    int bottom;         // index after the newest task
+    void** items;       // ring buffer of capacity nTasks, indexed modulo nTasks
+} Deque;
+
+// state shared by the workers
+typedef struct {
+    TaskFunction f;
+    void* context;
+    int nTasks;
+    int nThreads;
+    Deque* deques;      // one per worker
+    Mutex mutex;        // protects the fields below
+    Cond changed;       // signalled when remaining or generation changes
+    int remaining;      // number of unfinished tasks
+    int generation;     // incremented when a task is pushed back
+} Scheduler;
+
+// worker thread argument
+typedef struct {
+    Scheduler* s;
+    int id;
+} Worker;
+
+static void pushBottom(Scheduler* s, Deque* d, void* task) {
+    mutexLock(&d->mutex);
+    d->items[d->bottom % s->nTasks] = task;
+    d->bottom++;
+    mutexUnlock(&d->mutex);
+}
+
+// Returns NULL if the deque is empty
+static void* popBottom(Scheduler* s, Deque* d) {
+    void* task = NULL;
+    mutexLock(&d->mutex);
+    if (d->bottom > d->top) {
+        d->bottom--;
+        task = d->items[d->bottom % s->nTasks];
+    }
+    mutexUnlock(&d->mutex);
+    return task;
+}
+
+// Returns NULL if the deque is empty
+static void* popTop(Scheduler* s, Deque* d) {
+    void* task = NULL;
+    mutexLock(&d->mutex);
+    if (d->bottom > d->top) {
+        task = d->items[d->top % s->nTasks];
+        d->top++;
+    }
+    mutexUnlock(&d->mutex);
+    return task;
+}
+
+// Returns a task of the own deque or a stolen one, NULL if all are empty
+static void* findTask(Scheduler* s, int id) {
+    int i;
+    void* task = popBottom(s, &s->deques[id]);
+    for (i=1; !task && i<s->nThreads; i++) {
+        task = popTop(s, &s->deques[(id + i) % s->nThreads]);
+    }
+    return task;
+}
+
+static void work(Scheduler* s, int id) {
+    for (;;) {
+        int generation;
+        void* task;
+        mutexLock(&s->mutex);
+        generation = s->generation;
+        mutexUnlock(&s->mutex);
+        task = findTask(s, id);
+        if (task) {
+            if (s->f(task, id, s->context) == TASK_AGAIN) {
+                pushBottom(s, &s->deques[id], task);
+                mutexLock(&s->mutex);
+                s->generation++;
+            } else {
+                mutexLock(&s->mutex);
+                s->remaining--;
+            }
+            condBroadcast(&s->changed);
+            mutexUnlock(&s->mutex);
+            continue;
+        }
+        // all deques were empty, the remaining tasks run on other workers:
+        // wait until one of them is pushed back or finished
+        mutexLock(&s->mutex);
+        if (s->remaining > 0 && s->generation == generation) {
+            condWait(&s->changed, &s->mutex);
+        }
+        if (s->remaining == 0) {
+            mutexUnlock(&s->mutex);
+            return;
+        }
+        mutexUnlock(&s->mutex);
+    }
+}
+
+static void worker(void* arg) {
+    Worker* w = (Worker*)arg;
+    work(w->s, w->id);
+}
+
+// Run f for each task on up to nThreads threads until all are done. 
+// The tasks are dealt to the workers in turn. f may be called for
+// the same task again on any worker, but never concurrently.
+// Returns the number of threads used, 0 to indicate failure.
+int runTasks(void** tasks, int nTasks, int nThreads, TaskFunction f, void* context) {
+    Scheduler s;
+    Thread* threads;
+    Worker* workers;
+    int i, nStarted = 0;
+    if (nTasks == 0) return 1;
+    if (nThreads > nTasks) nThreads = nTasks;
+    if (nThreads < 1) nThreads = 1;
+    memset(&s, 0, sizeof(Scheduler));
+    s.f = f;
+    s.context = context;
+    s.nTasks = nTasks;
+    s.nThreads = nThreads;
+    s.remaining = nTasks;
+    s.deques = (Deque*)calloc(nThreads, sizeof(Deque));
+    threads = (Thread*)calloc(nThreads, sizeof(Thread));
+    workers = (Worker*)calloc(nThreads, sizeof(Worker));
+    for (i=0; s.deques && i<nThreads; i++) {
+        s.deques[i].items = (void**)calloc(nTasks, sizeof(void*));
+        if (!s.deques[i].items) break;
+    }
+    if (!s.deques || !threads || !workers || i < nThreads) {
+        printf("error: out of memory\n");
+        nThreads = 0;
+        goto done;
+    }
+    for (i=0; i<nThreads; i++) mutexInit(&s.deques[i].mutex);
+    for (i=0; i<nTasks; i++) pushBottom(&s, &s.deques[i % nThreads], tasks[i]);
+    mutexInit(&s.mutex);
+    condInit(&s.changed);
+
+    // the workers whose threads could not be started share their deques
+    // with the others by stealing, worker 0 runs in this thread
+    for (i=0; i<nThreads; i++) {
+        workers[i].s = &s;
+        workers[i].id = i;
+    }
+    for (nStarted=1; nStarted<nThreads; nStarted++) {
+        if (!threadCreate(&threads[nStarted], worker, &workers[nStarted])) break;
+    }
+    work(&s, 0);
+    for (i=1; i<nStarted; i++) threadJoin(threads[i]);
+
+    condDestroy(&s.changed);
+    mutexDestroy(&s.mutex);
+    for (i=0; i<nThreads; i++) mutexDestroy(&s.deques[i].mutex);
+    nThreads = nStarted;
+
+done:
+    for (i=0; s.deques && i<s.nThreads; i++) free(s.deques[i].items);
+    free(s.deques);
+    free(threads);
+    free(workers);
+    return nThreads;
+}
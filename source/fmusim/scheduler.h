@@ -0,0 +1,18 @@
+/* -------------------------------------------------------------------------
+ * scheduler.h
+ * Work-stealing execution of tasks by a pool of worker threads.
+ * -------------------------------------------------------------------------*/
+
+#ifndef scheduler_h
+#define scheduler_h
+
+// results of a task function
+#define TASK_DONE  0    // the task is finished
+#define TASK_AGAIN 1    // the task wants to run again, e.g. for its next slice
+
+// Runs a part or all of task on worker (0..nThreads-1) with the given context
+typedef int (*TaskFunction)(void* task, int worker, void* context);
+
+int runTasks(void** tasks, int nTasks, int nThreads, TaskFunction f, void* context);
+
+#endif // scheduler_h
@@ -0,0 +1,762 @@
+/* -------------------------------------------------------------------------
+ * solver.c
+ * Numerical integration of the continuous states of a model exchange FMU.
+ * A solver advances the states stored in the model instance from the
+ * current time to the next time, and leaves the model at the new time
+ * with the new states set. All work vectors are allocated once per run,
+ * from the workspace of the calling thread if one is given.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "solver.h"
+#include "fmuio.h"
+#include "sparsity.h"
+
+typedef struct {
+    const char* name;
+    int nVectors;       // number of work vectors of size nx
+    int adaptive;       // 1 if the step size is chosen to meet the tolerances
+    int implicit;       // 1 if a Jacobian is needed
+} MethodInfo;
+
+// indexed by SolverMethod
+static const MethodInfo methods[] = {
+    { "euler",  2, 0, 0 },
+    { "rk4",    6, 0, 0 },
+    { "dopri5", 10, 1, 0 },
+    { "beuler", 8, 0, 1 },
+    { "trbdf2", 10, 1, 1 }
+};
+#define N_METHODS ((int)(sizeof(methods)/sizeof(methods[0])))
+
+// Dormand-Prince 5(4) coefficients, the last row of a gives the solution
+// of order 5, e gives its difference to the embedded solution of order 4
+static const double dpC[] = { 0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1, 1 };
+static const double dpA[7][6] = {
+    { 0 },
+    { 1.0/5 },
+    { 3.0/40, 9.0/40 },
+    { 44.0/45, -56.0/15, 32.0/9 },
+    { 19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729 },
+    { 9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656 },
+    { 35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84 }
+};
+static const double dpE[] = { 71.0/57600, 0, -71.0/16695, 71.0/1920,
+        -17253.0/339200, 22.0/525, -1.0/40 };
+
+// TR-BDF2 coefficients: a trapezoidal stage to t+GAMMA*h, then a BDF2
+// stage to t+h, both solving z - D*h*f(z) = r with the same matrix
+#define SQRT2   1.4142135623730950488
+#define GAMMA   (2 - SQRT2)
+#define D       (GAMMA / 2)
+#define W       (SQRT2 / 4)
+
+// step size control
+#define SAFETY  0.9   // factor applied to the optimal step size
+#define FAC_MIN 0.2   // maximal decrease of the step size
+#define FAC_MAX 5.0   // maximal increase of the step size
+
+// event localization
+#define EVENT_TOL 1e-12   // width of the final interval around a crossing, relative to time
+#define EVENT_MAX 100     // maximal number of iterations
+
+// Newton iteration of implicit methods
+#define NEWTON_TOL 0.01   // required size of the last update, in units of the tolerances
+#define NEWTON_MAX 7      // maximal number of iterations
+#define NEWTON_RATE 0.9   // maximal ratio of successive updates
+
+// probing of the sparsity pattern
+#define PROBE_STATES 2    // number of offset states probed in addition to the current one
+#define PROBE_OFFSET 1e-3 // offset of the states, relative to their nominal values
+
+// Returns 0 to indicate that name is not a known solver
+int parseSolverMethod(const char* name, SolverMethod* method) {
+    int i;
+    for (i=0; i<N_METHODS; i++) {
+        if (!strcmp(name, methods[i].name)) {
+            *method = (SolverMethod)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* solverMethodName(SolverMethod method) {
+    return methods[method].name;
+}
+
+// Returns 1 if the method chooses its step size to meet the tolerances
+int isAdaptive(SolverMethod method) {
+    return methods[method].adaptive;
+}
+
+// Returns 1 if the method solves nonlinear equations in each step
+int isImplicit(SolverMethod method) {
+    return methods[method].implicit;
+}
+
+// Returns NULL to indicate failure
+Solver* newSolver(FMU* fmu, fmiComponent c, int nx, int nz, SolverOptions* options,
+        Workspace* w) {
+    int i;
+    const MethodInfo* m = &methods[options->method];
+    int hasNominal = m->adaptive || m->implicit;
+    size_t size = m->nVectors * nx + 1;
+    Solver* s = (Solver*)calloc(1, sizeof(Solver));
+    if (!s) {
+        printf("error: out of memory\n");
+        return NULL;
+    }
+    s->fmu = fmu;
+    s->c = c;
+    s->nx = nx;
+    s->nz = nz;
+    s->options = options;
+    if (m->implicit) size += 2 * (size_t)nx * nx;
+    if (nz > 0) size += 4 * nx + 2 * nz;
+    s->scratchSize = size * sizeof(double);
+    s->scratch = (double*)workspaceAlloc(w, s->scratchSize);
+    if (m->implicit) s->pivots = (int*)workspaceAlloc(w, (nx + 1) * sizeof(int));
+    if (!s->scratch || (m->implicit && !s->pivots)) {
+        printf("error: out of memory\n");
+        freeSolver(s, w);
+        return NULL;
+    }
+    // x, k[0], then xs and the later stages as far as used, then nominal,
+    // then the Jacobian and its factorization, then the dense output
+    s->x = s->scratch;
+    s->k[0] = s->x + nx;
+    if (m->nVectors > 2) {
+        s->xs = s->k[0] + nx;
+        for (i=1; i < m->nVectors - 2 - hasNominal; i++) s->k[i] = s->xs + i*nx;
+    }
+    if (hasNominal) s->nominal = s->scratch + (m->nVectors - 1) * nx;
+    if (m->implicit) {
+        s->jac = s->scratch + m->nVectors * nx;
+        s->lu = s->jac + (size_t)nx * nx;
+    }
+    if (nz > 0) {
+        s->x0 = s->scratch + m->nVectors * nx + (m->implicit ? 2 * (size_t)nx * nx : 0);
+        s->f0 = s->x0 + nx;
+        s->f1 = s->f0 + nx;
+        s->xi = s->f1 + nx;
+        s->zl = s->xi + nx;
+        s->zm = s->zl + nz;
+    }
+    return s;
+}
+
+// evaluate the derivatives f at time t and states x
+// returns 0 to indicate failure
+static int derivatives(Solver* s, double t, double* x, double* f) {
+    FMU* fmu = s->fmu;
+    fmiStatus fmiFlag = fmu->setTime(s->c, t);
+    if (fmiFlag > fmiWarning) return fmuError("could not set time");
+    fmiFlag = fmu->setContinuousStates(s->c, x, s->nx);
+    if (fmiFlag > fmiWarning) return fmuError("could not set states");
+    fmiFlag = fmu->getDerivatives(s->c, f, s->nx);
+    if (fmiFlag > fmiWarning) return fmuError("could not retrieve derivatives");
+    s->nDerivatives++;
+    return 1;
+}
+
+// one classical Runge-Kutta step of size dt from t, starting with the 
+// derivatives of the start of the step in s->k[0]. The new states are
+// returned in s->x. Returns 0 to indicate failure.
+static int rk4Step(Solver* s, double t, double dt) {
+    int i, nx = s->nx;
+    double *x = s->x, *xs = s->xs;
+    double *k1 = s->k[0], *k2 = s->k[1], *k3 = s->k[2], *k4 = s->k[3];
+    for (i=0; i<nx; i++) xs[i] = x[i] + 0.5*dt*k1[i];
+    if (!derivatives(s, t + 0.5*dt, xs, k2)) return 0;
+    for (i=0; i<nx; i++) xs[i] = x[i] + 0.5*dt*k2[i];
+    if (!derivatives(s, t + 0.5*dt, xs, k3)) return 0;
+    for (i=0; i<nx; i++) xs[i] = x[i] + dt*k3[i];
+    if (!derivatives(s, t + dt, xs, k4)) return 0;
+    for (i=0; i<nx; i++) x[i] += dt/6 * (k1[i] + 2*(k2[i] + k3[i]) + k4[i]);
+    return 1;
+}
+
+// weighted RMS norm of v, with weights from the tolerances, 
+// the state nominals and the states at both ends of the step
+static double errorNorm(Solver* s, double* v) {
+    int i, nx = s->nx;
+    double sum = 0;
+    for (i=0; i<nx; i++) {
+        double scale = s->options->absTol * fabs(s->nominal[i])
+                + s->options->relTol * fmax(fabs(s->x[i]), fabs(s->xs[i]));
+        double e = v[i] / scale;
+        sum += e*e;
+    }
+    return sqrt(sum / nx);
+}
+
+// initial step size guess as in Hairer, Norsett, Wanner: Solving ODE I
+static double initialStep(Solver* s, double dtMax) {
+    double d0, d1, h;
+    memcpy(s->xs, s->x, s->nx * sizeof(double));
+    d0 = errorNorm(s, s->x);
+    d1 = errorNorm(s, s->k[0]);
+    h = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+    return fmin(h, dtMax);
+}
+
+// Set the size of the next step after a step of size h was accepted with 
+// error e, for a method with the given error exponent. The step size is
+// not increased after a rejection, and not decreased if the step was only
+// cut short by the caller.
+static void proposeStep(Solver* s, double h, double e, int rejected, double exponent) {
+    double factor = e > 0 ? SAFETY * pow(e, -exponent) : FAC_MAX;
+    factor = fmin(rejected ? 1 : FAC_MAX, fmax(FAC_MIN, factor));
+    if (h < s->h) s->h = fmax(s->h, h * factor);
+    else s->h = h * factor;
+}
+
+// Dormand-Prince steps from t until one of size at most dtMax is accepted,
+// starting with the derivatives of the start of the step in s->k[0].
+// The new states are returned in s->x, their derivatives in s->k[0], 
+// and the size of the accepted step in *dt. Returns 0 to indicate failure.
+static int dopri5Step(Solver* s, double t, double dtMax, double* dt) {
+    int i, j, l, nx = s->nx;
+    double *x = s->x, *xs = s->xs, *err = s->k[1];
+    double *tmp, h, e;
+    int rejected = 0;
+
+    if (s->h <= 0) s->h = initialStep(s, dtMax);
+    for (;;) {
+        h = fmin(s->h, dtMax);
+        if (h <= 1e-14 * fmax(fabs(t), 1)) return fmuError("step size too small");
+        for (j=1; j<7; j++) {
+            for (i=0; i<nx; i++) {
+                double sum = 0;
+                for (l=0; l<j; l++) sum += dpA[j][l] * s->k[l][i];
+                xs[i] = x[i] + h*sum;
+            }
+            if (!derivatives(s, t + dpC[j]*h, xs, s->k[j])) return 0;
+        }
+        // xs holds the solution of order 5, k[6] its derivatives, 
+        // and k[1] is no longer needed and reused for the error estimate
+        for (i=0; i<nx; i++) {
+            double sum = 0;
+            for (l=0; l<7; l++) sum += dpE[l] * s->k[l][i];
+            err[i] = h*sum;
+        }
+        e = errorNorm(s, err);
+        if (e <= 1) break; // accept
+        s->nRejected++;
+        rejected = 1;
+        s->h = h * fmax(FAC_MIN, SAFETY * pow(e, -0.2));
+    }
+
+    proposeStep(s, h, e, rejected, 0.2);
+
+    // first same as last: the derivatives of the new states start the next step
+    tmp = s->x; s->x = s->xs; s->xs = tmp;
+    tmp = s->k[0]; s->k[0] = s->k[6]; s->k[6] = tmp;
+    *dt = h;
+    return 1;
+}
+
+// forward difference increment for state j
+static double increment(Solver* s, int j) {
+    return sqrt(DBL_EPSILON) * fmax(fabs(s->x[j]), fabs(s->nominal[j]));
+}
+
+// Approximate the Jacobian df/dx at time t and the states s->x with 
+// derivatives s->k[0] by forward differences, one column per evaluation.
+// s->jac holds the columns one after another. Returns 0 to indicate failure.
+static int denseJacobian(Solver* s, double t) {
+    int i, j, nx = s->nx;
+    double *x = s->x, *f0 = s->k[0], *xp = s->xs, *fp = s->k[4];
+    memcpy(xp, x, nx * sizeof(double));
+    for (j=0; j<nx; j++) {
+        double* column = s->jac + (size_t)j * nx;
+        xp[j] = x[j] + increment(s, j);
+        if (!derivatives(s, t, xp, fp)) return 0;
+        for (i=0; i<nx; i++) column[i] = (fp[i] - f0[i]) / (xp[j] - x[j]);
+        xp[j] = x[j];
+    }
+    return 1;
+}
+
+// As denseJacobian, but with one evaluation per group of columns 
+// of s->pattern. Entries outside the pattern are zero.
+static int coloredJacobian(Solver* s, double t) {
+    int c, k, l, nx = s->nx;
+    double *x = s->x, *f0 = s->k[0], *xp = s->xs, *fp = s->k[4];
+    JacobianPattern* p = s->pattern;
+    memcpy(xp, x, nx * sizeof(double));
+    memset(s->jac, 0, (size_t)nx * nx * sizeof(double));
+    for (c=0; c<p->nColors; c++) {
+        for (k=p->colorStart[c]; k<p->colorStart[c+1]; k++) {
+            int j = p->columns[k];
+            xp[j] = x[j] + increment(s, j);
+        }
+        if (!derivatives(s, t, xp, fp)) return 0;
+        for (k=p->colorStart[c]; k<p->colorStart[c+1]; k++) {
+            int j = p->columns[k];
+            double* column = s->jac + (size_t)j * nx;
+            for (l=p->colStart[j]; l<p->colStart[j+1]; l++) {
+                int i = p->rows[l];
+                column[i] = (fp[i] - f0[i]) / (xp[j] - x[j]);
+            }
+            xp[j] = x[j];
+        }
+    }
+    return 1;
+}
+
+// Mark in nonzero the entries of the rows not declared that are nonzero in 
+// the Jacobian at time t and the states xb with derivatives fb. nonzero 
+// holds the columns one after another. Returns 0 to indicate failure.
+static int probePattern(Solver* s, double t, double* xb, double* fb, 
+        unsigned char* nonzero, unsigned char* declared) {
+    int i, j, nx = s->nx;
+    double *xp = s->xs, *fp = s->k[4];
+    memcpy(xp, xb, nx * sizeof(double));
+    for (j=0; j<nx; j++) {
+        xp[j] = xb[j] + increment(s, j);
+        if (!derivatives(s, t, xp, fp)) return 0;
+        for (i=0; i<nx; i++) {
+            if (!declared[i] && fp[i] != fb[i]) nonzero[(size_t)j*nx + i] = 1;
+        }
+        xp[j] = xb[j];
+    }
+    return 1;
+}
+
+// Build s->pattern from the dependencies declared in the model description.
+// Rows of derivatives without declaration are dense, or, if probing is 
+// requested, have the nonzeros of the Jacobian at time t at the current 
+// states and at PROBE_STATES states offset from them. An entry that is zero 
+// by chance at one of these states, e.g. d(x*y)/dx while y is 0, is thus 
+// still found. Returns 0 to indicate failure.
+static int buildPattern(Solver* s, double t) {
+    int i, j, p, nDeclared, ok = 1, nx = s->nx;
+    double *xb = s->k[1], *fb = s->k[2];
+    unsigned char* nonzero = (unsigned char*)malloc((size_t)nx * nx);
+    unsigned char* declared = (unsigned char*)malloc(nx);
+    if (!nonzero || !declared) {
+        free(nonzero);
+        free(declared);
+        return fmuError("out of memory");
+    }
+    memset(nonzero, 1, (size_t)nx * nx);
+    nDeclared = declaredPattern(s->fmu->modelDescription, nx, nonzero, declared);
+    if (nDeclared < 0) memset(declared, 0, nx);
+    if (s->options->sparsity == probedSparsity && nDeclared < nx) {
+        for (i=0; i<nx; i++) {
+            if (declared[i]) continue;
+            for (j=0; j<nx; j++) nonzero[(size_t)j*nx + i] = 0;
+        }
+        ok = probePattern(s, t, s->x, s->k[0], nonzero, declared);
+        // the offsets differ between states, so that they do not cancel 
+        // in a difference of states
+        for (p=1; ok && p<=PROBE_STATES; p++) {
+            for (i=0; i<nx; i++) {
+                xb[i] = s->x[i] + p * PROBE_OFFSET * fabs(s->nominal[i]) * (1 + (i % 7) / 7.0);
+            }
+            ok = derivatives(s, t, xb, fb) && probePattern(s, t, xb, fb, nonzero, declared);
+        }
+    }
+    if (ok) s->pattern = newJacobianPattern(nx, nonzero);
+    free(nonzero);
+    free(declared);
+    return ok && s->pattern != NULL;
+}
+
+// Approximate the Jacobian df/dx at time t and the states s->x with 
+// derivatives s->k[0] by forward differences. s->jac holds the columns 
+// one after another. Returns 0 to indicate failure.
+static int jacobian(Solver* s, double t) {
+    if (s->options->sparsity != denseSparsity) {
+        if (!s->pattern && !buildPattern(s, t)) return 0;
+        if (!coloredJacobian(s, t)) return 0;
+    }
+    else if (!denseJacobian(s, t)) return 0;
+    s->nJacobians++;
+    s->jacFresh = 1;
+    s->luFactor = 0;
+    return 1;
+}
+
+// LU factorization of the n x n matrix a, stored by rows, in place,
+// with partial pivoting. Returns 0 if a is singular.
+static int luFactor(double* a, int n, int* pivots) {
+    int i, j, k;
+    for (k=0; k<n; k++) {
+        int p = k;
+        double* rowK;
+        for (i=k+1; i<n; i++) 
+            if (fabs(a[(size_t)i*n+k]) > fabs(a[(size_t)p*n+k])) p = i;
+        pivots[k] = p;
+        if (a[(size_t)p*n+k] == 0) return 0;
+        if (p != k) {
+            for (j=0; j<n; j++) {
+                double tmp = a[(size_t)k*n+j];
+                a[(size_t)k*n+j] = a[(size_t)p*n+j];
+                a[(size_t)p*n+j] = tmp;
+            }
+        }
+        rowK = a + (size_t)k*n;
+        for (i=k+1; i<n; i++) {
+            double* rowI = a + (size_t)i*n;
+            double l = rowI[k] /= rowK[k];
+            if (l != 0) for (j=k+1; j<n; j++) rowI[j] -= l * rowK[j];
+        }
+    }
+    return 1;
+}
+
+// solve a x = b in place of b, given the factorization of luFactor
+static void luSolve(const double* a, int n, const int* pivots, double* b) {
+    int i, j;
+    for (i=0; i<n; i++) {
+        double tmp = b[pivots[i]];
+        b[pivots[i]] = b[i];
+        b[i] = tmp;
+    }
+    for (i=1; i<n; i++) {
+        const double* row = a + (size_t)i*n;
+        for (j=0; j<i; j++) b[i] -= row[j] * b[j];
+    }
+    for (i=n-1; i>=0; i--) {
+        const double* row = a + (size_t)i*n;
+        for (j=i+1; j<n; j++) b[i] -= row[j] * b[j];
+        b[i] /= row[i];
+    }
+}
+
+// Factorize the iteration matrix I - dh*J of the Newton iteration,
+// unless the factorization for this dh and Jacobian is cached.
+// Returns 0 if the matrix is singular.
+static int factorize(Solver* s, double dh) {
+    int i, j, nx = s->nx;
+    if (s->luFactor == dh) return 1;
+    for (i=0; i<nx; i++) {
+        for (j=0; j<nx; j++) {
+            s->lu[(size_t)i*nx+j] = (i==j) - dh * s->jac[(size_t)j*nx+i];
+        }
+    }
+    s->nFactorizations++;
+    if (!luFactor(s->lu, nx, s->pivots)) {
+        s->luFactor = 0;
+        return 0;
+    }
+    s->luFactor = dh;
+    return 1;
+}
+
+// Solve z - dh*f(t, z) = r for z by a simplified Newton iteration,
+// starting with the guess in z, which is s->xs. Sets *converged to 0 if
+// the iteration failed to converge, which a fresh Jacobian or a smaller
+// step may cure. Returns 0 to indicate failure.
+static int newton(Solver* s, double t, double dh, double* r, int* converged) {
+    int i, n, nx = s->nx;
+    double *z = s->xs, *f = s->k[1], *delta = s->k[3];
+    double norm, normPre = 0;
+    *converged = 0;
+    if (!factorize(s, dh)) return 1; // singular
+    for (n=0; n<NEWTON_MAX; n++) {
+        if (!derivatives(s, t, z, f)) return 0;
+        for (i=0; i<nx; i++) delta[i] = r[i] - z[i] + dh * f[i];
+        luSolve(s->lu, nx, s->pivots, delta);
+        for (i=0; i<nx; i++) z[i] += delta[i];
+        norm = errorNorm(s, delta);
+        if (norm <= NEWTON_TOL) {
+            *converged = 1;
+            return 1;
+        }
+        if (n > 0 && norm > NEWTON_RATE * normPre) return 1; // diverges
+        normPre = norm;
+    }
+    return 1;
+}
+
+// Solve z - dh*f(t, z) = r as newton, but with a new Jacobian at the start
+// of the step if the one in use is older and the iteration fails.
+// Returns 0 to indicate failure.
+static int newtonRetry(Solver* s, double t0, double t, double dh, double* r,
+        double* guess, int* converged) {
+    int nx = s->nx;
+    memcpy(s->xs, guess, nx * sizeof(double));
+    if (!newton(s, t, dh, r, converged)) return 0;
+    if (*converged || s->jacFresh) return 1;
+    if (!jacobian(s, t0)) return 0;
+    memcpy(s->xs, guess, nx * sizeof(double));
+    return newton(s, t, dh, r, converged);
+}
+
+// one backward Euler step of size dt from t, starting with the derivatives
+// of the start of the step in s->k[0]. The new states are returned in s->x.
+// Returns 0 to indicate failure.
+static int beulerStep(Solver* s, double t, double dt) {
+    int i, converged, nx = s->nx;
+    double *x = s->x, *guess = s->k[2];
+    for (i=0; i<nx; i++) guess[i] = x[i] + dt * s->k[0][i];
+    if (!newtonRetry(s, t, t + dt, dt, x, guess, &converged)) return 0;
+    if (!converged) return fmuError("Newton iteration did not converge, try a smaller step size");
+    memcpy(x, s->xs, nx * sizeof(double));
+    return 1;
+}
+
+// TR-BDF2 steps from t until one of size at most dtMax is accepted,
+// starting with the derivatives of the start of the step in s->k[0]. 
+// The new states are returned in s->x and the size of the accepted step
+// in *dt. The error is estimated by the embedded method of order 3 of
+// Hosea and Shampine, filtered by the iteration matrix to stay bounded 
+// for stiff components. Returns 0 to indicate failure.
+static int trbdf2Step(Solver* s, double t, double dtMax, double* dt) {
+    int i, converged, nx = s->nx;
+    double *x = s->x, *f0 = s->k[0], *r = s->k[2], *err = s->k[3];
+    double *xg = s->k[5], *fg = s->k[6];
+    double h, e;
+    int rejected = 0, clipped;
+
+    if (s->h <= 0) s->h = initialStep(s, dtMax);
+    for (;;) {
+        h = fmin(s->h, dtMax);
+        if (h <= 1e-14 * fmax(fabs(t), 1)) return fmuError("step size too small");
+
+        // trapezoidal stage to t + GAMMA*h
+        for (i=0; i<nx; i++) {
+            r[i] = x[i] + D*h * f0[i];
+            xg[i] = x[i] + GAMMA*h * f0[i];
+        }
+        if (!newtonRetry(s, t, t + GAMMA*h, D*h, r, xg, &converged)) return 0;
+        if (converged) {
+            for (i=0; i<nx; i++) {
+                xg[i] = s->xs[i];
+                fg[i] = (xg[i] - r[i]) / (D*h);
+            }
+            // BDF2 stage to t + h, xg is no longer needed and takes the guess
+            for (i=0; i<nx; i++) {
+                r[i] = x[i] + W*h * (f0[i] + fg[i]);
+                xg[i] += (1 - GAMMA)*h * fg[i];
+            }
+            if (!newtonRetry(s, t, t + h, D*h, r, xg, &converged)) return 0;
+        }
+        if (converged) {
+            // s->xs holds the solution, estimate its error
+            for (i=0; i<nx; i++) {
+                double f1 = (s->xs[i] - r[i]) / (D*h);
+                err[i] = h * ((1 - 4*W)/3 * f0[i] + fg[i]/3 - 2*D/3 * f1);
+            }
+            luSolve(s->lu, nx, s->pivots, err);
+            e = errorNorm(s, err);
+            if (e <= 1) break; // accept
+            s->h = h * fmax(FAC_MIN, SAFETY * pow(e, -1.0/3));
+        }
+        else s->h = h / 4;
+        s->nRejected++;
+        rejected = 1;
+    }
+    // keep the step size, and with it the factorization, on small increases
+    clipped = h < s->h;
+    proposeStep(s, h, e, rejected, 1.0/3);
+    if (!clipped && s->h > h && s->h < 1.2*h) s->h = h;
+    memcpy(x, s->xs, nx * sizeof(double));
+    *dt = h;
+    return 1;
+}
+
+// Advance the model from time t, with the states currently set in the
+// model, to at most *tNext. On return, *tNext holds the time reached, 
+// which is less than requested if an adaptive solver took a smaller step.
+// The model is then set to this time and the states there.
+// Returns 0 to indicate failure.
+int solverStep(Solver* s, double t, double* tNext) {
+    FMU* fmu = s->fmu;
+    fmiStatus fmiFlag;
+    double dt = *tNext - t;
+    int i, nx = s->nx;
+
+    if (nx > 0) {
+        // get current state and derivatives, unless they are still
+        // known from the end of the previous step
+        if (!s->valid || s->options->method != dopri5Solver) {
+            fmiFlag = fmu->getContinuousStates(s->c, s->x, nx);
+            if (fmiFlag > fmiWarning) return fmuError("could not retrieve states");
+            fmiFlag = fmu->getDerivatives(s->c, s->k[0], nx);
+            if (fmiFlag > fmiWarning) return fmuError("could not retrieve derivatives");
+            s->nDerivatives++;
+        }
+        if (!s->valid && s->nominal) {
+            fmiFlag = fmu->getNominalContinuousStates(s->c, s->nominal, nx);
+            if (fmiFlag > fmiWarning) return fmuError("could not retrieve nominal values of states");
+            for (i=0; i<nx; i++) if (s->nominal[i] == 0) s->nominal[i] = 1;
+        }
+        s->valid = 1;
+
+        // keep the start of the step for the dense output
+        if (s->x0) {
+            memcpy(s->x0, s->x, nx * sizeof(double));
+            memcpy(s->f0, s->k[0], nx * sizeof(double));
+        }
+
+        // the Jacobian is computed at the start of the first step, 
+        // and later only when the Newton iteration fails to converge
+        s->jacFresh = 0;
+        if (s->jac && !s->nJacobians && !jacobian(s, t)) return 0;
+
+        switch (s->options->method) {
+            case eulerSolver:
+                for (i=0; i<nx; i++) s->x[i] += dt*s->k[0][i];
+                break;
+            case rk4Solver:
+                if (!rk4Step(s, t, dt)) return 0;
+                break;
+            case dopri5Solver:
+                if (!dopri5Step(s, t, dt, &dt)) return 0;
+                if (t + dt < *tNext) *tNext = t + dt;
+                break;
+            case beulerSolver:
+                if (!beulerStep(s, t, dt)) return 0;
+                break;
+            case trbdf2Solver:
+                if (!trbdf2Step(s, t, dt, &dt)) return 0;
+                if (t + dt < *tNext) *tNext = t + dt;
+                break;
+        }
+    }
+
+    s->t0 = t;
+    s->t1 = *tNext;
+    fmiFlag = fmu->setTime(s->c, *tNext);
+    if (fmiFlag > fmiWarning) return fmuError("could not set time");
+    if (nx > 0) {
+        fmiFlag = fmu->setContinuousStates(s->c, s->x, nx);
+        if (fmiFlag > fmiWarning) return fmuError("could not set states");
+    }
+    return 1; // success
+}
+
+// Set the model to time t in the last step, and to the states there 
+// given by cubic Hermite interpolation of the states and derivatives at 
+// both ends of the step. Returns 0 to indicate failure.
+static int interpolate(Solver* s, double t) {
+    FMU* fmu = s->fmu;
+    fmiStatus fmiFlag;
+    int i, nx = s->nx;
+    double dt = s->t1 - s->t0;
+    double u = (t - s->t0) / dt;
+    double h00 = (1 + 2*u) * (1 - u) * (1 - u);
+    double h10 = u * (1 - u) * (1 - u);
+    double h01 = u * u * (3 - 2*u);
+    double h11 = u * u * (u - 1);
+    for (i=0; i<nx; i++) {
+        s->xi[i] = h00 * s->x0[i] + h10 * dt * s->f0[i] 
+                 + h01 * s->x[i] + h11 * dt * s->f1[i];
+    }
+    fmiFlag = fmu->setTime(s->c, t);
+    if (fmiFlag > fmiWarning) return fmuError("could not set time");
+    if (nx > 0) {
+        fmiFlag = fmu->setContinuousStates(s->c, s->xi, nx);
+        if (fmiFlag > fmiWarning) return fmuError("could not set states");
+    }
+    return 1;
+}
+
+// Returns 1 if an event indicator changes sign from zl to zr
+static int crossed(const double* zl, const double* zr, int nz) {
+    int i;
+    for (i=0; i<nz; i++) if (zl[i] * zr[i] < 0) return 1;
+    return 0;
+}
+
+// Locate the first zero crossing of the event indicators in the last step,
+// given the indicators zPre at its start and z at its end, which change
+// sign. The Illinois variant of regula falsi narrows the interval around
+// the earliest crossing, with the states taken from the dense output. 
+// On return, *time and z hold the time right after the crossing and the
+// indicators there, and the model is set to this time and the states there.
+// Returns 0 to indicate failure.
+int solverLocateEvent(Solver* s, const double* zPre, double* z, double* time) {
+    FMU* fmu = s->fmu;
+    fmiStatus fmiFlag;
+    int i, n, nz = s->nz, side = 0;
+    double tl = s->t0, tr = s->t1, *zl = s->zl, *zr = z, *zm = s->zm;
+    double tol = EVENT_TOL * fmax(fabs(tr), 1);
+
+    // the derivatives at the end of the step
+    if (s->options->method == dopri5Solver) {
+        memcpy(s->f1, s->k[0], s->nx * sizeof(double));
+    }
+    else if (s->nx > 0) {
+        fmiFlag = fmu->getDerivatives(s->c, s->f1, s->nx);
+        if (fmiFlag > fmiWarning) return fmuError("could not retrieve derivatives");
+        s->nDerivatives++;
+    }
+
+    memcpy(zl, zPre, nz * sizeof(double));
+    for (n=0; n<EVENT_MAX && tr - tl > tol; n++) {
+        // earliest secant estimate of the crossings, kept inside the interval
+        double tm = tr;
+        for (i=0; i<nz; i++) {
+            if (zl[i] * zr[i] < 0) {
+                double ti = tr - zr[i] * (tr - tl) / (zr[i] - zl[i]);
+                if (ti < tm) tm = ti;
+            }
+        }
+        tm = fmin(fmax(tm, tl + tol/2), tr - tol/2);
+
+        if (!interpolate(s, tm)) return 0;
+        fmiFlag = fmu->getEventIndicators(s->c, zm, nz);
+        if (fmiFlag > fmiWarning) return fmuError("could not retrieve event indicators");
+        s->nEventIterations++;
+
+        // keep the part with the earliest crossing, and halve the 
+        // indicators at an end that is kept a second time in a row
+        if (crossed(zl, zm, nz)) {
+            tr = tm;
+            memcpy(zr, zm, nz * sizeof(double));
+            if (side == 1) for (i=0; i<nz; i++) zl[i] /= 2;
+            side = 1;
+        }
+        else {
+            tl = tm;
+            memcpy(zl, zm, nz * sizeof(double));
+            if (side == -1) for (i=0; i<nz; i++) zr[i] /= 2;
+            side = -1;
+        }
+    }
+
+    // end the step right after the crossing
+    if (tr < s->t1) {
+        if (!interpolate(s, tr)) return 0;
+        if (s->nx > 0) memcpy(s->x, s->xi, s->nx * sizeof(double));
+        s->t1 = tr;
+    }
+    else {
+        // z may be scaled, the model is not changed since the last step
+        fmiFlag = fmu->setTime(s->c, tr);
+        if (fmiFlag > fmiWarning) return fmuError("could not set time");
+        if (s->nx > 0) {
+            fmiFlag = fmu->setContinuousStates(s->c, s->x, s->nx);
+            if (fmiFlag > fmiWarning) return fmuError("could not set states");
+        }
+    }
+    fmiFlag = fmu->getEventIndicators(s->c, z, nz);
+    if (fmiFlag > fmiWarning) return fmuError("could not retrieve event indicators");
+    *time = tr;
+    return 1;
+}
+
+// Forget everything known about the model at the end of the last step.
+// Must be called after an event, which may change states and derivatives.
+void solverReset(Solver* s) {
+    s->valid = 0;
+}
+
+// Release the work vectors to w, the workspace of the calling thread
+void freeSolver(Solver* s, Workspace* w) {
+    if (!s) return;
+    workspaceFree(w, s->scratch, s->scratchSize);
+    workspaceFree(w, s->pivots, (s->nx + 1) * sizeof(int));
+    freeJacobianPattern(s->pattern);
+    free(s);
+}
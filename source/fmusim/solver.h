@@ -0,0 +1,79 @@
+/* -------------------------------------------------------------------------
+ * solver.h
+ * Numerical integration of the continuous states of a model exchange FMU.
+ * -------------------------------------------------------------------------*/
+
+#ifndef solver_h
+#define solver_h
+
+#include "main.h"
+#include "sparsity.h"
+#include "workspace.h"
+
+typedef enum {
+    eulerSolver,    // forward Euler, fixed step
+    rk4Solver,      // classical Runge-Kutta of order 4, fixed step
+    dopri5Solver,   // Dormand-Prince 5(4), adaptive step
+    beulerSolver,   // backward Euler, implicit, fixed step
+    trbdf2Solver    // TR-BDF2, implicit, adaptive step
+} SolverMethod;
+
+typedef enum {
+    denseSparsity,      // evaluate the Jacobian one column at a time
+    declaredSparsity,   // use the dependencies declared in the model description
+    probedSparsity      // as declared, and probe undeclared rows at the start
+} SparsityMode;
+
+typedef struct {
+    SolverMethod method;
+    SparsityMode sparsity;  // Jacobian evaluation of implicit solvers
+    double relTol;          // relative tolerance of adaptive and implicit solvers
+    double absTol;          // absolute tolerance, scaled by the state nominals
+} SolverOptions;
+
+typedef struct {
+    FMU* fmu;
+    fmiComponent c;
+    int nx;                 // number of continuous states
+    int nz;                 // number of event indicators
+    SolverOptions* options;
+    double* x;              // states at the start of the step
+    double* xs;             // states of the current stage
+    double* k[7];           // derivatives of the stages, k[0] at the start
+    double* nominal;        // nominal values of the states
+    double* jac;            // Jacobian df/dx of implicit methods, by columns
+    double* lu;             // LU factorization of I - luFactor*jac, by rows
+    int* pivots;            // row interchanges of the factorization
+    JacobianPattern* pattern; // NULL, or nonzeros of jac and their coloring
+    double* x0;             // states at the start of the last step
+    double* f0;             // derivatives at the start of the last step
+    double* f1;             // derivatives at the end of the last step
+    double* xi;             // states interpolated in the last step
+    double* zl;             // event indicators at the start of the interval
+    double* zm;             // event indicators inside the interval
+    double* scratch;        // single allocation holding the arrays above
+    size_t scratchSize;     // size of scratch in bytes
+    double t0, t1;          // start and end of the last step
+    double luFactor;        // factor of the cached factorization, 0 if none
+    int jacFresh;           // 1 if jac was computed at the start of this step
+    double h;               // proposed size of the next step, 0 if unknown
+    int valid;              // 0 if the model changed since the last step
+    int nDerivatives;       // number of calls of getDerivatives
+    int nRejected;          // number of rejected steps
+    int nJacobians;         // number of Jacobian evaluations
+    int nFactorizations;    // number of LU factorizations
+    int nEventIterations;   // number of evaluations to locate state events
+} Solver;
+
+int parseSolverMethod(const char* name, SolverMethod* method);
+const char* solverMethodName(SolverMethod method);
+int isAdaptive(SolverMethod method);
+int isImplicit(SolverMethod method);
+Solver* newSolver(FMU* fmu, fmiComponent c, int nx, int nz, SolverOptions* options,
+        Workspace* w);
+int solverStep(Solver* s, double t, double* tNext);
+int solverLocateEvent(Solver* s, const double* zPre, double* z, double* time);
+void solverReset(Solver* s);
+void freeSolver(Solver* s, Workspace* w);
+
+#endif // solver_h
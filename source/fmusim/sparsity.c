@@ -0,0 +1,156 @@
+/* -------------------------------------------------------------------------
+ * sparsity.c
+ * Sparsity pattern of the Jacobian df/dx of a model and a coloring of its
+ * columns for the evaluation by finite differences. Columns that have no
+ * nonzero in a common row are perturbed together, so that one evaluation
+ * of the derivatives yields all of them (Curtis, Powell and Reid 1974).
+ * For loosely coupled states, the number of groups is much smaller than
+ * the number of states.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sparsity.h"
+
+// FMI 1.0 has no link between the state vector and the model variables.
+// As generated by the usual tools, the i-th derivative 'der(x)' in the
+// list of model variables is taken to be the derivative of the i-th state,
+// which is the variable 'x'. Returns the length of the name of the state,
+// or 0 if name is no derivative.
+static int stateNameLength(const char* name) {
+    size_t n = strlen(name);
+    if (n < 6 || strncmp(name, "der(", 4) || name[n-1] != ')') return 0;
+    return (int)n - 5;
+}
+
+// Clear the rows of nonzero, an nx*nx matrix stored by columns, of all
+// derivatives that declare the states they depend on, and set the entries
+// of these states. A derivative declares its dependencies by a 
+// DirectDependency element listing the names of states, as FMI 1.0 does
+// for outputs and inputs. declared[i] is set to 1 for such rows, and 0
+// for the others, which are left unchanged. Returns the number of
+// declared rows, or -1 if the derivatives cannot be mapped to states.
+int declaredPattern(ModelDescription* md, int nx, unsigned char* nonzero,
+        unsigned char* declared) {
+    ScalarVariable** derivatives;
+    ScalarVariable** vars = md->modelVariables;
+    int i, j, k, n = 0, nDeclared = 0;
+    memset(declared, 0, nx);
+    if (!vars || nx == 0) return 0;
+    derivatives = (ScalarVariable**)calloc(nx, sizeof(ScalarVariable*));
+    if (!derivatives) return -1;
+    for (k=0; vars[k]; k++) {
+        if (vars[k]->baseType != elm_Real || getAlias(vars[k]) != enu_noAlias) continue;
+        if (!stateNameLength(getName(vars[k]))) continue;
+        if (n == nx) break;
+        derivatives[n++] = vars[k];
+    }
+    if (n != nx) {
+        free(derivatives);
+        return -1;
+    }
+    for (i=0; i<nx; i++) {
+        Element** names = derivatives[i]->directDependencies;
+        if (!names) continue;
+        for (j=0; j<nx; j++) nonzero[(size_t)j*nx + i] = 0;
+        for (k=0; names[k]; k++) {
+            const char* name = getString(names[k], att_input);
+            size_t len = strlen(name);
+            for (j=0; j<nx; j++) {
+                const char* der = getName(derivatives[j]);
+                if (stateNameLength(der) == (int)len && !strncmp(der + 4, name, len)) {
+                    nonzero[(size_t)j*nx + i] = 1;
+                }
+            }
+        }
+        declared[i] = 1;
+        nDeclared++;
+    }
+    free(derivatives);
+    return nDeclared;
+}
+
+// Build the pattern of the n*n matrix nonzero, stored by columns, and 
+// group its columns greedily in their natural order: a column joins the
+// first group that has no nonzero in one of its rows.
+// Returns NULL to indicate failure.
+JacobianPattern* newJacobianPattern(int n, const unsigned char* nonzero) {
+    int i, j, k, c, nnz = 0;
+    size_t m;
+    int *rowStart = NULL, *cols = NULL, *color = NULL, *mark = NULL, *fill;
+    JacobianPattern* p = (JacobianPattern*)calloc(1, sizeof(JacobianPattern));
+    if (!p) goto outOfMemory;
+    for (m=0; m<(size_t)n*n; m++) nnz += nonzero[m] != 0;
+    p->n = n;
+    p->nnz = nnz;
+    p->colStart = (int*)calloc(n + 1, sizeof(int));
+    p->rows = (int*)calloc(nnz + 1, sizeof(int));
+    p->colorStart = (int*)calloc(n + 1, sizeof(int));
+    p->columns = (int*)calloc(n + 1, sizeof(int));
+    rowStart = (int*)calloc(n + 1, sizeof(int));
+    cols = (int*)calloc(nnz + 1, sizeof(int));
+    color = (int*)calloc(n + 1, sizeof(int));
+    mark = (int*)calloc(n + 1, sizeof(int));
+    if (!p->colStart || !p->rows || !p->colorStart || !p->columns 
+            || !rowStart || !cols || !color || !mark) goto outOfMemory;
+
+    // the nonzeros by columns and by rows
+    for (j=0; j<n; j++) {
+        p->colStart[j+1] = p->colStart[j];
+        for (i=0; i<n; i++) {
+            if (!nonzero[(size_t)j*n + i]) continue;
+            p->rows[p->colStart[j+1]++] = i;
+            rowStart[i+1]++;
+        }
+    }
+    for (i=0; i<n; i++) rowStart[i+1] += rowStart[i];
+    fill = mark; // next free position in cols for each row
+    memcpy(fill, rowStart, n * sizeof(int));
+    for (j=0; j<n; j++) {
+        for (k=p->colStart[j]; k<p->colStart[j+1]; k++) cols[fill[p->rows[k]]++] = j;
+    }
+
+    // color the columns, mark[c] == j if color c is taken by a neighbor of j
+    for (c=0; c<n; c++) mark[c] = -1;
+    for (j=0; j<n; j++) {
+        for (k=p->colStart[j]; k<p->colStart[j+1]; k++) {
+            int r = p->rows[k], l;
+            for (l=rowStart[r]; l<rowStart[r+1] && cols[l]<j; l++) mark[color[cols[l]]] = j;
+        }
+        for (c=0; mark[c]==j; c++);
+        color[j] = c;
+        if (c == p->nColors) p->nColors++;
+    }
+
+    // the columns by colors
+    for (j=0; j<n; j++) p->colorStart[color[j]+1]++;
+    for (c=0; c<p->nColors; c++) p->colorStart[c+1] += p->colorStart[c];
+    fill = mark; // next free position in columns for each color
+    memcpy(fill, p->colorStart, p->nColors * sizeof(int));
+    for (j=0; j<n; j++) p->columns[fill[color[j]]++] = j;
+
+    free(rowStart);
+    free(cols);
+    free(color);
+    free(mark);
+    return p;
+
+outOfMemory:
+    printf("error: out of memory\n");
+    free(rowStart);
+    free(cols);
+    free(color);
+    free(mark);
+    freeJacobianPattern(p);
+    return NULL;
+}
+
+void freeJacobianPattern(JacobianPattern* p) {
+    if (!p) return;
+    free(p->colStart);
+    free(p->rows);
+    free(p->colorStart);
+    free(p->columns);
+    free(p);
+}
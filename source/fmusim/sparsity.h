@@ -0,0 +1,27 @@
+/* -------------------------------------------------------------------------
+ * sparsity.h
+ * Sparsity pattern of the Jacobian df/dx of a model and a coloring of its
+ * columns for the evaluation by finite differences.
+ * -------------------------------------------------------------------------*/
+
+#ifndef sparsity_h
+#define sparsity_h
+
+#include "xml_parser.h"
+
+typedef struct {
+    int n;              // number of rows and columns
+    int nnz;            // number of structural nonzeros
+    int* colStart;      // n+1 offsets into rows
+    int* rows;          // row indices of the nonzeros, by columns
+    int nColors;        // number of column groups
+    int* colorStart;    // nColors+1 offsets into columns
+    int* columns;       // column indices, by groups
+} JacobianPattern;
+
+int declaredPattern(ModelDescription* md, int nx, unsigned char* nonzero,
+        unsigned char* declared);
+JacobianPattern* newJacobianPattern(int n, const unsigned char* nonzero);
+void freeJacobianPattern(JacobianPattern* p);
+
+#endif // sparsity_h
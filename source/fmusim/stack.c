@@ -63,6 +63,17 @@ void** stackLastPopedAsArray0(Stack* s, int n){
     return array;
 }
 
+// copy the last n elements to the given array of size n+1
+// and terminate it with NULL. Returns array.
+void** stackLastPopedToArray0(Stack* s, int n, void** array){
+    int i;
+    for (i=0; i<n; i++) {
+        array[i] = s->stack[i+ s->stackPos + 1];
+    }
+    array[n]=NULL; // terminating NULL
+    return array;
+}
+
 // return stack as possibly empty array, or NULL if memory allocation fails
 // On sucessful return, the stack is empty.
 void** stackPopAllAsArray(Stack* s, int *size) {
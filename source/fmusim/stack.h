@@ -22,6 +22,7 @@ void* stackPeek(Stack* s);
 void* stackPop(Stack* s);
 void** stackPopAllAsArray(Stack* s, int *size);
 void** stackLastPopedAsArray0(Stack* s, int n);
+void** stackLastPopedToArray0(Stack* s, int n, void** array);
 void stackFree(Stack* s);
 
 #endif // STACK_H
@@ -0,0 +1,58 @@
+/* -------------------------------------------------------------------------
+ * workspace.c
+ * A cache of released work arrays of one thread. Simulations of the same
+ * model need arrays of the same sizes, so a thread that runs many of them
+ * allocates its arrays once. A NULL workspace allocates and frees directly.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "workspace.h"
+
+// Returns size bytes of zero-initialized memory, preferably the smallest 
+// cached array that is large enough, or NULL if out of memory
+void* workspaceAlloc(Workspace* w, size_t size) {
+    int i, best = -1;
+    void* p;
+    if (!w) return calloc(size > 0 ? size : 1, 1);
+    for (i=0; i<w->n; i++) {
+        if (w->sizes[i] >= size && (best < 0 || w->sizes[i] < w->sizes[best])) best = i;
+    }
+    if (best < 0) return calloc(size > 0 ? size : 1, 1);
+    p = w->blocks[best];
+    w->n--;
+    w->blocks[best] = w->blocks[w->n];
+    w->sizes[best] = w->sizes[w->n];
+    memset(p, 0, size);
+    return p;
+}
+
+// Release p, returned by workspaceAlloc of any workspace for size bytes,
+// to w for reuse. If w is full, its smallest array is freed instead.
+void workspaceFree(Workspace* w, void* p, size_t size) {
+    int i, smallest = 0;
+    if (!p) return;
+    if (!w) {
+        free(p);
+        return;
+    }
+    if (w->n < WORKSPACE_BLOCKS) {
+        w->blocks[w->n] = p;
+        w->sizes[w->n] = size;
+        w->n++;
+        return;
+    }
+    for (i=1; i<w->n; i++) if (w->sizes[i] < w->sizes[smallest]) smallest = i;
+    if (w->sizes[smallest] >= size) {
+        free(p);
+        return;
+    }
+    free(w->blocks[smallest]);
+    w->blocks[smallest] = p;
+    w->sizes[smallest] = size;
+}
+
+// free all cached arrays
+void workspaceClear(Workspace* w) {
+    while (w->n > 0) free(w->blocks[--w->n]);
+}
@@ -0,0 +1,24 @@
+/* -------------------------------------------------------------------------
+ * workspace.h
+ * A cache of released work arrays of one thread, for reuse by the next 
+ * simulations on that thread.
+ * -------------------------------------------------------------------------*/
+
+#ifndef workspace_h
+#define workspace_h
+
+#include <stddef.h>
+
+#define WORKSPACE_BLOCKS 16 // maximal number of cached arrays
+
+typedef struct {
+    int n;                              // number of cached arrays
+    void* blocks[WORKSPACE_BLOCKS];     // the cached arrays
+    size_t sizes[WORKSPACE_BLOCKS];     // their sizes in bytes
+} Workspace;
+
+void* workspaceAlloc(Workspace* w, size_t size);
+void workspaceFree(Workspace* w, void* p, size_t size);
+void workspaceClear(Workspace* w);
+
+#endif // workspace_h
@@ -22,6 +22,8 @@
 #include <string.h>
 #include "xml_parser.h"
 
+#define ARENA_BLOCKSIZE 65536 // size of the first arena block of an AST
+
 const char *elmNames[SIZEOF_ELM] = { 
     "fmiModelDescription","UnitDefinitions","BaseUnit","DisplayUnitDefinition","TypeDefinitions",
     "Type","RealType","IntegerType","BooleanType","StringType","EnumerationType","Item",
@@ -43,12 +45,6 @@ const char *enuNames[SIZEOF_ENU] = {
 };
 
 #define ANY_TYPE -1
-#define XMLBUFSIZE 1024
-char text[XMLBUFSIZE];       // XML file is parsed in chunks of length XMLBUFZIZE
-XML_Parser parser = NULL;    // non-NULL during parsing
-Stack* stack = NULL;         // the parser stack
-char* data = NULL;           // buffer that holds element content, see handleData
-int skipData=0;              // 1 to ignore element content, 0 when recordig content
 
 // ------------------------------------------------------------------------- 
 // Low-level functions for inspecting the model description 
@@ -98,7 +94,7 @@ char getBoolean(void* element, Att a, ValueStatus* vs){
     return 0;
 }
 
-static int checkEnumValue(const char* enu);
+static int checkEnumValue(ParserContext* ctx, const char* enu);
 
 // Retrieve the value of the given built-in enum attribute.
 // If the value is missing, this is marked in the ValueStatus
@@ -118,7 +114,7 @@ Enu getEnumValue(void* element, Att a, ValueStatus* vs) {
             default: return -1;
         }
     }
-    id = checkEnumValue(value);
+    id = checkEnumValue(NULL, value);
     if (id==-1) *vs = valueIllegal; 
     return id;
 }
@@ -158,6 +154,8 @@ const char* getName(void* element) {
 // if value is missing, the default internal is returned
 Enu getCausality(void* scalarVariable) {
     ValueStatus vs;
+    ScalarVariable* sv = (ScalarVariable*)scalarVariable;
+    if (sv->decoded) return sv->causality;
     return getEnumValue(scalarVariable, att_causality, &vs);
 }
 
@@ -165,6 +163,8 @@ Enu getCausality(void* scalarVariable) {
 // if value is missing, the default continuous is returned
 Enu getVariability(void* scalarVariable) {
     ValueStatus vs;
+    ScalarVariable* sv = (ScalarVariable*)scalarVariable;
+    if (sv->decoded) return sv->variability;
     return getEnumValue(scalarVariable, att_variability, &vs);
 }
 
@@ -172,6 +172,8 @@ Enu getVariability(void* scalarVariable) {
 // if value is missing, the default noAlias is returned 
 Enu getAlias(void* scalarVariable) {
     ValueStatus vs;
+    ScalarVariable* sv = (ScalarVariable*)scalarVariable;
+    if (sv->decoded) return sv->alias;
     return getEnumValue(scalarVariable, att_alias, &vs);
 }
 
@@ -180,15 +182,163 @@ Enu getAlias(void* scalarVariable) {
 // here, i means integer or enumeration
 fmiValueReference getValueReference(void* scalarVariable) {
     ValueStatus vs;
-    fmiValueReference vr = getUInt(scalarVariable, att_valueReference, &vs);
-    assert(((Element*)scalarVariable)->type == elm_ScalarVariable);
+    fmiValueReference vr;
+    ScalarVariable* sv = (ScalarVariable*)scalarVariable;
+    assert(sv->type == elm_ScalarVariable);
+    if (sv->decoded) return sv->vr;
+    vr = getUInt(scalarVariable, att_valueReference, &vs);
     assert(vs==valueDefined); // this is a reqired attribute
     return vr;
 }
 
+// ------------------------------------------------------------------------- 
+// Hash index for variable and type lookup
+
+static unsigned int hashVr(Elm type, fmiValueReference vr) {
+    return (vr ^ ((unsigned int)type << 27)) * 2654435761u;
+}
+
+// FNV-1a
+static unsigned int hashName(const char* name) {
+    unsigned int h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Enumeration and Integer share the value references of base type Integer
+static Elm baseType(Elm type) {
+    return type==elm_Enumeration ? elm_Integer : type;
+}
+
+static Elm getBaseType(ScalarVariable* sv) {
+    return sv->decoded ? sv->baseType : baseType(sv->typeSpec->type);
+}
+
+// smallest power of 2 that is at least twice n
+static int tableSize(int n) {
+    int size = 8;
+    while (size < 2*n) size *= 2;
+    return size;
+}
+
+// Returns 0 to indicate failure (out of memory)
+// Build the type part of md->index in the arena of md. If a name occurs 
+// more than once, the first occurrence is indexed, as found by a linear search.
+static int buildTypeIndex(ModelDescription* md) {
+    int i, n = 0, nt = 0;
+    unsigned int mask, h;
+    VariableIndex* index = (VariableIndex*)arenaAlloc(md->arena, sizeof(VariableIndex));
+    if (!index) return 0;
+    if (md->modelVariables) while (md->modelVariables[n]) n++;
+    if (md->typeDefinitions) while (md->typeDefinitions[nt]) nt++;
+    index->size = tableSize(n);
+    index->typesSize = tableSize(nt);
+    index->byVr = (ScalarVariable**)arenaAlloc(md->arena, index->size * sizeof(ScalarVariable*));
+    index->byName = (ScalarVariable**)arenaAlloc(md->arena, index->size * sizeof(ScalarVariable*));
+    index->types = (Type**)arenaAlloc(md->arena, index->typesSize * sizeof(Type*));
+    if (!index->byVr || !index->byName || !index->types) return 0;
+    mask = index->typesSize - 1;
+    for (i=0; i<nt; i++) {
+        Type* tp = md->typeDefinitions[i];
+        const char* name = getString(tp, att_name);
+        if (!name) continue;
+        for (h=hashName(name) & mask; index->types[h]; h=(h+1) & mask)
+            if (!strcmp(getName(index->types[h]), name)) break;
+        if (!index->types[h]) index->types[h] = tp;
+    }
+    md->index = index;
+    return 1; // success
+}
+
+// Fill the variable part of md->index, after buildTypeIndex and 
+// decodeVariables. If a key occurs more than once, the first
+// occurrence is indexed, as found by a linear search.
+static void buildVariableIndex(ModelDescription* md) {
+    int i;
+    VariableIndex* index = md->index;
+    unsigned int mask = index->size - 1;
+    unsigned int h;
+    if (!md->modelVariables) return;
+    for (i=0; md->modelVariables[i]; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        const char* name = getString(sv, att_name);
+        if (name) {
+            for (h=hashName(name) & mask; index->byName[h]; h=(h+1) & mask)
+                if (!strcmp(getName(index->byName[h]), name)) break;
+            if (!index->byName[h]) index->byName[h] = sv;
+        }
+        if (sv->vr!=fmiUndefinedValueReference && sv->typeSpec) {
+            for (h=hashVr(sv->baseType, sv->vr) & mask; index->byVr[h]; h=(h+1) & mask) {
+                ScalarVariable* other = index->byVr[h];
+                if (other->baseType==sv->baseType && other->vr==sv->vr) break;
+            }
+            if (!index->byVr[h]) index->byVr[h] = sv;
+        }
+    }
+}
+
+// Decode the attributes of all variables into the typed fields of
+// ScalarVariable, after buildTypeIndex, so that declared types are found
+// quickly. Illegal values are reported and treated like missing values.
+static void decodeVariables(ModelDescription* md) {
+    int i;
+    if (!md->modelVariables) return;
+    for (i=0; md->modelVariables[i]; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        Element* ts = sv->typeSpec;
+        ValueStatus vs;
+        sv->vr = getUInt(sv, att_valueReference, &vs);
+        if (vs!=valueDefined) sv->vr = fmiUndefinedValueReference;
+        sv->causality = getEnumValue(sv, att_causality, &vs);
+        sv->variability = getEnumValue(sv, att_variability, &vs);
+        sv->alias = getEnumValue(sv, att_alias, &vs);
+        sv->defined = 0;
+        if (ts) {
+            sv->baseType = baseType(ts->type);
+            if (sv->baseType==elm_Boolean) {
+                sv->start = getBoolean(ts, att_start, &vs);
+                if (vs==valueDefined) sv->defined |= hasStart;
+            }
+            else if (sv->baseType!=elm_String) {
+                const char* value;
+                sv->start = getDouble(ts, att_start, &vs);
+                if (vs==valueDefined) sv->defined |= hasStart;
+                value = getString2(md, ts, att_min);
+                if (value && 1==sscanf(value, "%lf", &sv->min)) sv->defined |= hasMin;
+                value = getString2(md, ts, att_max);
+                if (value && 1==sscanf(value, "%lf", &sv->max)) sv->defined |= hasMax;
+                if (sv->baseType==elm_Real) {
+                    value = getString2(md, ts, att_nominal);
+                    if (value && 1==sscanf(value, "%lf", &sv->nominal)) sv->defined |= hasNominal;
+                }
+            }
+        }
+        sv->decoded = 1;
+    }
+}
+
+// Returns 0 to indicate failure (out of memory)
+// Builds md->index for an AST whose variables are decoded already,
+// such as one loaded from a binary cache, see mdcache.c
+int indexModelDescription(ModelDescription* md) {
+    if (!buildTypeIndex(md)) return 0;
+    buildVariableIndex(md);
+    return 1; // success
+}
+
 // the name is unique within a fmu
 ScalarVariable* getVariableByName(ModelDescription* md, const char* name) {
     int i;
+    if (md->index) {
+        unsigned int mask = md->index->size - 1;
+        unsigned int h;
+        for (h=hashName(name) & mask; md->index->byName[h]; h=(h+1) & mask)
+            if (!strcmp(getName(md->index->byName[h]), name)) return md->index->byName[h];
+        return NULL;
+    }
     if (md->modelVariables)
     for (i=0; md->modelVariables[i]; i++){
         ScalarVariable* sv = (ScalarVariable*)md->modelVariables[i];
@@ -208,7 +358,18 @@ int sameBaseType(Elm t1, Elm t2){
 // returns NULL if variable not found or vr==fmiUndefinedValueReference
 ScalarVariable* getVariable(ModelDescription* md, fmiValueReference vr, Elm type){
     int i;
-    if (md->modelVariables && vr!=fmiUndefinedValueReference)
+    if (vr==fmiUndefinedValueReference) return NULL;
+    if (md->index) {
+        unsigned int mask = md->index->size - 1;
+        unsigned int h;
+        type = baseType(type);
+        for (h=hashVr(type, vr) & mask; md->index->byVr[h]; h=(h+1) & mask) {
+            ScalarVariable* sv = md->index->byVr[h];
+            if (getBaseType(sv)==type && getValueReference(sv)==vr) return sv;
+        }
+        return NULL;
+    }
+    if (md->modelVariables)
     for (i=0; md->modelVariables[i]; i++){
         ScalarVariable* sv = (ScalarVariable*)md->modelVariables[i];
         if (sameBaseType(type, sv->typeSpec->type) && getValueReference(sv) == vr) 
@@ -219,6 +380,13 @@ ScalarVariable* getVariable(ModelDescription* md, fmiValueReference vr, Elm type
 
 Type* getDeclaredType(ModelDescription* md, const char* declaredType){
     int i;
+    if (declaredType && md->index) {
+        unsigned int mask = md->index->typesSize - 1;
+        unsigned int h;
+        for (h=hashName(declaredType) & mask; md->index->types[h]; h=(h+1) & mask)
+            if (!strcmp(getName(md->index->types[h]), declaredType)) return md->index->types[h];
+        return NULL;
+    }
     if (declaredType && md->typeDefinitions)
     for (i=0; md->typeDefinitions[i]; i++){
         Type* tp = (Type*)md->typeDefinitions[i];
@@ -277,7 +445,10 @@ double getVariableAttributeDouble(ModelDescription* md,
 // Return 1, if no nominal value is defined.
 double getNominal(ModelDescription* md, fmiValueReference vr){
     ValueStatus vs;
-    double nominal = getVariableAttributeDouble(md, vr, elm_Real, att_nominal, &vs);
+    double nominal;
+    ScalarVariable* sv = getVariable(md, vr, elm_Real);
+    if (sv && sv->decoded) return (sv->defined & hasNominal) ? sv->nominal : 1.0;
+    nominal = getVariableAttributeDouble(md, vr, elm_Real, att_nominal, &vs);
     return vs==valueDefined ? nominal : 1.0;
 }
 
@@ -285,72 +456,73 @@ double getNominal(ModelDescription* md, fmiValueReference vr){
 // Various checks that log an error and stop the parser 
 
 // Returns 0 to indicate error
-static int checkPointer(const void* ptr){
+static int checkPointer(ParserContext* ctx, const void* ptr){
     if (! ptr) {
         printf("Out of memory\n");
-        if (parser) XML_StopParser(parser, XML_FALSE);
+        if (ctx) XML_StopParser(ctx->parser, XML_FALSE);
         return 0; // error 
     }
     return 1; // success
 }
 
-static int checkName(const char* name, const char* kind, const char* array[], int n){
+// ctx is NULL when called after parsing, e.g. from getEnumValue
+static int checkName(ParserContext* ctx, const char* name, const char* kind, const char* array[], int n){
     int i;
     for (i=0; i<n; i++) {
         if (!strcmp(name, array[i])) return i;
     }
     printf("Illegal %s %s\n", kind, name);
-    XML_StopParser(parser, XML_FALSE);
+    if (ctx) XML_StopParser(ctx->parser, XML_FALSE);
     return -1;
 }
 
 // Returns -1 to indicate error
-static int checkElement(const char* elm){
-    return checkName(elm, "element", elmNames, SIZEOF_ELM);
+static int checkElement(ParserContext* ctx, const char* elm){
+    return checkName(ctx, elm, "element", elmNames, SIZEOF_ELM);
 }
 
 // Returns -1 to indicate error
-static int checkAttribute(const char* att){
-    return checkName(att, "attribute", attNames, SIZEOF_ATT);
+static int checkAttribute(ParserContext* ctx, const char* att){
+    return checkName(ctx, att, "attribute", attNames, SIZEOF_ATT);
 }
 
 // Returns -1 to indicate error
-static int checkEnumValue(const char* enu){
-    return checkName(enu, "enum value", enuNames, SIZEOF_ENU);
+static int checkEnumValue(ParserContext* ctx, const char* enu){
+    return checkName(ctx, enu, "enum value", enuNames, SIZEOF_ENU);
 }
 
-static void logFatalTypeError(const char* expected, Elm found) {
+static void logFatalTypeError(ParserContext* ctx, const char* expected, Elm found) {
     printf("Wrong element type, expected %s, found %s\n", 
             expected, elmNames[found]);
-    XML_StopParser(parser, XML_FALSE);
+    XML_StopParser(ctx->parser, XML_FALSE);
 }
 
 // Returns 0 to indicate error
 // Verify that Element elm is of the given type
-static int checkElementType(void* element, Elm e) {
+static int checkElementType(ParserContext* ctx, void* element, Elm e) {
     Element* elm = (Element* )element;
     if (elm->type == e) return 1; // success
-    logFatalTypeError(elmNames[e], elm->type);
+    logFatalTypeError(ctx, elmNames[e], elm->type);
     return 0; // error    
 }
 
 // Returns 0 to indicate error
 // Verify that the next stack element exists and is of the given type
 // If e==ANY_TYPE, the type check is ommited 
-static int checkPeek(Elm e) {
-    if (stackIsEmpty(stack)){
+static int checkPeek(ParserContext* ctx, Elm e) {
+    if (stackIsEmpty(ctx->stack)){
         printf("Illegal document structure, expected %s\n", elmNames[e]);
-        XML_StopParser(parser, XML_FALSE);
+        XML_StopParser(ctx->parser, XML_FALSE);
         return 0; // error
     }
-    return e==ANY_TYPE ? 1 : checkElementType(stackPeek(stack), e);
+    return e==ANY_TYPE ? 1 : checkElementType(ctx, stackPeek(ctx->stack), e);
 }
 
 // Returns NULL to indicate error
 // Get the next stack element, it is of the given type.
 // If e==ANY_TYPE, the type check is ommited 
-static void* checkPop(Elm e){
-    return checkPeek(e) ? stackPop(stack) : NULL;
+static void* checkPop(ParserContext* ctx, Elm e){
+    return checkPeek(ctx, e) ? stackPop(ctx->stack) : NULL;
 }
 
 // ------------------------------------------------------------------------- 
@@ -378,25 +550,71 @@ AstNodeType getAstNodeType(Elm e){
     }
 }
 
+// Returns NULL to indicate error
+// Returns a copy of the first n chars of value in the arena.
+// Equal values are stored only once: many attributes share
+// values such as "true", "parameter" or "1".
+static const char* intern(ParserContext* ctx, const char* value, int n) {
+    unsigned int h = 2166136261u; // FNV-1a
+    unsigned int mask;
+    const char* copy;
+    int i;
+    for (i=0; i<n; i++) {
+        h ^= (unsigned char)value[i];
+        h *= 16777619u;
+    }
+    if (2 * (ctx->internCount + 1) > ctx->internSize) {
+        // grow and rehash the table of interned strings
+        int size = ctx->internSize ? 2 * ctx->internSize : 1024;
+        const char** table = (const char**)calloc(size, sizeof(char*));
+        if (!table) return NULL;
+        for (i=0; i<ctx->internSize; i++) {
+            const char* v = ctx->internTable[i];
+            unsigned int k = 2166136261u;
+            const char* p;
+            if (!v) continue;
+            for (p=v; *p; p++) {
+                k ^= (unsigned char)*p;
+                k *= 16777619u;
+            }
+            for (k &= size - 1; table[k]; k = (k+1) & (size - 1));
+            table[k] = v;
+        }
+        free((void*)ctx->internTable);
+        ctx->internTable = table;
+        ctx->internSize = size;
+    }
+    mask = ctx->internSize - 1;
+    for (h &= mask; ctx->internTable[h]; h = (h+1) & mask) {
+        copy = ctx->internTable[h];
+        if (!strncmp(copy, value, n) && copy[n]=='\0') return copy;
+    }
+    copy = arenaStrndup(ctx->arena, value, n);
+    if (!copy) return NULL;
+    ctx->internTable[h] = copy;
+    ctx->internCount++;
+    return copy;
+}
+
 // Returns 0 to indicate error
-// Copies the attr array and all values.
+// Copies the attr array and all values to the arena.
 // Replaces all attribute names by constant literal strings.
 // Converts the null-terminated array into an array of known size n.
-int addAttributes(Element* el, const char** attr) {
+int addAttributes(ParserContext* ctx, Element* el, const char** attr) {
     int n, a;
     const char** att = NULL;
     for (n=0; attr[n]; n+=2);
     if (n>0) {
-        att = calloc(n, sizeof(char*));
-        if (!checkPointer(att)) return 0;
+        att = arenaAlloc(ctx->arena, n * sizeof(char*));
+        if (!checkPointer(ctx, att)) return 0;
     } 
     for (n=0; attr[n]; n+=2) {
-        char* value = strdup(attr[n+1]);
-        if (!checkPointer(value)) return 0;
-        a = checkAttribute(attr[n]);
+        const char* value = intern(ctx, attr[n+1], strlen(attr[n+1]));
+        if (!checkPointer(ctx, value)) return 0;
+        a = checkAttribute(ctx, attr[n]);
         if (a == -1) return 0;  // illegal attribute error
         att[n  ] = attNames[a]; // no heap memory
-        att[n+1] = value;       // heap memory
+        att[n+1] = value;       // arena memory
     }
     el->attributes = att; // NULL if n=0
     el->n = n;
@@ -404,13 +622,13 @@ int addAttributes(Element* el, const char** attr) {
 }
 
 // Returns NULL to indicate error
-Element* newElement(Elm type, int size, const char** attr) {
-    Element* e = (Element*)calloc(1, size);
-    if (!checkPointer(e)) return NULL; 
+Element* newElement(ParserContext* ctx, Elm type, int size, const char** attr) {
+    Element* e = (Element*)arenaAlloc(ctx->arena, size);
+    if (!checkPointer(ctx, e)) return NULL; 
     e->type = type;
     e->attributes = NULL;
     e->n=0;
-    if (!addAttributes(e, attr)) return NULL;
+    if (!addAttributes(ctx, e, attr)) return NULL;
     return e;
 }
 
@@ -419,12 +637,13 @@ Element* newElement(Elm type, int size, const char** attr) {
 
 // Create and push a new element node
 static void XMLCALL startElement(void *context, const char *elm, const char **attr) {
+    ParserContext* ctx = (ParserContext*)context;
     Elm el;
     void* e;
     int size;
-    el = checkElement(elm);
+    el = checkElement(ctx, elm);
     if (el==-1) return; // error
-    skipData = (el != elm_Name); // skip element content for all elements but Name
+    ctx->skipData = (el != elm_Name); // skip element content for all elements but Name
     switch(getAstNodeType(el)){
         case astElement:          size = sizeof(Element); break;
         case astListElement:      size = sizeof(ListElement); break;
@@ -433,24 +652,26 @@ static void XMLCALL startElement(void *context, const char *elm, const char **at
         case astModelDescription: size = sizeof(ModelDescription); break;
 		default: assert(0);
     }
-    e = newElement(el, size, attr);
-    checkPointer(e); 
-    stackPush(stack, e);
+    e = newElement(ctx, el, size, attr);
+    checkPointer(ctx, e); 
+    stackPush(ctx->stack, e);
 }
 
 // Pop all elements of the given type from stack and 
 // add it to the ListElement that follows.
 // The ListElement remains on the stack.
-static void popList(Elm e) {
+static void popList(ParserContext* ctx, Elm e) {
     int n = 0;
     Element** array;
-    Element* elm = stackPop(stack);
+    Element* elm = stackPop(ctx->stack);
     while (elm->type == e) {
-        elm = stackPop(stack);
+        elm = stackPop(ctx->stack);
         n++;
     }
-    stackPush(stack, elm); // push ListElement back to stack
-    array = (Element**)stackLastPopedAsArray0(stack, n); // NULL terminated list
+    stackPush(ctx->stack, elm); // push ListElement back to stack
+    array = (Element**)arenaAlloc(ctx->arena, (n + 1) * sizeof(Element*));
+    if (!checkPointer(ctx, array)) return; // failure
+    stackLastPopedToArray0(ctx->stack, n, (void**)array); // NULL terminated list
     if (getAstNodeType(elm->type)!=astListElement) return; // failure
     ((ListElement*)elm)->list = array;
     return; // success only if list!=NULL    
@@ -459,8 +680,9 @@ static void popList(Elm e) {
 // Pop the children from the stack and
 // check for correct type and sequence of children
 static void XMLCALL endElement(void *context, const char *elm) {
+    ParserContext* ctx = (ParserContext*)context;
     Elm el;
-    el = checkElement(elm);
+    el = checkElement(ctx, elm);
     switch(el) {        
         case elm_fmiModelDescription: 
             {
@@ -472,53 +694,49 @@ static void XMLCALL endElement(void *context, const char *elm) {
                  ScalarVariable** mv = NULL;  // NULL or list of ScalarVariable
                  ListElement* child;
 
-                 child = checkPop(ANY_TYPE);
+                 child = checkPop(ctx, ANY_TYPE);
                  if (child->type == elm_ModelVariables){
                      mv = (ScalarVariable**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ctx, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_VendorAnnotations){
                      va = (ListElement**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ctx, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_DefaultExperiment){
                      de = (Element*)child;
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ctx, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_TypeDefinitions){
                      td = (Type**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ctx, ANY_TYPE);
                      if (!child) return;
                  }
                  if (child->type == elm_UnitDefinitions){
                      ud = (ListElement**)child->list;
-                     free(child);
-                     child = checkPop(ANY_TYPE);
+                     child = checkPop(ctx, ANY_TYPE);
                      if (!child) return;
                  }
-                 if (!checkElementType(child, elm_fmiModelDescription)) return;
+                 if (!checkElementType(ctx, child, elm_fmiModelDescription)) return;
                  md = (ModelDescription*)child;
                  md->modelVariables = mv;
                  md->vendorAnnotations = va;
                  md->defaultExperiment = de;
                  md->typeDefinitions = td;
                  md->unitDefinitions = ud;
-                 stackPush(stack, md);
+                 stackPush(ctx->stack, md);
                  break;
             }
         case elm_Type:
             {
                 Type* tp;
-                Element* ts = checkPop(ANY_TYPE);
+                Element* ts = checkPop(ctx, ANY_TYPE);
                 if (!ts) return;
-                if (!checkPeek(elm_Type)) return;
-                tp = (Type*)stackPeek(stack);
+                if (!checkPeek(ctx, elm_Type)) return;
+                tp = (Type*)stackPeek(ctx->stack);
                 switch (ts->type) {
                     case elm_RealType:
                     case elm_IntegerType:
@@ -526,7 +744,7 @@ static void XMLCALL endElement(void *context, const char *elm) {
                     case elm_EnumerationType:
                         break;
                     deaullt:
-                         logFatalTypeError("RealType or similar", ts->type);
+                         logFatalTypeError(ctx, "RealType or similar", ts->type);
                          return;
                 }
                 tp->typeSpec = ts;
@@ -536,16 +754,15 @@ static void XMLCALL endElement(void *context, const char *elm) {
             {
                 ScalarVariable* sv;
                 Element** list = NULL;
-                Element* child = checkPop(ANY_TYPE);
+                Element* child = checkPop(ctx, ANY_TYPE);
                 if (!child) return;
                 if (child->type==elm_DirectDependency){
                     list = ((ListElement*)child)->list;
-                    free(child);
-                    child = checkPop(ANY_TYPE);
+                    child = checkPop(ctx, ANY_TYPE);
                     if (!child) return;
                 }
-                if (!checkPeek(elm_ScalarVariable)) return;
-                sv = (ScalarVariable*)stackPeek(stack);
+                if (!checkPeek(ctx, elm_ScalarVariable)) return;
+                sv = (ScalarVariable*)stackPeek(ctx->stack);
                 switch (child->type) {
                     case elm_Real:
                     case elm_Integer:
@@ -553,34 +770,39 @@ static void XMLCALL endElement(void *context, const char *elm) {
                     case elm_Enumeration:
                         break;
                     deault:
-                         logFatalTypeError("Real or similar", child->type);
+                         logFatalTypeError(ctx, "Real or similar", child->type);
                          return;
                 }
                 sv->directDependencies = list;
                 sv->typeSpec = child;
                 break;
             }
-        case elm_ModelVariables:    popList(elm_ScalarVariable); break;
-        case elm_VendorAnnotations: popList(elm_Tool);break;
-        case elm_Tool:              popList(elm_Annotation); break;
-        case elm_TypeDefinitions:   popList(elm_Type); break;
-        case elm_EnumerationType:   popList(elm_Item); break;
-        case elm_UnitDefinitions:   popList(elm_BaseUnit); break;
-        case elm_BaseUnit:          popList(elm_DisplayUnitDefinition); break;
-        case elm_DirectDependency:  popList(elm_Name); break;
+        case elm_ModelVariables:    popList(ctx, elm_ScalarVariable); break;
+        case elm_VendorAnnotations: popList(ctx, elm_Tool);break;
+        case elm_Tool:              popList(ctx, elm_Annotation); break;
+        case elm_TypeDefinitions:   popList(ctx, elm_Type); break;
+        case elm_EnumerationType:   popList(ctx, elm_Item); break;
+        case elm_UnitDefinitions:   popList(ctx, elm_BaseUnit); break;
+        case elm_BaseUnit:          popList(ctx, elm_DisplayUnitDefinition); break;
+        case elm_DirectDependency:  popList(ctx, elm_Name); break;
         case elm_Name:
             {
                  // Exception: the name value is represented as element content.
                  // All other values of the XML file are represented using attributes.
-                 Element* name = checkPop(elm_Name);
+                 Element* name = checkPop(ctx, elm_Name);
                  if (!name) return;
                  name->n = 2;
-                 name->attributes = malloc(2*sizeof(char*));
+                 name->attributes = arenaAlloc(ctx->arena, 2*sizeof(char*));
+                 if (!checkPointer(ctx, name->attributes)) return;
                  name->attributes[0] = attNames[att_input];
-                 name->attributes[1] = data;
-                 data = NULL;
-                 skipData = 1; // stop recording element content
-                 stackPush(stack, name);
+                 name->attributes[1] = NULL;
+                 if (ctx->dataLen >= 0) {
+                     name->attributes[1] = intern(ctx, ctx->data, ctx->dataLen);
+                     if (!checkPointer(ctx, name->attributes[1])) return;
+                 }
+                 ctx->dataLen = -1;
+                 ctx->skipData = 1; // stop recording element content
+                 stackPush(ctx->stack, name);
                  break;
             }
         case -1: return; // illegal element error
@@ -590,7 +812,7 @@ static void XMLCALL endElement(void *context, const char *elm) {
     }
     // All children of el removed from the stack.
     // The top element must be of type el now.
-    checkPeek(el);
+    checkPeek(ctx, el);
 }
 
 // Called to handle element data, e.g. "xy" in <Name>xy</Name>
@@ -599,26 +821,25 @@ static void XMLCALL endElement(void *context, const char *elm) {
 // For some reason, if the element data is the empty string (Eg. <a></a>)
 // instead of an empty string with len == 0 we get "\n". The workaround is
 // to replace this with the empty string whenever we encounter "\n".
+// The content is collected in ctx->data, which is reused for all elements.
 void XMLCALL handleData(void *context, const XML_Char *s, int len) {
-    int n;
-    if (skipData) return;
-    if (!data) {
-        // start a new data string
-        if (len == 1 && s[0] == '\n') {
-            data = strdup("");
-        } else {
-            data = malloc(len + 1);
-            strncpy(data, s, len);
-            data[len] = '\0';
-        }
+    ParserContext* ctx = (ParserContext*)context;
+    int start = ctx->dataLen < 0 ? 0 : ctx->dataLen;
+    if (ctx->skipData) return;
+    if (ctx->dataLen < 0 && len == 1 && s[0] == '\n') {
+        // start a new, empty data string
+        ctx->dataLen = 0;
+        return;
     }
-    else {
-        // continue existing string
-        n = strlen(data) + len;
-        data = realloc(data, n+1);
-        strncat(data, s, len);
-        data[n] = '\0';
+    if (start + len > ctx->dataSize) {
+        int size = 2 * (start + len);
+        char* data = realloc(ctx->data, size);
+        if (!checkPointer(ctx, data)) return;
+        ctx->data = data;
+        ctx->dataSize = size;
     }
+    memcpy(ctx->data + start, s, len);
+    ctx->dataLen = start + len;
     return;
 }
 
@@ -659,6 +880,8 @@ void printElement(int indent, void* element){
             printList(indent, (void **)md->vendorAnnotations);
             printList(indent, (void **)md->modelVariables);
             break;
+        case astElement:
+            break;
     }
 }
 
@@ -671,97 +894,147 @@ static void printList(int indent, void** list){
 // ------------------------------------------------------------------------- 
 // free memory of the AST
 
-static void freeList(void** list);
-
+// All nodes, strings and indexes of an AST are allocated in the arena
+// of its root node. Releasing the root releases the whole AST at once.
+// Other nodes are released with their root and are ignored here.
 void freeElement(void* element){
-    int i;
     Element* e = (Element*)element;
-    ModelDescription* md;
-    if (!e) return;
-    // free attributes
-    for (i=0; i<e->n; i+=2) 
-        free((void *)e->attributes[i+1]);
-    free(e->attributes);
-    // free child nodes
-    switch (getAstNodeType(e->type)) {
-        case astListElement:
-            freeList((void **)((ListElement*)e)->list);
-            break;
-        case astScalarVariable:
-            freeList((void **)((ScalarVariable*)e)->directDependencies);
-        case astType:
-            freeElement(((Type*)e)->typeSpec);
-            break;
-        case astModelDescription:
-            md = (ModelDescription*)e;
-            freeList((void **)md->unitDefinitions);
-            freeList((void **)md->typeDefinitions);
-            freeElement(md->defaultExperiment);
-            freeList((void **)md->vendorAnnotations);
-            freeList((void **)md->modelVariables);
-            break;
+    if (!e || e->type != elm_fmiModelDescription) return;
+    arenaFree(((ModelDescription*)e)->arena); // e is part of the arena
+}
+
+// ------------------------------------------------------------------------- 
+// Entry function parse() of the XML parser 
+
+// Returns NULL to indicate failure
+// The context can be used for any number of calls to parseCtx and
+// parseBufferCtx, one at a time. Use one context per thread to parse
+// several model descriptions concurrently.
+ParserContext* newParserContext() {
+    ParserContext* ctx = (ParserContext*)calloc(1, sizeof(ParserContext));
+    if (!checkPointer(NULL, ctx)) return NULL;  // failure
+    ctx->stack = stackNew(100, 10);
+    ctx->parser = XML_ParserCreate(NULL);
+    ctx->dataLen = -1;
+    if (!checkPointer(NULL, ctx->stack) || !checkPointer(NULL, ctx->parser)) {
+        freeParserContext(ctx);
+        return NULL;  // failure
     }
-    // free the struct
-    free(e);
+    return ctx;
 }
 
-static void freeList(void** list){
-    int i;
-    if (!list) return;
-    for (i=0; list[i]; i++) 
-        freeElement(list[i]);
-    free(list);
+void freeParserContext(ParserContext* ctx) {
+    if (!ctx) return;
+    if (ctx->stack) stackFree(ctx->stack);
+    if (ctx->parser) XML_ParserFree(ctx->parser);
+    if (ctx->data) free(ctx->data);
+    if (ctx->internTable) free((void*)ctx->internTable);
+    arenaFree(ctx->arena);
+    free(ctx);
 }
 
-// ------------------------------------------------------------------------- 
-// Entry function parse() of the XML parser 
+// Returns 0 to indicate failure
+// Prepare the context for parsing a new document
+static int resetParser(ParserContext* ctx) {
+    XML_ParserReset(ctx->parser, NULL); // also clears the handlers
+    XML_SetUserData(ctx->parser, ctx);
+    XML_SetElementHandler(ctx->parser, startElement, endElement);
+    XML_SetCharacterDataHandler(ctx->parser, handleData);
+    while (!stackIsEmpty(ctx->stack)) stackPop(ctx->stack);
+    ctx->dataLen = -1;
+    ctx->skipData = 0;
+    if (ctx->internTable) memset((void*)ctx->internTable, 0, ctx->internSize * sizeof(char*));
+    ctx->internCount = 0;
+    arenaFree(ctx->arena);
+    ctx->arena = arenaNew(ARENA_BLOCKSIZE);
+    return checkPointer(NULL, ctx->arena);
+}
 
-static void cleanup(FILE *file) {
-    stackFree(stack);
-    stack = NULL;
-    XML_ParserFree(parser);
-    parser = NULL;
-    fclose(file);
+// Feeds the next n bytes of the document to the parser.
+// Returns 0 to indicate failure, the AST built so far is then released.
+static int parseChunk(ParserContext* ctx, const char* chunk, int n, int done, const char* xmlPath) {
+    if (XML_Parse(ctx->parser, chunk, n, done)) return 1; // success
+    printf("Parse error in file %s at line %d:\n%s\n", 
+            xmlPath,
+            (int)XML_GetCurrentLineNumber(ctx->parser),
+            XML_ErrorString(XML_GetErrorCode(ctx->parser)));
+    while (! stackIsEmpty(ctx->stack)) stackPop(ctx->stack);
+    arenaFree(ctx->arena);
+    ctx->arena = NULL;
+    return 0; // failure
+}
+
+// Returns NULL to indicate failure
+// Takes the root node of a completely parsed document from the stack,
+// builds the indexes for variable lookup and decodes the variables.
+static ModelDescription* finishParse(ParserContext* ctx) {
+    ModelDescription* md = stackPop(ctx->stack);
+    assert(stackIsEmpty(ctx->stack));
+    md->arena = ctx->arena; // the AST owns the arena from now on
+    ctx->arena = NULL;
+    if (!buildTypeIndex(md)) {
+        printf("Out of memory\n");
+        freeElement(md);
+        return NULL; // failure
+    }
+    decodeVariables(md);
+    buildVariableIndex(md);
+    //printElement(1, md); // debug
+    return md; // success if all refs are valid    
 }
 
 // Returns NULL to indicate failure
 // Otherwise, return the root node md of the AST.
 // The receiver must call freeElement(md) to release AST memory.
-ModelDescription* parse(const char* xmlPath) {
-    ModelDescription* md = NULL;
+ModelDescription* parseCtx(ParserContext* ctx, const char* xmlPath) {
     FILE *file;
     int done = 0;
-    stack = stackNew(100, 10);
-    if (!checkPointer(stack)) return NULL;  // failure
-    parser = XML_ParserCreate(NULL);
-    if (!checkPointer(parser)) return NULL;  // failure
-    XML_SetElementHandler(parser, startElement, endElement);
-    XML_SetCharacterDataHandler(parser, handleData);
   	file = fopen(xmlPath, "rb");
 	if (file == NULL) {
         printf("Cannot open file '%s'\n", xmlPath);
-     	XML_ParserFree(parser);
+        return NULL; // failure
+    }
+    if (!resetParser(ctx)) {
+        fclose(file);
         return NULL; // failure
     }
     while (!done) {
-        int n = fread(text, sizeof(char), XMLBUFSIZE, file);
+        int n = fread(ctx->text, sizeof(char), XMLBUFSIZE, file);
 	    if (n != XMLBUFSIZE) done = 1;
-        if (!XML_Parse(parser, text, n, done)){
-             printf("Parse error in file %s at line %d:\n%s\n", 
-                     xmlPath,
-                         (int)XML_GetCurrentLineNumber(parser),
-	                 XML_ErrorString(XML_GetErrorCode(parser)));
-             while (! stackIsEmpty(stack)) md = stackPop(stack);
-             if (md) freeElement(md);
-             cleanup(file);
+        if (!parseChunk(ctx, ctx->text, n, done, xmlPath)) {
+             fclose(file);
              return NULL; // failure
         }
     }
-    md = stackPop(stack);
-    assert(stackIsEmpty(stack));
-    cleanup(file);
-    //printElement(1, md); // debug
-    return md; // success if all refs are valid    
+    fclose(file);
+    return finishParse(ctx);
+}
+
+// Same as parseCtx(), for a document of n bytes that is already in memory,
+// e.g. read directly from the FMU archive. name is used in error messages.
+ModelDescription* parseBufferCtx(ParserContext* ctx, const char* buffer, int n, const char* name) {
+    if (!resetParser(ctx)) return NULL; // failure
+    if (!parseChunk(ctx, buffer, n, 1, name)) return NULL; // failure
+    return finishParse(ctx);
 }
 
+// Parse using a context of its own, see parseCtx
+ModelDescription* parse(const char* xmlPath) {
+    ModelDescription* md;
+    ParserContext* ctx = newParserContext();
+    if (!ctx) return NULL; // failure
+    md = parseCtx(ctx, xmlPath);
+    freeParserContext(ctx);
+    return md;
+}
+
+// Parse using a context of its own, see parseBufferCtx
+ModelDescription* parseBuffer(const char* buffer, int n, const char* name) {
+    ModelDescription* md;
+    ParserContext* ctx = newParserContext();
+    if (!ctx) return NULL; // failure
+    md = parseBufferCtx(ctx, buffer, n, name);
+    freeParserContext(ctx);
+    return md;
+}
 
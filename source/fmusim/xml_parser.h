@@ -13,6 +13,7 @@
 #include "expat.h"
 #include "fmiModelTypes.h"
 #include "stack.h"
+#include "arena.h"
 
 #define SIZEOF_ELM 25
 extern const char *elmNames[SIZEOF_ELM];
@@ -72,6 +73,14 @@ typedef struct {
     Element* typeSpec; // one of RealType, IntegerType etc. 
 } Type;
 
+// Flags for the optional attributes decoded into a ScalarVariable
+typedef enum {
+    hasStart   = 1<<0,
+    hasNominal = 1<<1,
+    hasMin     = 1<<2,
+    hasMax     = 1<<3
+} DecodedAttributes;
+
 // AST node for element ScalarVariable
 typedef struct {
     Elm type;          // element type 
@@ -79,8 +88,31 @@ typedef struct {
     int n;             // size of attributes, even number
     Element* typeSpec; // one of Real, Integer, etc
     Element** directDependencies; // null or null-terminated list of Name
+    // Attribute values decoded once after parsing, valid if decoded is 1.
+    // min, max and nominal include defaults from the declared type.
+    int decoded;
+    fmiValueReference vr;  // fmiUndefinedValueReference if missing
+    Enu causality;
+    Enu variability;
+    Enu alias;
+    Elm baseType;          // Real, Integer (also for Enumeration), Boolean or String
+    int defined;           // DecodedAttributes present in the XML
+    double start;          // Real, Integer, Enumeration and Boolean only
+    double nominal;        // Real only
+    double min;            // Real, Integer and Enumeration only
+    double max;            // Real, Integer and Enumeration only
 } ScalarVariable;
 
+// Hash tables for finding variables and types, built once after parsing.
+// Open addressing with linear probing, sizes are powers of 2.
+typedef struct {
+    int size;                    // number of slots in byVr and byName
+    ScalarVariable** byVr;       // key: base type and value reference
+    ScalarVariable** byName;     // key: variable name
+    int typesSize;               // number of slots in types
+    Type** types;                // key: type name
+} VariableIndex;
+
 // AST node for element ModelDescription
 typedef struct {
     Elm type;          // element type
@@ -91,6 +123,8 @@ typedef struct {
     Element*      defaultExperiment;  // NULL or DefaultExperiment
     ListElement** vendorAnnotations;  // NULL or null-terminated list of Tools
     ScalarVariable** modelVariables;  // NULL or null-terminated list of ScalarVariable
+    VariableIndex* index;             // NULL or index of modelVariables and typeDefinitions
+    Arena* arena;                     // holds all nodes, strings and the index of the AST
 } ModelDescription;
 
 // types of AST nodes used to represent an element
@@ -109,8 +143,31 @@ typedef enum {
     valueIllegal
 } ValueStatus;
 
+// State of the parser while parsing one document.
+// Passed to the Expat callbacks as user data, so that
+// several documents can be parsed concurrently.
+#define XMLBUFSIZE 1024
+typedef struct {
+    XML_Parser parser;      // the Expat parser, reset for each document
+    Stack* stack;           // the parser stack
+    Arena* arena;           // arena of the AST being built
+    char* data;             // buffer that holds element content, see handleData
+    int dataLen;            // length of content in data, -1 if none
+    int dataSize;           // allocated size of data
+    int skipData;           // 1 to ignore element content, 0 when recordig content
+    const char** internTable; // hash set of attribute values in the arena
+    int internSize;         // number of slots in internTable, a power of 2
+    int internCount;        // number of values in internTable
+    char text[XMLBUFSIZE];  // XML file is parsed in chunks of length XMLBUFSIZE
+} ParserContext;
+
 // Public methods: Parsing and low-level AST access
 ModelDescription* parse(const char* xmlPath);
+ModelDescription* parseBuffer(const char* buffer, int n, const char* name);
+ParserContext* newParserContext();
+void freeParserContext(ParserContext* ctx);
+ModelDescription* parseCtx(ParserContext* ctx, const char* xmlPath);
+ModelDescription* parseBufferCtx(ParserContext* ctx, const char* buffer, int n, const char* name);
 const char* getString(void* element, Att a);
 double getDouble     (void* element, Att a, ValueStatus* vs);
 int getInt           (void* element, Att a, ValueStatus* vs);
@@ -118,6 +175,8 @@ unsigned int getUInt (void* element, Att a, ValueStatus* vs);
 char getBoolean      (void* element, Att a, ValueStatus* vs);
 Enu getEnumValue     (void* element, Att a, ValueStatus* vs);
 void freeElement     (void* element);
+AstNodeType getAstNodeType(Elm e);
+int indexModelDescription(ModelDescription* md);
 
 // Convenience methods for AST access. To be used afer successful validation only.
 const char* getModelIdentifier(ModelDescription* md);
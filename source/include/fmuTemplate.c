@@ -71,9 +71,23 @@ const char* fmiGetVersion() {
 // FMI functions: creation and destruction of a model instance
 // ---------------------------------------------------------------------------
 
+// size of a cache line, the alignment of the instance and of each of its arrays
+#define CACHE_LINE 64
+
+// size rounded up to whole cache lines
+#define cacheLines(size) (((size) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1))
+
 fmiComponent fmiInstantiateModel(fmiString instanceName, fmiString GUID, 
         fmiCallbackFunctions functions, fmiBoolean loggingOn) {
     ModelInstance* comp;
+    char *block, *start;
+    // offsets of the arrays from the start of the instance
+    size_t offsetR = cacheLines(sizeof(ModelInstance));
+    size_t offsetI = offsetR + cacheLines(NUMBER_OF_REALS    * sizeof(fmiReal));
+    size_t offsetB = offsetI + cacheLines(NUMBER_OF_INTEGERS * sizeof(fmiInteger));
+    size_t offsetS = offsetB + cacheLines(NUMBER_OF_BOOLEANS * sizeof(fmiBoolean));
+    size_t offsetZ = offsetS + cacheLines(NUMBER_OF_STRINGS  * sizeof(fmiString));
+    size_t size    = offsetZ + cacheLines(NUMBER_OF_EVENT_INDICATORS * sizeof(fmiBoolean));
     if (!functions.logger) 
         return NULL;
     if (!functions.allocateMemory || !functions.freeMemory){ 
@@ -91,19 +105,22 @@ fmiComponent fmiInstantiateModel(fmiString instanceName, fmiString GUID,
                 "fmiInstantiateModel: Wrong GUID %s. Expected %s.", GUID, MODEL_GUID);
         return NULL;
     }
-    comp = (ModelInstance *)functions.allocateMemory(1, sizeof(ModelInstance));
-    if (comp) {
-        comp->r = calloc(NUMBER_OF_REALS,    sizeof(fmiReal));
-        comp->i = calloc(NUMBER_OF_INTEGERS, sizeof(fmiInteger));
-        comp->b = calloc(NUMBER_OF_BOOLEANS, sizeof(fmiBoolean));
-        comp->s = calloc(NUMBER_OF_STRINGS,  sizeof(fmiString));
-        comp->isPositive = calloc(NUMBER_OF_EVENT_INDICATORS, sizeof(fmiBoolean));
-    }
-    if (!comp || !comp->r || !comp->i || !comp->b || !comp->s || !comp->isPositive) {
+    // the instance and all its arrays in one zeroed block of the host, 
+    // with room to start the instance on a cache line
+    block = (char *)functions.allocateMemory(1, size + CACHE_LINE - 1);
+    if (!block) {
         functions.logger(NULL, instanceName, fmiError, "error", 
                 "fmiInstantiateModel: Out of memory.");
         return NULL;
     }
+    start = block + (CACHE_LINE - (size_t)block % CACHE_LINE) % CACHE_LINE;
+    comp = (ModelInstance *)start;
+    comp->block = block;
+    comp->r = (fmiReal *)(start + offsetR);
+    comp->i = (fmiInteger *)(start + offsetI);
+    comp->b = (fmiBoolean *)(start + offsetB);
+    comp->s = (fmiString *)(start + offsetS);
+    comp->isPositive = (fmiBoolean *)(start + offsetZ);
     if (comp->loggingOn) comp->functions.logger(NULL, instanceName, fmiOK, "log", 
             "fmiInstantiateModel: GUID=%s", GUID);
     comp->instanceName = instanceName;
@@ -130,11 +147,7 @@ void fmiFreeModelInstance(fmiComponent c) {
     if (!comp) return;
     if (comp->loggingOn) comp->functions.logger(c, comp->instanceName, fmiOK, "log", 
             "fmiFreeModelInstance");
-    if (comp->r) comp->functions.freeMemory(comp->r);
-    if (comp->i) comp->functions.freeMemory(comp->i);
-    if (comp->b) comp->functions.freeMemory(comp->b);
-    if (comp->s) comp->functions.freeMemory(comp->s);
-    comp->functions.freeMemory(comp);
+    comp->functions.freeMemory(comp->block);
 }
 
 // ---------------------------------------------------------------------------
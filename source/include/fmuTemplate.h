@@ -37,6 +37,7 @@ typedef struct {
     fmiCallbackFunctions functions;
     fmiBoolean loggingOn;
     ModelState state;
+    void* block; // memory of the instance and its arrays, to be freed
 } ModelInstance;
 
 